@@ -4,10 +4,12 @@ import os
 import pathlib
 import signal
 import sys
+import time
 from contextlib import suppress
 from textwrap import dedent
 from typing import Any
 from typing import Dict
+from typing import List
 from typing import NoReturn
 from typing import Optional
 from typing import Set
@@ -15,6 +17,7 @@ from typing import Set
 from pystack import __version__
 from pystack.errors import InvalidPythonProcess
 from pystack.process import decompress_gzip
+from pystack.process import get_process_tree
 from pystack.process import is_elf
 from pystack.process import is_gzip
 
@@ -23,9 +26,13 @@ from . import print_threads
 from .colors import colored
 from .engine import CoreFileAnalyzer
 from .engine import NativeReportingMode
+from .engine import SamplingSession
+from .engine import StackAggregator
 from .engine import StackMethod
+from .engine import StopMethod
 from .engine import get_process_threads
 from .engine import get_process_threads_for_core
+from .engine import get_processes_threads
 
 PERMISSION_ERROR_MSG = "Operation not permitted"
 NO_SUCH_PROCESS_ERROR_MSG = "No such process"
@@ -144,12 +151,32 @@ def generate_cli_parser() -> argparse.ArgumentParser:
         parents=[general_options_parser],
     )
     remote_parser.set_defaults(func=process_remote)
-    remote_parser.add_argument("pid", type=int, help="The PID of the remote process")
+    remote_parser.add_argument(
+        "pid",
+        type=int,
+        nargs="+",
+        help="The PID of the remote process. Several PIDs can be given, in "
+        "which case the processes are inspected concurrently",
+    )
+    remote_parser.add_argument(
+        "--tree",
+        action="store_true",
+        default=False,
+        help="Also inspect every descendant of the given processes",
+    )
+    remote_parser.add_argument(
+        "--workers",
+        type=int,
+        default=8,
+        help="Maximum number of processes inspected at the same time when "
+        "several are given (default: 8)",
+    )
     remote_parser.add_argument(
         "--no-block",
         dest="block",
         action="store_false",
-        help="do not block the process when inspecting its memory",
+        help="do not block the process when inspecting its memory. Native "
+        "stacks are captured by stopping one thread at a time, very briefly",
     )
     remote_parser.add_argument(
         "--native",
@@ -177,6 +204,16 @@ def generate_cli_parser() -> argparse.ArgumentParser:
         help="Include native (C) frames only after the last python frame "
         "in the resulting stack trace",
     )
+    remote_parser.add_argument(
+        "--native-symbols",
+        action="store_const",
+        dest="native_mode",
+        const=NativeReportingMode.SYMBOLS,
+        default=NativeReportingMode.OFF,
+        help="Include the native (C) frames in the resulting stack trace, "
+        "resolving only their symbol names. Skips loading the debugging "
+        "information, so file names and line numbers are not reported",
+    )
     remote_parser.add_argument(
         "--locals",
         action="store_true",
@@ -189,6 +226,89 @@ def generate_cli_parser() -> argparse.ArgumentParser:
         default=False,
         help="Use all possible methods to obtain the Python stack info (may be slow)",
     )
+    remote_parser.add_argument(
+        "--frame-pointers",
+        action="store_true",
+        default=False,
+        help="Unwind native stacks by following frame pointers, falling back to "
+        "DWARF unwinding only where the chain breaks. Faster, but frames of "
+        "functions built without frame pointers may be missing",
+    )
+    remote_parser.add_argument(
+        "--stop-method",
+        choices=["ptrace", "cgroup", "signal"],
+        default="ptrace",
+        help="How to stop the process while it is inspected: attach to every "
+        "thread with ptrace (the default), freeze the cgroup v2 the process "
+        "runs in (it must be the only process in it), or send it SIGSTOP",
+    )
+    remote_parser.add_argument(
+        "--timings",
+        action="store_true",
+        default=False,
+        help="Report how long the process was stopped for and how much time "
+        "was spent in each phase of the analysis",
+    )
+    remote_parser.add_argument(
+        "--group",
+        action="store_true",
+        default=False,
+        help="Report threads with identical stacks only once, together with "
+        "the TIDs of all of them",
+    )
+    remote_parser.add_argument(
+        "--timeout",
+        type=float,
+        default=None,
+        help="Stop the analysis after this many seconds and report what was "
+        "gathered so far. Threads that could not be fully inspected in time "
+        "are marked as incomplete",
+    )
+    remote_parser.add_argument(
+        "--tid",
+        dest="tids",
+        type=int,
+        action="append",
+        default=None,
+        help="Only report the thread with this TID (can be given several times)",
+    )
+    remote_parser.add_argument(
+        "--thread-name",
+        default=None,
+        help="Only report the threads whose name matches this glob pattern",
+    )
+    remote_parser.add_argument(
+        "--gil-only",
+        action="store_true",
+        default=False,
+        help="Only report the thread holding the GIL",
+    )
+    remote_parser.add_argument(
+        "--gc-only",
+        action="store_true",
+        default=False,
+        help="Only report the thread running the garbage collector",
+    )
+    remote_parser.add_argument(
+        "--sample",
+        action="store_true",
+        default=False,
+        help="Sample the Python stacks of the process repeatedly and print how "
+        "often each one was seen, in the collapsed stack format used by flame "
+        "graph tools",
+    )
+    remote_parser.add_argument(
+        "--rate",
+        type=float,
+        default=100,
+        help="Number of samples per second taken with --sample (default: 100)",
+    )
+    remote_parser.add_argument(
+        "--duration",
+        type=float,
+        default=10,
+        help="Number of seconds to sample for with --sample (default: 10)",
+    )
     core_parser = subparsers.add_parser(
         "core",
         help="Analyze a core dump file given its location and the executable",
@@ -232,6 +352,16 @@ def generate_cli_parser() -> argparse.ArgumentParser:
         help="Include native (C) frames only after the last python frame "
         "in the resulting stack trace",
     )
+    core_parser.add_argument(
+        "--native-symbols",
+        action="store_const",
+        dest="native_mode",
+        const=NativeReportingMode.SYMBOLS,
+        default=NativeReportingMode.OFF,
+        help="Include the native (C) frames in the resulting stack trace, "
+        "resolving only their symbol names. Skips loading the debugging "
+        "information, so file names and line numbers are not reported",
+    )
     core_parser.add_argument(
         "--locals",
         action="store_true",
@@ -244,6 +374,39 @@ def generate_cli_parser() -> argparse.ArgumentParser:
         default=False,
         help="Use all possible methods to obtain the Python stack info (may be slow)",
     )
+    core_parser.add_argument(
+        "--timings",
+        action="store_true",
+        default=False,
+        help="Report how much time was spent in each phase of the analysis",
+    )
+    core_parser.add_argument(
+        "--group",
+        action="store_true",
+        default=False,
+        help="Report threads with identical stacks only once, together with "
+        "the TIDs of all of them",
+    )
+    core_parser.add_argument(
+        "--tid",
+        dest="tids",
+        type=int,
+        action="append",
+        default=None,
+        help="Only report the thread with this TID (can be given several times)",
+    )
+    core_parser.add_argument(
+        "--gil-only",
+        action="store_true",
+        default=False,
+        help="Only report the thread holding the GIL",
+    )
+    core_parser.add_argument(
+        "--gc-only",
+        action="store_true",
+        default=False,
+        help="Only report the thread running the garbage collector",
+    )
     search_path_group = core_parser.add_mutually_exclusive_group()
     search_path_group.add_argument(
         "--lib-search-path",
@@ -284,17 +447,149 @@ def main() -> None:
 
 
 def process_remote(parser: argparse.ArgumentParser, args: argparse.Namespace) -> None:
-    if not args.block and args.native_mode != NativeReportingMode.OFF:
-        parser.error("Native traces are only available in blocking mode")
+    if not args.block and args.stop_method != "ptrace":
+        parser.error("--stop-method can't be used with --no-block")
+    if args.timeout is not None and args.timeout <= 0:
+        parser.error("--timeout must be positive")
+    if args.frame_pointers and args.native_mode == NativeReportingMode.OFF:
+        parser.error("--frame-pointers can only be used with a --native mode")
+
+    pids: List[int] = []
+    for pid in args.pid:
+        for tree_pid in get_process_tree(pid) if args.tree else [pid]:
+            if tree_pid not in pids:
+                pids.append(tree_pid)
+    if args.tree or len(pids) > 1:
+        if args.sample or args.timings or args.timeout is not None:
+            parser.error(
+                "--sample, --timings and --timeout can only be used with a "
+                "single process"
+            )
+        if args.workers <= 0:
+            parser.error("--workers must be positive")
+        process_remote_many(args, pids)
+        return
+
+    if args.sample:
+        if args.native_mode != NativeReportingMode.OFF:
+            parser.error("--sample only reports Python frames")
+        if args.locals or args.timings or args.group or args.timeout is not None:
+            parser.error(
+                "--locals, --timings, --group and --timeout can't be used with "
+                "--sample"
+            )
+        if args.tids or args.thread_name is not None or args.gil_only or args.gc_only:
+            parser.error(
+                "--tid, --thread-name, --gil-only and --gc-only can't be used "
+                "with --sample"
+            )
+        if args.rate <= 0 or args.duration <= 0:
+            parser.error("--rate and --duration must be positive")
+        sample_process(args, pids[0])
+        return
 
+    timings: Optional[Dict[str, Any]] = {} if args.timings else None
     threads = get_process_threads(
-        args.pid,
+        pids[0],
         stop_process=args.block,
         native_mode=args.native_mode,
         locals=args.locals,
         method=StackMethod.ALL if args.exhaustive else StackMethod.AUTO,
+        frame_pointers=args.frame_pointers,
+        stop_method=StopMethod[args.stop_method.upper()],
+        timings=timings,
+        group=args.group,
+        timeout=args.timeout,
+        tids=args.tids,
+        thread_name=args.thread_name,
+        gil_only=args.gil_only,
+        gc_only=args.gc_only,
     )
     print_threads(threads, args.native_mode)
+    if timings is not None:
+        print(format_timings(timings), file=sys.stderr)
+
+
+def process_remote_many(args: argparse.Namespace, pids: List[int]) -> None:
+    results = get_processes_threads(
+        pids,
+        stop_process=args.block,
+        native_mode=args.native_mode,
+        locals=args.locals,
+        method=StackMethod.ALL if args.exhaustive else StackMethod.AUTO,
+        frame_pointers=args.frame_pointers,
+        stop_method=StopMethod[args.stop_method.upper()],
+        max_workers=args.workers,
+        group=args.group,
+        tids=args.tids,
+        thread_name=args.thread_name,
+        gil_only=args.gil_only,
+        gc_only=args.gc_only,
+    )
+    failures = []
+    for pid in pids:
+        result = results[pid]
+        print(colored(f"Process {pid}:", "blue"))
+        if isinstance(result, BaseException):
+            failures.append(result)
+            print(produce_error_message(result), file=sys.stderr)
+            continue
+        print_threads(result, args.native_mode)
+    if len(failures) == len(pids):
+        raise failures[0]
+
+
+def sample_process(args: argparse.Namespace, pid: int) -> None:
+    aggregator = StackAggregator()
+    interval = 1 / args.rate
+    with SamplingSession(
+        pid,
+        stop_process=args.block,
+        method=StackMethod.ALL if args.exhaustive else StackMethod.AUTO,
+        stop_method=StopMethod[args.stop_method.upper()],
+    ) as session:
+        next_sample = time.monotonic()
+        deadline = next_sample + args.duration
+        try:
+            while next_sample < deadline:
+                session.sample(aggregator)
+                # If a sample took longer than the interval, don't try to
+                # catch up by sampling in a tight loop.
+                next_sample = max(next_sample + interval, time.monotonic())
+                time.sleep(max(0.0, min(next_sample, deadline) - time.monotonic()))
+        except KeyboardInterrupt:
+            pass
+        except errors.EngineError as the_error:
+            if not aggregator.samples:
+                raise
+            LOGGER.warning("Stopped sampling early: %s", the_error)
+
+    for stack, count in aggregator.collapsed():
+        print(f"{stack} {count}")
+    if aggregator.truncated_samples:
+        LOGGER.warning(
+            "%d of %d samples were truncated because too many distinct stacks "
+            "were seen",
+            aggregator.truncated_samples,
+            aggregator.samples,
+        )
+
+
+def format_timings(timings: Dict[str, Any]) -> str:
+    def as_ms(seconds: float) -> str:
+        return f"{seconds * 1000:10.3f} ms"
+
+    lines = [colored("Timings:", "blue")]
+    for phase, seconds in timings["phases"].items():
+        lines.append(f"  {phase.replace('_', ' '):<24}{as_ms(seconds)}")
+    lines.append(f"  {'total':<24}{as_ms(timings['total'])}")
+    if timings["target_stopped"] is not None:
+        lines.append(
+            f"  {'target stopped':<24}{colored(as_ms(timings['target_stopped']), 'green')}"
+        )
+    if timings["stop_skew"] is not None:
+        lines.append(f"  {'stop skew':<24}{as_ms(timings['stop_skew'])}")
+    return "\n".join(lines)
 
 
 def format_psinfo_information(psinfo: Dict[str, Any]) -> str:
@@ -414,6 +709,7 @@ def process_core(parser: argparse.ArgumentParser, args: argparse.Namespace) -> N
                 elf_id if elf_id else "<MISSING>",
             )
 
+    timings: Optional[Dict[str, Any]] = {} if args.timings else None
     threads = get_process_threads_for_core(
         corefile,
         executable,
@@ -421,8 +717,15 @@ def process_core(parser: argparse.ArgumentParser, args: argparse.Namespace) -> N
         native_mode=args.native_mode,
         locals=args.locals,
         method=StackMethod.ALL if args.exhaustive else StackMethod.AUTO,
+        timings=timings,
+        group=args.group,
+        tids=args.tids,
+        gil_only=args.gil_only,
+        gc_only=args.gc_only,
     )
     print_threads(threads, args.native_mode)
+    if timings is not None:
+        print(format_timings(timings), file=sys.stderr)
 
 
 if __name__ == "__main__":  # pragma: no cover
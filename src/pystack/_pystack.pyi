@@ -6,11 +6,13 @@ from typing import Dict
 from typing import Iterable
 from typing import List
 from typing import Optional
+from typing import Sequence
 from typing import Set
 from typing import Tuple
 from typing import TypeVar
 from typing import Union
 
+from .errors import PystackError
 from .maps import VirtualMap
 from .types import PyThread
 
@@ -35,6 +37,12 @@ class NativeReportingMode(enum.Enum):
     PYTHON = 1
     ALL = 1000
     LAST = 2000
+    SYMBOLS = 3000
+
+class StopMethod(enum.Enum):
+    PTRACE = 0
+    CGROUP = 1
+    SIGNAL = 2
 
 class StackMethod(enum.Enum):
     ELF_DATA = 1
@@ -52,7 +60,11 @@ class ProcessManager:
 
     @classmethod
     def create_from_pid(
-        cls, pid: int, stop_process: bool = True
+        cls,
+        pid: int,
+        stop_process: bool = True,
+        frame_pointers: bool = False,
+        stop_method: StopMethod = StopMethod.PTRACE,
     ) -> "ProcessManager": ...
     @classmethod
     def create_from_core(
@@ -66,13 +78,64 @@ class ProcessManager:
     def __enter__(self) -> "ProcessManager": ...
     def __exit__(self, exc_type: Any, exc_val: Any, exc_tb: Any) -> None: ...
 
+class StackAggregator:
+    samples: int
+    truncated_samples: int
+    nodes: int
+
+    def __init__(self, max_nodes: int = ...) -> None: ...
+    def collapsed(self) -> List[Tuple[str, int]]: ...
+    def clear(self) -> None: ...
+
+class SamplingSession(ProcessManager):
+    def __init__(
+        self,
+        pid: int,
+        stop_process: bool = True,
+        native_mode: NativeReportingMode = NativeReportingMode.OFF,
+        locals: bool = False,
+        method: StackMethod = StackMethod.AUTO,
+        frame_pointers: bool = False,
+        stop_method: StopMethod = StopMethod.PTRACE,
+    ) -> None: ...
+    def snapshot(
+        self, timings: Optional[Dict[str, Any]] = None, group: bool = False
+    ) -> List[PyThread]: ...
+    def sample(self, aggregator: StackAggregator) -> int: ...
+    def close(self) -> None: ...
+    def __enter__(self) -> "SamplingSession": ...
+
 def get_process_threads(
     pid: int,
     stop_process: bool = True,
     native_mode: NativeReportingMode = NativeReportingMode.OFF,
     locals: bool = False,
     method: StackMethod = StackMethod.AUTO,
+    frame_pointers: bool = False,
+    stop_method: StopMethod = StopMethod.PTRACE,
+    timings: Optional[Dict[str, Any]] = None,
+    group: bool = False,
+    timeout: Optional[float] = None,
+    tids: Optional[Sequence[int]] = None,
+    thread_name: Optional[str] = None,
+    gil_only: bool = False,
+    gc_only: bool = False,
 ) -> List[PyThread]: ...
+def get_processes_threads(
+    pids: Iterable[int],
+    stop_process: bool = True,
+    native_mode: NativeReportingMode = NativeReportingMode.OFF,
+    locals: bool = False,
+    method: StackMethod = StackMethod.AUTO,
+    frame_pointers: bool = False,
+    stop_method: StopMethod = StopMethod.PTRACE,
+    max_workers: int = 8,
+    group: bool = False,
+    tids: Optional[Sequence[int]] = None,
+    thread_name: Optional[str] = None,
+    gil_only: bool = False,
+    gc_only: bool = False,
+) -> Dict[int, Union[List[PyThread], PystackError]]: ...
 def get_process_threads_for_core(
     core_file: Union[str, pathlib.Path],
     executable: Union[str, pathlib.Path],
@@ -80,6 +143,11 @@ def get_process_threads_for_core(
     native_mode: NativeReportingMode = NativeReportingMode.PYTHON,
     locals: bool = False,
     method: StackMethod = StackMethod.AUTO,
+    timings: Optional[Dict[str, Any]] = None,
+    group: bool = False,
+    tids: Optional[Sequence[int]] = None,
+    gil_only: bool = False,
+    gc_only: bool = False,
 ) -> List[PyThread]: ...
 def get_bss_info(binary: Union[str, pathlib.Path]) -> Optional[Dict[str, Any]]: ...
 def _check_interpreter_shutdown(manager: ProcessManager) -> None: ...
@@ -89,6 +157,10 @@ def _normalize_threads_for_testing(
     native_mode: NativeReportingMode,
     python_version: Tuple[int, int],
 ) -> List[PyThread]: ...
+def _parse_maps_for_testing(contents: str) -> List[VirtualMap]: ...
+def _get_version_from_elf_section_for_testing(
+    data: bytes,
+) -> Optional[Tuple[int, int]]: ...
 
 F = TypeVar("F", bound=Callable[..., Any])
 
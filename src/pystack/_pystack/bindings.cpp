@@ -10,14 +10,19 @@
 #include <nanobind/stl/unordered_map.h>
 #include <nanobind/stl/vector.h>
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <memory>
 #include <numeric>
 #include <optional>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
 #include "corefile.h"
+#include "deadline.h"
 #include "elf_common.h"
 #include "interpreter.h"
 #include "logging.h"
@@ -25,7 +30,10 @@
 #include "mem.h"
 #include "native_frame.h"
 #include "process.h"
+#include "stack_aggregator.h"
 #include "thread_builder.h"
+#include "timing.h"
+#include "version_detector.h"
 
 namespace nb = nanobind;
 using namespace nb::literals;
@@ -114,8 +122,33 @@ enum class NativeReportingMode {
     PYTHON = 1,
     ALL = 1000,
     LAST = 2000,
+    SYMBOLS = 3000,
 };
 
+static nb::list
+buildVirtualMapObjects(const std::vector<pystack::VirtualMap>& maps, const pystack::StringTable& strings)
+{
+    nb::module_ pystack_maps = nb::module_::import_("pystack.maps");
+    nb::object VirtualMap = pystack_maps.attr("VirtualMap");
+
+    nb::list result;
+    for (const auto& map : maps) {
+        const std::string& path_str = map.Path(strings);
+        nb::object path_obj = path_str.empty() ? nb::none() : nb::cast(std::filesystem::path(path_str));
+        nb::object vm = VirtualMap(
+                map.Start(),
+                map.End(),
+                map.FileSize(),
+                map.Offset(),
+                map.Device(strings),
+                map.Flags(),
+                map.Inode(),
+                path_obj);
+        result.append(vm);
+    }
+    return result;
+}
+
 class CoreFileAnalyzerWrapper
 {
   public:
@@ -143,28 +176,8 @@ class CoreFileAnalyzerWrapper
     {
         auto mapped_files = d_extractor->extractMappedFiles();
         auto memory_maps = d_extractor->MemoryMaps();
-        auto maps = parseCoreFileMaps(mapped_files, memory_maps);
-
-        nb::module_ pystack_maps = nb::module_::import_("pystack.maps");
-        nb::object VirtualMap = pystack_maps.attr("VirtualMap");
-
-        nb::list result;
-        for (const auto& map : maps) {
-            std::string path_str = map.Path();
-            nb::object path_obj =
-                    path_str.empty() ? nb::none() : nb::cast(std::filesystem::path(path_str));
-            nb::object vm = VirtualMap(
-                    map.Start(),
-                    map.End(),
-                    map.FileSize(),
-                    map.Offset(),
-                    map.Device(),
-                    map.Flags(),
-                    map.Inode(),
-                    path_obj);
-            result.append(vm);
-        }
-        return result;
+        pystack::StringTable strings;
+        return buildVirtualMapObjects(parseCoreFileMaps(mapped_files, memory_maps, strings), strings);
     }
 
     int extract_pid() const
@@ -301,9 +314,14 @@ class ProcessManagerWrapper
     {
     }
 
-    static std::unique_ptr<ProcessManagerWrapper> create_from_pid(pid_t pid, bool stop_process)
+    static std::unique_ptr<ProcessManagerWrapper> create_from_pid(
+            pid_t pid,
+            bool stop_process,
+            bool frame_pointers = false,
+            pystack::StopMethod stop_method = pystack::StopMethod::PTRACE)
     {
-        auto manager = pystack::ProcessManager::create(pid, stop_process);
+        auto manager =
+                pystack::ProcessManager::create(pid, stop_process, frame_pointers, stop_method);
         return std::make_unique<ProcessManagerWrapper>(std::move(manager));
     }
 
@@ -472,7 +490,8 @@ nb::object
 buildPyThreadObject(
         const pystack::PyThreadData& thread,
         const PyTypes& types,
-        std::pair<int, int> python_version)
+        std::pair<int, int> python_version,
+        const std::vector<int>* tids = nullptr)
 {
     nb::object first_frame = buildFrameChain(thread, types);
     nb::list native_frames = buildNativeFramesList(thread.native_frames, types);
@@ -485,12 +504,17 @@ buildPyThreadObject(
             thread.gc_status,
             nb::make_tuple(python_version.first, python_version.second),
             "name"_a = thread.name ? nb::cast(*thread.name) : nb::none(),
-            "interpreter_id"_a = thread.interpreter_id);
+            "interpreter_id"_a = thread.interpreter_id,
+            "tids"_a = tids ? nb::cast(*tids) : nb::none(),
+            "complete"_a = thread.complete);
 }
 
 // Build a native-only thread object (no Python frames)
 nb::object
-buildNativeOnlyThreadObject(const pystack::PyThreadData& thread, const PyTypes& types)
+buildNativeOnlyThreadObject(
+        const pystack::PyThreadData& thread,
+        const PyTypes& types,
+        const std::vector<int>* tids = nullptr)
 {
     nb::list native_frames = buildNativeFramesList(thread.native_frames, types);
 
@@ -501,7 +525,9 @@ buildNativeOnlyThreadObject(const pystack::PyThreadData& thread, const PyTypes&
             0,
             0,
             nb::none(),
-            "name"_a = thread.name ? nb::cast(*thread.name) : nb::none());
+            "name"_a = thread.name ? nb::cast(*thread.name) : nb::none(),
+            "tids"_a = tids ? nb::cast(*tids) : nb::none(),
+            "complete"_a = thread.complete);
 }
 
 // Log interpreter status
@@ -517,14 +543,35 @@ logInterpreterStatus(int status)
     }
 }
 
+// Fill a Python dict with the phases and stop window of a timing report
+void
+fillTimingsDict(const pystack::TimingReport& report, nb::dict timings)
+{
+    auto seconds = [](pystack::TimingReport::Clock::duration duration) {
+        return std::chrono::duration<double>(duration).count();
+    };
+    auto optional_seconds = [&](std::optional<pystack::TimingReport::Clock::duration> duration) {
+        return duration ? nb::cast(seconds(*duration)) : nb::none();
+    };
+
+    nb::dict phases;
+    for (const auto& [phase, duration] : report.phases()) {
+        phases[phase.c_str()] = seconds(duration);
+    }
+    timings["phases"] = phases;
+    timings["total"] = seconds(report.total());
+    timings["target_stopped"] = optional_seconds(report.targetStopped());
+    timings["stop_skew"] = optional_seconds(report.stopSkew());
+}
+
 // Log available memory maps
 void
-logMemoryMaps(const std::vector<pystack::VirtualMap>& maps, const char* source)
+logMemoryMaps(const pystack::AbstractProcessManager& manager, const char* source)
 {
     pystack::LOG(pystack::DEBUG) << "Available memory maps for " << source << ":";
-    for (const auto& map : maps) {
-        pystack::LOG(pystack::DEBUG)
-                << "  " << std::hex << map.Start() << "-" << map.End() << " " << map.Path();
+    for (const auto& map : manager.MemoryMaps()) {
+        pystack::LOG(pystack::DEBUG) << "  " << std::hex << map.Start() << "-" << map.End() << " "
+                                     << map.Path(manager.Strings());
     }
 }
 
@@ -671,106 +718,344 @@ normalizeThreads(
     return ret;
 }
 
+// OS threads whose stacks are identical. The entries are the ones of the
+// first thread of the group: one per interpreter the thread runs code of.
+struct ThreadGroup
+{
+    std::vector<pystack::PyThreadData> entries;
+    std::vector<int> tids;
+};
+
+void
+hashCombine(size_t& seed, size_t value)
+{
+    seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+size_t
+hashThreadStack(const std::vector<pystack::PyThreadData>& entries)
+{
+    size_t seed = entries.size();
+    for (const auto& entry : entries) {
+        hashCombine(seed, std::hash<bool>{}(entry.complete));
+        hashCombine(seed, std::hash<int>{}(entry.gil_status));
+        hashCombine(seed, std::hash<int>{}(entry.gc_status));
+        for (const auto& frame : entry.frames) {
+            hashCombine(seed, std::hash<std::string>{}(frame.code.filename));
+            hashCombine(seed, std::hash<std::string>{}(frame.code.scope));
+            hashCombine(seed, std::hash<int>{}(frame.code.location.lineno));
+        }
+        for (const auto& frame : entry.native_frames) {
+            hashCombine(seed, std::hash<unsigned long>{}(frame.address));
+        }
+    }
+    return seed;
+}
+
+bool
+haveIdenticalStacks(
+        const std::vector<pystack::PyThreadData>& lhs,
+        const std::vector<pystack::PyThreadData>& rhs)
+{
+    auto same_location = [](const pystack::LocationInfo& a, const pystack::LocationInfo& b) {
+        return a.lineno == b.lineno && a.end_lineno == b.end_lineno && a.column == b.column
+               && a.end_column == b.end_column;
+    };
+    auto same_frame = [&](const pystack::PyFrameData& a, const pystack::PyFrameData& b) {
+        return a.code.filename == b.code.filename && a.code.scope == b.code.scope
+               && same_location(a.code.location, b.code.location) && a.is_entry == b.is_entry
+               && a.is_shim == b.is_shim && a.arguments == b.arguments && a.locals == b.locals;
+    };
+    auto same_native_frame = [](const pystack::NativeFrame& a, const pystack::NativeFrame& b) {
+        return a.address == b.address && a.symbol == b.symbol;
+    };
+    auto same_entry = [&](const pystack::PyThreadData& a, const pystack::PyThreadData& b) {
+        return a.complete == b.complete && a.gil_status == b.gil_status && a.gc_status == b.gc_status
+               && a.interpreter_id == b.interpreter_id
+               && std::equal(
+                       a.frames.begin(),
+                       a.frames.end(),
+                       b.frames.begin(),
+                       b.frames.end(),
+                       same_frame)
+               && std::equal(
+                       a.native_frames.begin(),
+                       a.native_frames.end(),
+                       b.native_frames.begin(),
+                       b.native_frames.end(),
+                       same_native_frame);
+    };
+    return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), same_entry);
+}
+
+// Group the threads that are stopped at exactly the same Python and native
+// frames, keeping the order in which each group was first seen. The entries
+// of a TID must be consecutive, as normalizeThreads leaves them.
+std::vector<ThreadGroup>
+groupIdenticalThreads(std::vector<pystack::PyThreadData> threads)
+{
+    std::vector<ThreadGroup> groups;
+    std::unordered_multimap<size_t, size_t> groups_by_hash;
+
+    auto begin = threads.begin();
+    while (begin != threads.end()) {
+        const int tid = begin->tid;
+        auto end = std::find_if(begin, threads.end(), [&](const pystack::PyThreadData& thread) {
+            return thread.tid != tid;
+        });
+        std::vector<pystack::PyThreadData> entries(
+                std::make_move_iterator(begin),
+                std::make_move_iterator(end));
+        begin = end;
+
+        size_t hash = hashThreadStack(entries);
+        auto [first, last] = groups_by_hash.equal_range(hash);
+        auto match = std::find_if(first, last, [&](const auto& candidate) {
+            return haveIdenticalStacks(groups[candidate.second].entries, entries);
+        });
+        if (match == last) {
+            groups_by_hash.emplace(hash, groups.size());
+            groups.push_back({std::move(entries), {tid}});
+            continue;
+        }
+
+        ThreadGroup& group = groups[match->second];
+        group.tids.push_back(tid);
+        // Only report a name when it's shared by every thread of the group.
+        if (group.entries[0].name != entries[0].name) {
+            for (auto& entry : group.entries) {
+                entry.name.reset();
+            }
+        }
+    }
+    return groups;
+}
+
+// Build the filter selecting the threads to report from the keyword arguments
+pystack::ThreadFilter
+makeThreadFilter(
+        std::optional<std::vector<int>> tids,
+        std::optional<std::string> thread_name,
+        bool gil_only,
+        bool gc_only)
+{
+    pystack::ThreadFilter filter;
+    if (tids) {
+        filter.tids.emplace(tids->begin(), tids->end());
+    }
+    filter.name_pattern = std::move(thread_name);
+    filter.gil_holder_only = gil_only;
+    filter.gc_collecting_only = gc_only;
+    return filter;
+}
+
+// Threads gathered from a process, before any Python object is built
+struct CollectedThreads
+{
+    std::vector<pystack::PyThreadData> python_threads;
+    std::vector<pystack::PyThreadData> native_only_threads;
+};
+
+// Gather the threads of every interpreter starting at head, and the threads
+// that don't run Python code if all native threads were requested. Only the
+// threads selected by the filter are decoded and unwound.
+CollectedThreads
+collectThreads(
+        const std::shared_ptr<pystack::AbstractProcessManager>& manager,
+        pystack::remote_addr_t head,
+        pid_t pid,
+        NativeReportingMode native_mode,
+        bool locals,
+        const pystack::ThreadFilter& filter = {})
+{
+    CollectedThreads result;
+    std::vector<int> all_tids = pystack::getThreadIds(manager);
+    bool add_native = native_mode != NativeReportingMode::OFF;
+    manager->setNativeSymbolsOnly(native_mode == NativeReportingMode::SYMBOLS);
+
+    while (head) {
+        auto next = pystack::InterpreterUtils::getNextInterpreter(manager, head);
+        if (next && !manager->versionIsAtLeast(3, 11)) {
+            // We are currently unable to reliably determine the
+            // order of the stacks for different interpreters on
+            // the same OS thread for versions < 3.11, and so we
+            // ignore interpreters but the main one (which should
+            // be the last one in the linked list).
+            pystack::LOG(pystack::WARNING)
+                    << "Ignoring subinterpreter at address " << std::hex << std::showbase << head
+                    << ". pystack can only handle subinterpreters for Python 3.11+";
+            head = next;
+            continue;
+        }
+
+        std::vector<pystack::PyThreadData> new_threads =
+                pystack::buildThreadsFromInterpreter(manager, head, pid, add_native, locals, filter);
+
+        for (const auto& thread : new_threads) {
+            all_tids.erase(std::remove(all_tids.begin(), all_tids.end(), thread.tid), all_tids.end());
+        }
+        result.python_threads.insert(
+                result.python_threads.end(),
+                std::make_move_iterator(new_threads.begin()),
+                std::make_move_iterator(new_threads.end()));
+        head = next;
+    }
+
+    if (native_mode == NativeReportingMode::ALL) {
+        // The Python threads that the filter rejected are still listed here,
+        // but checking them as threads that don't hold the GIL rejects them
+        // again.
+        if (!filter.empty()) {
+            all_tids.erase(
+                    std::remove_if(
+                            all_tids.begin(),
+                            all_tids.end(),
+                            [&](int tid) {
+                                return !filter.matches(
+                                        pid,
+                                        tid,
+                                        pystack::PyThread::GilStatus::NOT_HELD,
+                                        pystack::PyThread::GCStatus::NOT_COLLECTING);
+                            }),
+                    all_tids.end());
+        }
+        result.native_only_threads = pystack::buildNativeThreads(manager, pid, all_tids);
+    }
+    return result;
+}
+
+// Build the Python thread objects for the collected threads
+nb::list
+buildThreadObjects(
+        CollectedThreads threads,
+        NativeReportingMode native_mode,
+        std::pair<int, int> python_version,
+        const PyTypes& types,
+        bool group = false)
+{
+    pystack::ScopedTimer timer("object_construction");
+    nb::list result;
+    auto python_threads =
+            normalizeThreads(std::move(threads.python_threads), native_mode, python_version);
+    if (!group) {
+        for (const auto& thread : python_threads) {
+            result.append(buildPyThreadObject(thread, types, python_version));
+        }
+        for (const auto& thread : threads.native_only_threads) {
+            result.append(buildNativeOnlyThreadObject(thread, types));
+        }
+        return result;
+    }
+
+    for (const auto& thread_group : groupIdenticalThreads(std::move(python_threads))) {
+        for (const auto& thread : thread_group.entries) {
+            result.append(buildPyThreadObject(thread, types, python_version, &thread_group.tids));
+        }
+    }
+    for (const auto& thread_group : groupIdenticalThreads(std::move(threads.native_only_threads))) {
+        for (const auto& thread : thread_group.entries) {
+            result.append(buildNativeOnlyThreadObject(thread, types, &thread_group.tids));
+        }
+    }
+    return result;
+}
+
+// Threads of a live process and the version of its interpreter
+struct ProcessSnapshot
+{
+    CollectedThreads threads;
+    std::pair<int, int> python_version;
+    bool not_enough_information{false};
+};
+
+// Stop the process, gather its threads and let it run again. Called without
+// the GIL, and possibly for several processes at once.
+ProcessSnapshot
+snapshotProcess(
+        pid_t pid,
+        bool stop_process,
+        NativeReportingMode native_mode,
+        bool locals,
+        StackMethod method,
+        bool frame_pointers,
+        pystack::StopMethod stop_method,
+        const pystack::ThreadFilter& filter)
+{
+    ProcessSnapshot snapshot;
+    auto manager =
+            ProcessManagerWrapper::create_from_pid(pid, stop_process, frame_pointers, stop_method);
+    logMemoryMaps(*manager->get_manager(), "process");
+
+    if (native_mode != NativeReportingMode::ALL) {
+        logInterpreterStatus(manager->interpreter_status());
+    }
+
+    pystack::remote_addr_t head =
+            pystack::getInterpreterStateAddr(manager->get_manager().get(), static_cast<int>(method));
+
+    if (head == 0 && native_mode != NativeReportingMode::ALL) {
+        snapshot.not_enough_information = true;
+        return snapshot;
+    }
+    snapshot.python_version = manager->python_version();
+    snapshot.threads =
+            collectThreads(manager->get_manager(), head, pid, native_mode, locals, filter);
+    manager->reset();
+    return snapshot;
+}
+
 nb::object
 get_process_threads(
         pid_t pid,
         bool stop_process,
         NativeReportingMode native_mode,
         bool locals,
-        StackMethod method)
+        StackMethod method,
+        bool frame_pointers,
+        pystack::StopMethod stop_method,
+        pystack::TimingReport* timings,
+        bool group,
+        pystack::Deadline* deadline,
+        const pystack::ThreadFilter& filter)
 {
+    pystack::TimingReport::Activation activate_timings(timings);
+    pystack::Deadline::Activation activate_deadline(deadline);
     auto types = PyTypes::load();
 
     try {
         // Collect all C++ data with GIL released so other threads can run
         // (e.g. concurrent ptrace attachment attempts will see EPERM).
-        std::vector<pystack::PyThreadData> python_threads;
-        std::vector<pystack::PyThreadData> native_only_threads;
-        std::pair<int, int> python_version;
-        bool not_enough_info = false;
-
+        ProcessSnapshot snapshot;
         {
+            pystack::refreshLoggingLevel();
             nb::gil_scoped_release release;
-
-            auto manager = ProcessManagerWrapper::create_from_pid(pid, stop_process);
-            logMemoryMaps(manager->virtual_maps(), "process");
-
-            if (native_mode != NativeReportingMode::ALL) {
-                logInterpreterStatus(manager->interpreter_status());
-            }
-
-            pystack::remote_addr_t head = pystack::getInterpreterStateAddr(
-                    manager->get_manager().get(),
-                    static_cast<int>(method));
-
-            if (head == 0 && native_mode != NativeReportingMode::ALL) {
-                not_enough_info = true;
-            } else {
-                python_version = manager->python_version();
-                std::vector<int> all_tids = pystack::getThreadIds(manager->get_manager());
-                bool add_native = native_mode != NativeReportingMode::OFF;
-
-                while (head) {
-                    auto next =
-                            pystack::InterpreterUtils::getNextInterpreter(manager->get_manager(), head);
-                    if (next && !manager->get_manager()->versionIsAtLeast(3, 11)) {
-                        // We are currently unable to reliably determine the
-                        // order of the stacks for different interpreters on
-                        // the same OS thread for versions < 3.11, and so we
-                        // ignore interpreters but the main one (which should
-                        // be the last one in the linked list).
-                        pystack::LOG(pystack::WARNING)
-                                << "Ignoring subinterpreter at address " << std::hex << std::showbase
-                                << head << ". pystack can only handle subinterpreters for Python 3.11+";
-                        head = next;
-                        continue;
-                    }
-
-                    std::vector<pystack::PyThreadData> new_threads =
-                            pystack::buildThreadsFromInterpreter(
-                                    manager->get_manager(),
-                                    head,
-                                    pid,
-                                    add_native,
-                                    locals);
-
-                    for (const auto& thread : new_threads) {
-                        all_tids.erase(
-                                std::remove(all_tids.begin(), all_tids.end(), thread.tid),
-                                all_tids.end());
-                    }
-                    python_threads.insert(
-                            python_threads.end(),
-                            std::make_move_iterator(new_threads.begin()),
-                            std::make_move_iterator(new_threads.end()));
-                    head = next;
-                }
-
-                if (native_mode == NativeReportingMode::ALL) {
-                    for (int tid : all_tids) {
-                        native_only_threads.push_back(
-                                pystack::buildNativeThread(manager->get_manager(), pid, tid));
-                    }
-                }
-
-                manager->reset();
-            }
+            snapshot = snapshotProcess(
+                    pid,
+                    stop_process,
+                    native_mode,
+                    locals,
+                    method,
+                    frame_pointers,
+                    stop_method,
+                    filter);
+        }
+        if (deadline && deadline->wasHit()) {
+            pystack::LOG(pystack::WARNING)
+                    << "The timeout expired before the analysis finished, so the report is incomplete";
         }
 
         // GIL re-acquired: build Python objects
-        if (not_enough_info) {
+        if (snapshot.not_enough_information) {
             raise_not_enough_information(
                     "Could not gather enough information to extract the Python frame information");
         }
 
-        nb::list result;
-        for (const auto& thread : normalizeThreads(python_threads, native_mode, python_version)) {
-            result.append(buildPyThreadObject(thread, types, python_version));
-        }
-        for (const auto& thread : native_only_threads) {
-            result.append(buildNativeOnlyThreadObject(thread, types));
-        }
-        return result;
+        return buildThreadObjects(
+                std::move(snapshot.threads),
+                native_mode,
+                snapshot.python_version,
+                types,
+                group);
     } catch (const NotEnoughInformationError&) {
         throw;
     } catch (const EngineError&) {
@@ -787,14 +1072,18 @@ get_process_threads_for_core(
         std::optional<std::filesystem::path> library_search_path,
         NativeReportingMode native_mode,
         bool locals,
-        StackMethod method)
+        StackMethod method,
+        pystack::TimingReport* timings,
+        bool group,
+        const pystack::ThreadFilter& filter)
 {
+    pystack::TimingReport::Activation activate_timings(timings);
     auto types = PyTypes::load();
 
     try {
         auto manager =
                 ProcessManagerWrapper::create_from_core(core_file, executable, library_search_path);
-        logMemoryMaps(manager->virtual_maps(), "core");
+        logMemoryMaps(*manager->get_manager(), "core");
 
         if (native_mode != NativeReportingMode::ALL) {
             logInterpreterStatus(manager->interpreter_status());
@@ -808,68 +1097,307 @@ get_process_threads_for_core(
                     "Could not gather enough information to extract the Python frame information");
         }
 
-        nb::list result;
-        std::vector<pystack::PyThreadData> python_threads;
-        std::vector<int> all_tids = pystack::getThreadIds(manager->get_manager());
-        bool add_native = native_mode != NativeReportingMode::OFF;
-
-        while (head) {
-            auto next = pystack::InterpreterUtils::getNextInterpreter(manager->get_manager(), head);
-            if (next && !manager->get_manager()->versionIsAtLeast(3, 11)) {
-                // We are currently unable to reliably determine the
-                // order of the stacks for different interpreters on
-                // the same OS thread for versions < 3.11, and so we
-                // ignore interpreters but the main one (which should
-                // be the last one in the linked list).
-                pystack::LOG(pystack::WARNING)
-                        << "Ignoring subinterpreter at address " << std::hex << std::showbase << head
-                        << ". pystack can only handle subinterpreters for Python 3.11+";
-                head = next;
-                continue;
+        CollectedThreads threads = collectThreads(
+                manager->get_manager(),
+                head,
+                manager->pid(),
+                native_mode,
+                locals,
+                filter);
+        return buildThreadObjects(
+                std::move(threads),
+                native_mode,
+                manager->python_version(),
+                types,
+                group);
+    } catch (const NotEnoughInformationError&) {
+        throw;
+    } catch (const EngineError&) {
+        throw;
+    } catch (const std::exception& e) {
+        throw EngineError(e.what());
+    }
+}
+
+nb::dict
+get_processes_threads(
+        const std::vector<pid_t>& pids,
+        bool stop_process,
+        NativeReportingMode native_mode,
+        bool locals,
+        StackMethod method,
+        bool frame_pointers,
+        pystack::StopMethod stop_method,
+        size_t max_workers,
+        bool group,
+        const pystack::ThreadFilter& filter)
+{
+    auto types = PyTypes::load();
+    nb::module_ errors = nb::module_::import_("pystack.errors");
+
+    std::vector<std::optional<ProcessSnapshot>> snapshots(pids.size());
+    std::vector<std::string> failures(pids.size());
+    {
+        pystack::refreshLoggingLevel();
+        nb::gil_scoped_release release;
+
+        // Each process is only stopped while its own worker inspects it.
+        // Workers share whatever is cached per build id (symbols of the
+        // interpreter, the pthread layout of libc), so processes running
+        // the same binaries only pay for loading them once.
+        std::atomic<size_t> next_pid{0};
+        auto worker = [&]() {
+            for (size_t i = next_pid++; i < pids.size(); i = next_pid++) {
+                try {
+                    snapshots[i] = snapshotProcess(
+                            pids[i],
+                            stop_process,
+                            native_mode,
+                            locals,
+                            method,
+                            frame_pointers,
+                            stop_method,
+                            filter);
+                } catch (const std::exception& e) {
+                    failures[i] = e.what();
+                }
             }
+        };
+
+        size_t n_workers = std::min(std::max<size_t>(max_workers, 1), pids.size());
+        pystack::LOG(pystack::INFO) << "Inspecting " << pids.size() << " processes with " << n_workers
+                                    << " workers";
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < n_workers; ++i) {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : workers) {
+            thread.join();
+        }
+    }
 
-            auto new_threads = pystack::buildThreadsFromInterpreter(
-                    manager->get_manager(),
-                    head,
-                    manager->pid(),
-                    add_native,
-                    locals);
-
-            for (const auto& thread : new_threads) {
-                all_tids.erase(
-                        std::remove(all_tids.begin(), all_tids.end(), thread.tid),
-                        all_tids.end());
+    nb::dict result;
+    for (size_t i = 0; i < pids.size(); ++i) {
+        nb::object pid = nb::cast(pids[i]);
+        if (!snapshots[i]) {
+            result[pid] = errors.attr("EngineError")(failures[i], "pid"_a = pid);
+        } else if (snapshots[i]->not_enough_information) {
+            result[pid] = errors.attr("NotEnoughInformation")(
+                    "Could not gather enough information to extract the Python frame information");
+        } else {
+            try {
+                result[pid] = buildThreadObjects(
+                        std::move(snapshots[i]->threads),
+                        native_mode,
+                        snapshots[i]->python_version,
+                        types,
+                        group);
+            } catch (const std::exception& e) {
+                result[pid] = errors.attr("EngineError")(e.what(), "pid"_a = pid);
             }
-            python_threads.insert(
-                    python_threads.end(),
-                    std::make_move_iterator(new_threads.begin()),
-                    std::make_move_iterator(new_threads.end()));
+        }
+    }
+    return result;
+}
 
-            head = next;
+// Samples the stacks of a live process repeatedly. Everything that doesn't
+// change while the process runs (the interpreter state, the Python version,
+// ELF and DWARF information, resolved symbols and the static data of code
+// objects) is computed once. Between snapshots the process is resumed and only
+// the memory cache, the thread list and, if they changed, the memory maps are
+// refreshed.
+class SamplingSession : public ProcessManagerWrapper
+{
+  public:
+    SamplingSession(
+            pid_t pid,
+            bool stop_process,
+            NativeReportingMode native_mode,
+            bool locals,
+            StackMethod method,
+            bool frame_pointers,
+            pystack::StopMethod stop_method)
+    : ProcessManagerWrapper(createManager(pid, stop_process, frame_pointers, stop_method))
+    , d_process(std::static_pointer_cast<pystack::ProcessManager>(get_manager()))
+    , d_stop_process(stop_process)
+    , d_native_mode(native_mode)
+    , d_locals(locals)
+    , d_method(method)
+    {
+        try {
+            pystack::refreshLoggingLevel();
+            nb::gil_scoped_release release;
+            logMemoryMaps(*d_process, "process");
+            d_head = pystack::getInterpreterStateAddr(d_process.get(), static_cast<int>(d_method));
+            d_process->resumeProcess();
+        } catch (const std::exception& e) {
+            raise_python_exception("EngineError", e.what(), pid);
         }
+        if (d_head == 0 && d_native_mode != NativeReportingMode::ALL) {
+            raise_not_enough_information(
+                    "Could not gather enough information to extract the Python frame information");
+        }
+    }
 
-        for (const auto& thread :
-             normalizeThreads(python_threads, native_mode, manager->python_version()))
-        {
-            result.append(buildPyThreadObject(thread, types, manager->python_version()));
+    nb::object snapshot(std::optional<nb::dict> timings, bool group)
+    {
+        if (!d_process) {
+            throw std::runtime_error("The sampling session is closed");
         }
+        Use use(*this);
 
-        if (native_mode == NativeReportingMode::ALL) {
-            for (int tid : all_tids) {
-                auto thread = pystack::buildNativeThread(manager->get_manager(), manager->pid(), tid);
-                result.append(buildNativeOnlyThreadObject(thread, types));
-            }
+        std::optional<pystack::TimingReport> report;
+        if (timings) {
+            report.emplace();
         }
+        pystack::TimingReport::Activation activate_timings(report ? &*report : nullptr);
+        auto types = PyTypes::load();
 
+        CollectedThreads threads;
+        try {
+            pystack::refreshLoggingLevel();
+            nb::gil_scoped_release release;
+            threads = collect();
+        } catch (const NotEnoughInformationError&) {
+            throw;
+        } catch (const std::exception& e) {
+            raise_python_exception("EngineError", e.what(), d_process->Pid());
+        }
+
+        nb::list result = buildThreadObjects(
+                std::move(threads),
+                d_native_mode,
+                d_process->Version(),
+                types,
+                group);
+        if (report) {
+            fillTimingsDict(*report, *timings);
+        }
         return result;
-    } catch (const NotEnoughInformationError&) {
-        throw;
-    } catch (const EngineError&) {
-        throw;
-    } catch (const std::exception& e) {
-        throw EngineError(e.what());
     }
-}
+
+    // Takes a snapshot and adds the Python stack of every thread to the
+    // aggregator without building any Python object. Returns the number of
+    // threads that were sampled.
+    size_t sample(pystack::StackAggregator& aggregator)
+    {
+        if (!d_process) {
+            throw std::runtime_error("The sampling session is closed");
+        }
+        Use use(*this);
+
+        CollectedThreads threads;
+        try {
+            pystack::refreshLoggingLevel();
+            nb::gil_scoped_release release;
+            threads = collect();
+        } catch (const NotEnoughInformationError&) {
+            throw;
+        } catch (const std::exception& e) {
+            raise_python_exception("EngineError", e.what(), d_process->Pid());
+        }
+
+        // The aggregator belongs to Python code, which may use it from other
+        // threads, so it is only updated while holding the GIL.
+        for (const auto& thread : threads.python_threads) {
+            aggregator.addThread(thread);
+        }
+        return threads.python_threads.size();
+    }
+
+    void close()
+    {
+        Use use(*this);
+        d_process.reset();
+        reset();
+    }
+
+  private:
+    // Classes
+
+    // The process manager, its Dwfl and its caches are used with the GIL
+    // released, so a session can only be used by one thread at a time.
+    class Use
+    {
+      public:
+        // Constructors
+        explicit Use(SamplingSession& session)
+        : d_session(session)
+        {
+            if (d_session.d_in_use.exchange(true)) {
+                throw std::runtime_error("The sampling session is being used by another thread");
+            }
+        }
+        Use(const Use&) = delete;
+        Use& operator=(const Use&) = delete;
+
+        // Destructors
+        ~Use()
+        {
+            d_session.d_in_use = false;
+        }
+
+      private:
+        // Data members
+        SamplingSession& d_session;
+    };
+
+    // Methods
+    static std::shared_ptr<pystack::ProcessManager> createManager(
+            pid_t pid,
+            bool stop_process,
+            bool frame_pointers,
+            pystack::StopMethod stop_method)
+    {
+        try {
+            pystack::refreshLoggingLevel();
+            nb::gil_scoped_release release;
+            return pystack::ProcessManager::create(pid, stop_process, frame_pointers, stop_method);
+        } catch (const std::exception& e) {
+            raise_python_exception("EngineError", e.what(), pid);
+        }
+    }
+
+    CollectedThreads collect()
+    {
+        if (d_stop_process) {
+            d_process->stopProcess();
+        } else {
+            d_process->refresh();
+        }
+
+        try {
+            // The interpreter state found when the session started stays valid
+            // for the whole life of the interpreter, so it is only searched for
+            // again if it went away.
+            if (!d_head || !d_process->isValidInterpreterState(d_head)) {
+                d_head = pystack::getInterpreterStateAddr(d_process.get(), static_cast<int>(d_method));
+            }
+            if (d_head == 0 && d_native_mode != NativeReportingMode::ALL) {
+                raise_not_enough_information(
+                        "Could not gather enough information to extract the Python frame "
+                        "information");
+            }
+            CollectedThreads threads =
+                    collectThreads(d_process, d_head, d_process->Pid(), d_native_mode, d_locals);
+            d_process->resumeProcess();
+            return threads;
+        } catch (...) {
+            d_process->resumeProcess();
+            throw;
+        }
+    }
+
+    // Data members
+    std::shared_ptr<pystack::ProcessManager> d_process;
+    bool d_stop_process;
+    NativeReportingMode d_native_mode;
+    bool d_locals;
+    StackMethod d_method;
+    pystack::remote_addr_t d_head{0};
+    std::atomic<bool> d_in_use{false};
+};
 
 void
 _check_interpreter_shutdown(nb::object manager)
@@ -915,11 +1443,17 @@ NB_MODULE(_pystack, m)
             .value("AUTO", StackMethod::AUTO)
             .value("ALL", StackMethod::ALL);
 
+    nb::enum_<pystack::StopMethod>(m, "StopMethod")
+            .value("PTRACE", pystack::StopMethod::PTRACE)
+            .value("CGROUP", pystack::StopMethod::CGROUP)
+            .value("SIGNAL", pystack::StopMethod::SIGNAL);
+
     nb::enum_<NativeReportingMode>(m, "NativeReportingMode")
             .value("OFF", NativeReportingMode::OFF)
             .value("PYTHON", NativeReportingMode::PYTHON)
             .value("ALL", NativeReportingMode::ALL)
-            .value("LAST", NativeReportingMode::LAST);
+            .value("LAST", NativeReportingMode::LAST)
+            .value("SYMBOLS", NativeReportingMode::SYMBOLS);
 
     nb::class_<CoreFileAnalyzerWrapper>(m, "CoreFileAnalyzer")
             .def(nb::init<
@@ -943,7 +1477,9 @@ NB_MODULE(_pystack, m)
                     "create_from_pid",
                     &ProcessManagerWrapper::create_from_pid,
                     "pid"_a,
-                    "stop_process"_a = true)
+                    "stop_process"_a = true,
+                    "frame_pointers"_a = false,
+                    "stop_method"_a = pystack::StopMethod::PTRACE)
             .def_static(
                     "create_from_core",
                     &ProcessManagerWrapper::create_from_core,
@@ -960,6 +1496,62 @@ NB_MODULE(_pystack, m)
                     nb::rv_policy::reference)
             .def("__exit__", [](ProcessManagerWrapper& self, nb::args) { self.reset(); });
 
+    nb::class_<pystack::StackAggregator>(m, "StackAggregator")
+            .def(nb::init<size_t>(), "max_nodes"_a = pystack::StackAggregator::DEFAULT_MAX_NODES)
+            .def("collapsed", &pystack::StackAggregator::collapsed)
+            .def("clear", &pystack::StackAggregator::clear)
+            .def_prop_ro("samples", &pystack::StackAggregator::samples)
+            .def_prop_ro("truncated_samples", &pystack::StackAggregator::truncatedSamples)
+            .def_prop_ro("nodes", &pystack::StackAggregator::nodes);
+
+    nb::class_<SamplingSession, ProcessManagerWrapper>(m, "SamplingSession")
+            .def("__init__",
+                 [](SamplingSession* self,
+                    pid_t pid,
+                    bool stop_process,
+                    NativeReportingMode native_mode,
+                    bool locals,
+                    nb::object method_obj,
+                    bool frame_pointers,
+                    pystack::StopMethod stop_method) {
+                     StackMethod method;
+                     try {
+                         method = nb::cast<StackMethod>(method_obj);
+                     } catch (const nb::cast_error&) {
+                         throw std::invalid_argument("Invalid method for stack analysis");
+                     }
+                     new (self) SamplingSession(
+                             pid,
+                             stop_process,
+                             native_mode,
+                             locals,
+                             method,
+                             frame_pointers,
+                             stop_method);
+                 },
+                 "pid"_a,
+                 "stop_process"_a = true,
+                 "native_mode"_a = NativeReportingMode::OFF,
+                 "locals"_a = false,
+                 nb::arg("method").none() = nb::cast(StackMethod::AUTO),
+                 "frame_pointers"_a = false,
+                 "stop_method"_a = pystack::StopMethod::PTRACE)
+            .def("snapshot",
+                 &SamplingSession::snapshot,
+                 nb::arg("timings").none() = nb::none(),
+                 "group"_a = false,
+                 "Return an iterable of Thread objects with the current stacks of the process")
+            .def("sample",
+                 &SamplingSession::sample,
+                 "aggregator"_a,
+                 "Add the current Python stacks of the process to a StackAggregator")
+            .def("close", &SamplingSession::close)
+            .def(
+                    "__enter__",
+                    [](SamplingSession& self) -> SamplingSession& { return self; },
+                    nb::rv_policy::reference)
+            .def("__exit__", [](SamplingSession& self, nb::args) { self.close(); });
+
     m.def("get_bss_info", &get_bss_info, "binary"_a, "Get BSS section information from an ELF binary");
 
     // Note: We use nb::arg().none() to allow None to be passed explicitly
@@ -969,7 +1561,16 @@ NB_MODULE(_pystack, m)
                bool stop_process,
                NativeReportingMode native_mode,
                bool locals,
-               nb::object method_obj) {
+               nb::object method_obj,
+               bool frame_pointers,
+               pystack::StopMethod stop_method,
+               std::optional<nb::dict> timings,
+               bool group,
+               std::optional<double> timeout,
+               std::optional<std::vector<int>> tids,
+               std::optional<std::string> thread_name,
+               bool gil_only,
+               bool gc_only) {
                 if (method_obj.is_none()) {
                     throw std::invalid_argument("Invalid method for stack analysis");
                 }
@@ -980,8 +1581,41 @@ NB_MODULE(_pystack, m)
                     throw std::invalid_argument("Invalid method for stack analysis");
                 }
 
+                // The deadline starts counting now, so that attaching to the
+                // process is part of the budget.
+                std::optional<pystack::Deadline> deadline;
+                if (timeout) {
+                    if (*timeout <= 0) {
+                        throw std::invalid_argument("The timeout must be positive");
+                    }
+                    deadline.emplace(std::chrono::duration_cast<pystack::Deadline::Clock::duration>(
+                            std::chrono::duration<double>(*timeout)));
+                }
+                std::optional<pystack::TimingReport> report;
+                if (timings) {
+                    report.emplace();
+                }
                 try {
-                    return get_process_threads(pid, stop_process, native_mode, locals, method);
+                    nb::object result = get_process_threads(
+                            pid,
+                            stop_process,
+                            native_mode,
+                            locals,
+                            method,
+                            frame_pointers,
+                            stop_method,
+                            report ? &*report : nullptr,
+                            group,
+                            deadline ? &*deadline : nullptr,
+                            makeThreadFilter(
+                                    std::move(tids),
+                                    std::move(thread_name),
+                                    gil_only,
+                                    gc_only));
+                    if (report) {
+                        fillTimingsDict(*report, *timings);
+                    }
+                    return result;
                 } catch (const EngineError& e) {
                     raise_python_exception("EngineError", e.what(), pid);
                 }
@@ -991,8 +1625,69 @@ NB_MODULE(_pystack, m)
             "native_mode"_a = NativeReportingMode::OFF,
             "locals"_a = false,
             nb::arg("method").none() = nb::cast(StackMethod::AUTO),
+            "frame_pointers"_a = false,
+            "stop_method"_a = pystack::StopMethod::PTRACE,
+            nb::arg("timings").none() = nb::none(),
+            "group"_a = false,
+            nb::arg("timeout").none() = nb::none(),
+            nb::arg("tids").none() = nb::none(),
+            nb::arg("thread_name").none() = nb::none(),
+            "gil_only"_a = false,
+            "gc_only"_a = false,
             "Return an iterable of Thread objects from a live process");
 
+    m.def(
+            "get_processes_threads",
+            [](const std::vector<pid_t>& pids,
+               bool stop_process,
+               NativeReportingMode native_mode,
+               bool locals,
+               nb::object method_obj,
+               bool frame_pointers,
+               pystack::StopMethod stop_method,
+               size_t max_workers,
+               bool group,
+               std::optional<std::vector<int>> tids,
+               std::optional<std::string> thread_name,
+               bool gil_only,
+               bool gc_only) {
+                if (method_obj.is_none()) {
+                    throw std::invalid_argument("Invalid method for stack analysis");
+                }
+                StackMethod method;
+                try {
+                    method = nb::cast<StackMethod>(method_obj);
+                } catch (const nb::cast_error&) {
+                    throw std::invalid_argument("Invalid method for stack analysis");
+                }
+                return get_processes_threads(
+                        pids,
+                        stop_process,
+                        native_mode,
+                        locals,
+                        method,
+                        frame_pointers,
+                        stop_method,
+                        max_workers,
+                        group,
+                        makeThreadFilter(std::move(tids), std::move(thread_name), gil_only, gc_only));
+            },
+            "pids"_a,
+            "stop_process"_a = true,
+            "native_mode"_a = NativeReportingMode::OFF,
+            "locals"_a = false,
+            nb::arg("method").none() = nb::cast(StackMethod::AUTO),
+            "frame_pointers"_a = false,
+            "stop_method"_a = pystack::StopMethod::PTRACE,
+            "max_workers"_a = 8,
+            "group"_a = false,
+            nb::arg("tids").none() = nb::none(),
+            nb::arg("thread_name").none() = nb::none(),
+            "gil_only"_a = false,
+            "gc_only"_a = false,
+            "Return a dictionary mapping each PID to an iterable of Thread objects, or to the "
+            "exception raised while inspecting it");
+
     m.def(
             "get_process_threads_for_core",
             [](const std::filesystem::path& core_file,
@@ -1000,7 +1695,12 @@ NB_MODULE(_pystack, m)
                std::optional<std::filesystem::path> library_search_path,
                NativeReportingMode native_mode,
                bool locals,
-               nb::object method_obj) {
+               nb::object method_obj,
+               std::optional<nb::dict> timings,
+               bool group,
+               std::optional<std::vector<int>> tids,
+               bool gil_only,
+               bool gc_only) {
                 if (method_obj.is_none()) {
                     throw std::invalid_argument("Invalid method for stack analysis");
                 }
@@ -1011,14 +1711,27 @@ NB_MODULE(_pystack, m)
                     throw std::invalid_argument("Invalid method for stack analysis");
                 }
 
+                std::optional<pystack::TimingReport> report;
+                if (timings) {
+                    report.emplace();
+                }
                 try {
-                    return get_process_threads_for_core(
+                    nb::object result = get_process_threads_for_core(
                             core_file,
                             executable,
                             library_search_path,
                             native_mode,
                             locals,
-                            method);
+                            method,
+                            report ? &*report : nullptr,
+                            group,
+                            // Thread names are read from /proc, which a core
+                            // file has no equivalent of.
+                            makeThreadFilter(std::move(tids), std::nullopt, gil_only, gc_only));
+                    if (report) {
+                        fillTimingsDict(*report, *timings);
+                    }
+                    return result;
                 } catch (const EngineError& e) {
                     raise_python_exception("EngineError", e.what(), std::nullopt, core_file);
                 }
@@ -1029,6 +1742,11 @@ NB_MODULE(_pystack, m)
             "native_mode"_a = NativeReportingMode::PYTHON,
             "locals"_a = false,
             nb::arg("method").none() = nb::cast(StackMethod::AUTO),
+            nb::arg("timings").none() = nb::none(),
+            "group"_a = false,
+            nb::arg("tids").none() = nb::none(),
+            "gil_only"_a = false,
+            "gc_only"_a = false,
             "Return an iterable of Thread objects from a core file");
 
     m.def("_check_interpreter_shutdown",
@@ -1095,4 +1813,19 @@ NB_MODULE(_pystack, m)
             "thread_descs"_a,
             "native_mode"_a,
             "python_version"_a);
+
+    m.def(
+            "_parse_maps_for_testing",
+            [](const std::string& contents) {
+                pystack::StringTable strings;
+                return buildVirtualMapObjects(pystack::parseMaps(contents, strings), strings);
+            },
+            "contents"_a);
+
+    m.def(
+            "_get_version_from_elf_section_for_testing",
+            [](nb::bytes data) {
+                return pystack::getVersionFromElfSectionData(data.c_str(), data.size());
+            },
+            "data"_a);
 }
@@ -0,0 +1,68 @@
+#include "deadline.h"
+
+namespace pystack {
+
+namespace {
+
+thread_local Deadline* t_current_deadline = nullptr;
+
+}  // namespace
+
+Deadline::Activation::Activation(Deadline* deadline)
+: d_previous(t_current_deadline)
+{
+    t_current_deadline = deadline;
+}
+
+Deadline::Activation::~Activation()
+{
+    t_current_deadline = d_previous;
+}
+
+Deadline::Deadline(Clock::duration timeout)
+: d_end(Clock::now() + timeout)
+{
+}
+
+Deadline*
+Deadline::current()
+{
+    return t_current_deadline;
+}
+
+bool
+Deadline::expired()
+{
+    Deadline* deadline = t_current_deadline;
+    if (!deadline || Clock::now() < deadline->d_end) {
+        return false;
+    }
+    deadline->d_hit = true;
+    return true;
+}
+
+void
+Deadline::recordTruncatedThread(pid_t tid)
+{
+    Deadline* deadline = t_current_deadline;
+    if (!deadline) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(deadline->d_truncated_threads_mutex);
+    deadline->d_truncated_threads.insert(tid);
+}
+
+bool
+Deadline::wasHit() const
+{
+    return d_hit;
+}
+
+bool
+Deadline::threadTruncated(pid_t tid) const
+{
+    std::lock_guard<std::mutex> lock(d_truncated_threads_mutex);
+    return d_truncated_threads.count(tid) != 0;
+}
+
+}  // namespace pystack
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sys/types.h>
+#include <unordered_set>
+
+namespace pystack {
+
+// A point in time by which gathering the stacks of a process must be done, so
+// that a pathological thread can't keep the target stopped indefinitely.
+//
+// Like a TimingReport, a deadline only applies while it is activated on a
+// thread. The expensive parts of the analysis check it cooperatively and, once
+// it has passed, skip the rest of their work and report what they have.
+class Deadline
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // Makes a deadline the current one for the calling thread while alive.
+    class Activation
+    {
+      public:
+        // Constructors
+        explicit Activation(Deadline* deadline);
+        Activation(const Activation&) = delete;
+        Activation& operator=(const Activation&) = delete;
+
+        // Destructors
+        ~Activation();
+
+      private:
+        // Data members
+        Deadline* d_previous;
+    };
+
+    // Constructors
+    explicit Deadline(Clock::duration timeout);
+
+    // Static methods
+    static Deadline* current();
+    // Whether the deadline of the calling thread, if it has one, has passed.
+    // Callers are expected to cut their work short when it returns true.
+    static bool expired();
+    // Records that the native stack of a thread may be missing frames
+    // because the deadline of the calling thread passed while unwinding it.
+    static void recordTruncatedThread(pid_t tid);
+
+    // Methods
+    // Whether any work was cut short because the deadline had passed.
+    bool wasHit() const;
+    bool threadTruncated(pid_t tid) const;
+
+  private:
+    // Data members
+    Clock::time_point d_end;
+    // Set from every thread the deadline is activated on.
+    std::atomic<bool> d_hit{false};
+    mutable std::mutex d_truncated_threads_mutex;
+    std::unordered_set<pid_t> d_truncated_threads;
+};
+
+}  // namespace pystack
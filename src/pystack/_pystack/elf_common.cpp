@@ -284,10 +284,6 @@ ProcessAnalyzer::ProcessAnalyzer(pid_t pid)
     if (dwfl_linux_proc_report(d_dwfl.get(), pid) || dwfl_report_end(d_dwfl.get(), nullptr, nullptr)) {
         throw ElfAnalyzerError("Failed to analyze DWARF information for the remote process");
     }
-
-    if (dwfl_linux_proc_attach(d_dwfl.get(), pid, true) != 0) {
-        throw ElfAnalyzerError("Could not attach the DWARF process analyzer");
-    }
 }
 
 const dwfl_unique_ptr&
@@ -481,6 +477,79 @@ getSectionInfo(const std::string& filename, const std::string& section_name, Sec
     return false;
 }
 
+bool
+getSymbolData(const std::string& filename, const std::string& symbol, void* dst, size_t size)
+{
+    if (elf_version(EV_CURRENT) == EV_NONE) {
+        LOG(ERROR) << "libelf library ELF version too old";
+        return false;
+    }
+
+    file_unique_ptr file(fopen(filename.c_str(), "r"), fclose);
+    if (!file || fileno(file.get()) == -1) {
+        LOG(ERROR) << "Cannot open ELF file " << filename << " (" << std::strerror(errno) << ")";
+        return false;
+    }
+    const int fd = fileno(file.get());
+
+    elf_unique_ptr elf = elf_unique_ptr(elf_begin(fd, ELF_C_READ_MMAP, nullptr), elf_end);
+    if (!elf) {
+        LOG(ERROR) << "Cannot read ELF file " << filename;
+        return false;
+    }
+
+    Elf* the_elf = elf.get();
+
+    LOG(DEBUG) << "Searching the symbol tables of " << filename << " for " << symbol;
+
+    Elf_Scn* scn = nullptr;
+    while ((scn = elf_nextscn(the_elf, scn)) != nullptr) {
+        GElf_Shdr shdr_mem;
+        GElf_Shdr* shdr = gelf_getshdr(scn, &shdr_mem);
+        if (shdr == nullptr || (shdr->sh_type != SHT_SYMTAB && shdr->sh_type != SHT_DYNSYM)
+            || shdr->sh_entsize == 0)
+        {
+            continue;
+        }
+
+        Elf_Data* data = elf_getdata(scn, nullptr);
+        if (data == nullptr) {
+            continue;
+        }
+
+        const size_t n_symbols = shdr->sh_size / shdr->sh_entsize;
+        for (size_t i = 0; i < n_symbols; i++) {
+            GElf_Sym sym_mem;
+            GElf_Sym* sym = gelf_getsym(data, i, &sym_mem);
+            if (sym == nullptr || sym->st_shndx == SHN_UNDEF || sym->st_shndx >= SHN_LORESERVE) {
+                continue;
+            }
+            const char* name = elf_strptr(the_elf, shdr->sh_link, sym->st_name);
+            if (name == nullptr || symbol != name) {
+                continue;
+            }
+            if (sym->st_size != 0 && sym->st_size < size) {
+                LOG(DEBUG) << "Symbol " << symbol << " is smaller than the requested " << size
+                           << " bytes";
+                return false;
+            }
+
+            GElf_Shdr sym_shdr_mem;
+            GElf_Shdr* sym_shdr = gelf_getshdr(elf_getscn(the_elf, sym->st_shndx), &sym_shdr_mem);
+            if (sym_shdr == nullptr || sym_shdr->sh_type == SHT_NOBITS) {
+                LOG(DEBUG) << "Symbol " << symbol << " has no data in " << filename;
+                return false;
+            }
+
+            off_t offset = sym_shdr->sh_offset + (sym->st_value - sym_shdr->sh_addr);
+            LOG(DEBUG) << "Found symbol " << symbol << " at file offset " << std::hex << std::showbase
+                       << offset;
+            return pread(fd, dst, size, offset) == static_cast<ssize_t>(size);
+        }
+    }
+    return false;
+}
+
 const dwfl_unique_ptr&
 CoreFileAnalyzer::getDwfl() const
 {
@@ -127,6 +127,9 @@ struct SectionInfo
 bool
 getSectionInfo(const std::string& filename, const std::string& section_name, SectionInfo* result);
 
+bool
+getSymbolData(const std::string& filename, const std::string& symbol, void* dst, size_t size);
+
 std::string
 buildIdPtrToString(const uint8_t* id, ssize_t size);
 
@@ -1,3 +1,4 @@
+#include <atomic>
 #include <stdexcept>
 #include <string>
 
@@ -10,6 +11,9 @@ namespace pystack {
 
 static PyObject* g_logger = nullptr;
 static int LOGGER_INITIALIZED = false;
+// Lowest level the logger was enabled for the last time it was checked.
+// Everything is let through until then, and Python makes the final decision.
+static std::atomic<int> g_cached_level{NOTSET};
 
 void
 initializePythonLoggerInterface()
@@ -72,6 +76,36 @@ isLoggingEnabled(logLevel level)
     return enabled;
 }
 
+void
+refreshLoggingLevel()
+{
+    if (!LOGGER_INITIALIZED || !g_logger) {
+        return;
+    }
+
+    int cached_level = CRITICAL + 1;
+    for (logLevel level : {DEBUG, INFO, WARNING, ERROR, CRITICAL}) {
+        PyObject* result = PyObject_CallMethod(g_logger, "isEnabledFor", "i", static_cast<int>(level));
+        bool enabled = result && PyObject_IsTrue(result);
+        Py_XDECREF(result);
+        if (PyErr_Occurred()) {
+            PyErr_Clear();
+            return;
+        }
+        if (enabled) {
+            cached_level = level;
+            break;
+        }
+    }
+    g_cached_level.store(cached_level, std::memory_order_relaxed);
+}
+
+bool
+isLevelEnabled(logLevel level)
+{
+    return level >= g_cached_level.load(std::memory_order_relaxed) || PyGILState_Check();
+}
+
 void
 logWithPython(const std::string& message, int level)
 {
@@ -17,6 +17,17 @@ enum logLevel {
 bool
 isLoggingEnabled(logLevel level);
 
+// Caches the lowest level the Python logger is enabled for. Must be called
+// with the GIL held, before releasing it for a long analysis: while the GIL
+// is not held, messages below the cached level are dropped without taking it.
+void
+refreshLoggingLevel();
+
+// Whether a message of the given level may be logged. Never takes the GIL:
+// without it, the level cached by refreshLoggingLevel() decides.
+bool
+isLevelEnabled(logLevel level);
+
 void
 logWithPython(const std::string& message, int level);
 
@@ -25,24 +36,28 @@ class LOG
   public:
     // Constructors
     LOG()
-    : msgLevel(INFO) {};
+    : msgLevel(INFO)
+    , enabled(isLevelEnabled(INFO)) {};
 
     explicit LOG(logLevel type)
-    {
-        msgLevel = type;
-    };
+    : msgLevel(type)
+    , enabled(isLevelEnabled(type)) {};
 
     // Destructors
     ~LOG()
     {
-        logWithPython(buffer.str(), msgLevel);
+        if (enabled) {
+            logWithPython(buffer.str(), msgLevel);
+        }
     };
 
     // Operators
     template<typename T>
     LOG& operator<<(const T& msg)
     {
-        buffer << msg;
+        if (enabled) {
+            buffer << msg;
+        }
         return *this;
     };
 
@@ -50,6 +65,7 @@ class LOG
     // Data members
     std::ostringstream buffer;
     logLevel msgLevel = DEBUG;
+    bool enabled;
 };
 
 void
@@ -1,14 +1,20 @@
 #include "maps_parser.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <charconv>
 #include <climits>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
 #include <filesystem>
 #include <fstream>
-#include <regex>
 #include <set>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <sys/ioctl.h>
 #include <unistd.h>
 
 #include "logging.h"
@@ -17,63 +23,322 @@ namespace pystack {
 
 namespace fs = std::filesystem;
 
-// Regex pattern for parsing /proc/pid/maps lines
+namespace {
+
+// Reads a file from procfs, which reports a size of 0 for most of its files,
+// into a single buffer that grows geometrically.
+bool
+readProcFile(const std::string& path, std::string* contents)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    size_t used = 0;
+    contents->resize(64 * 1024);
+    while (true) {
+        if (used == contents->size()) {
+            contents->resize(contents->size() * 2);
+        }
+        ssize_t bytes_read = read(fd, contents->data() + used, contents->size() - used);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return false;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        used += bytes_read;
+    }
+    close(fd);
+    contents->resize(used);
+    return true;
+}
+
+// Caches the string table indices of the paths and devices of a maps file:
+// every library appears in several consecutive maps, so most lookups hit this
+// cache and skip the (locked) table.
+class StringInterner
+{
+  public:
+    explicit StringInterner(StringTable& table)
+    : d_table(table)
+    {
+    }
+
+    StringTable::Index intern(std::string_view str)
+    {
+        auto it = d_indices.find(str);
+        if (it == d_indices.end()) {
+            it = d_indices.emplace(str, d_table.intern(str)).first;
+        }
+        return it->second;
+    }
+
+  private:
+    StringTable& d_table;
+    std::unordered_map<std::string_view, StringTable::Index> d_indices;
+};
+
+class MapsLineParser
+{
+  public:
+    explicit MapsLineParser(std::string_view line)
+    : d_cursor(line.data())
+    , d_end(line.data() + line.size())
+    {
+    }
+
+    template<typename T>
+    bool parseNumber(T* value, int base)
+    {
+        auto [ptr, ec] = std::from_chars(d_cursor, d_end, *value, base);
+        if (ec != std::errc()) {
+            return false;
+        }
+        d_cursor = ptr;
+        return true;
+    }
+
+    bool consume(char expected)
+    {
+        if (d_cursor == d_end || *d_cursor != expected) {
+            return false;
+        }
+        ++d_cursor;
+        return true;
+    }
+
+    bool skipWhitespace()
+    {
+        const char* start = d_cursor;
+        while (d_cursor != d_end && (*d_cursor == ' ' || *d_cursor == '\t')) {
+            ++d_cursor;
+        }
+        return d_cursor != start;
+    }
+
+    std::string_view token(size_t size)
+    {
+        size = std::min<size_t>(size, d_end - d_cursor);
+        std::string_view result(d_cursor, size);
+        d_cursor += size;
+        return result;
+    }
+
+    std::string_view word()
+    {
+        const char* start = d_cursor;
+        while (d_cursor != d_end && *d_cursor != ' ' && *d_cursor != '\t') {
+            ++d_cursor;
+        }
+        return std::string_view(start, d_cursor - start);
+    }
+
+    std::string_view rest()
+    {
+        std::string_view result(d_cursor, d_end - d_cursor);
+        d_cursor = d_end;
+        return result;
+    }
+
+  private:
+    const char* d_cursor;
+    const char* d_end;
+};
+
 // Format: start-end permissions offset dev inode pathname
-static const std::regex MAPS_REGEXP(
-        R"(([0-9a-f]+)-([0-9a-f]+)\s+(.{4})\s+([0-9a-f]+)\s+([0-9a-f]+:[0-9a-f]+)\s+(\d+)\s*(.*)?)");
+std::optional<VirtualMap>
+parseMapsLine(std::string_view line, StringInterner& strings)
+{
+    MapsLineParser parser(line);
+    uintptr_t start;
+    uintptr_t end;
+    unsigned long offset;
+    unsigned long inode;
+
+    if (!parser.parseNumber(&start, 16) || !parser.consume('-') || !parser.parseNumber(&end, 16)
+        || !parser.skipWhitespace())
+    {
+        return std::nullopt;
+    }
+
+    std::string_view permissions = parser.token(4);
+    if (permissions.size() != 4 || !parser.skipWhitespace() || !parser.parseNumber(&offset, 16)
+        || !parser.skipWhitespace())
+    {
+        return std::nullopt;
+    }
+
+    std::string_view device = parser.word();
+    if (device.find(':') == std::string_view::npos || !parser.skipWhitespace()
+        || !parser.parseNumber(&inode, 10))
+    {
+        return std::nullopt;
+    }
+
+    parser.skipWhitespace();
+    std::string_view pathname = parser.rest();
+
+    return VirtualMap(
+            start,
+            end,
+            end - start,  // filesize
+            VirtualMap::parsePermissions(permissions),
+            offset,
+            strings.intern(device),
+            inode,
+            strings.intern(pathname));
+}
+
+std::string_view
+pathFilename(std::string_view path)
+{
+    size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
 
 std::vector<VirtualMap>
-parseProcMaps(pid_t pid)
+parseProcMaps(pid_t pid, StringTable& strings)
 {
-    std::vector<VirtualMap> maps;
     std::string maps_path = "/proc/" + std::to_string(pid) + "/maps";
 
-    std::ifstream maps_file(maps_path);
-    if (!maps_file.is_open()) {
+    std::string contents;
+    if (!readProcFile(maps_path, &contents)) {
         throw std::runtime_error("No such process id: " + std::to_string(pid));
     }
+    return parseMaps(contents, strings);
+}
 
-    std::string line;
-    while (std::getline(maps_file, line)) {
-        std::smatch match;
-        if (!std::regex_match(line, match, MAPS_REGEXP)) {
+std::vector<VirtualMap>
+parseMaps(std::string_view contents, StringTable& strings_table)
+{
+    std::vector<VirtualMap> maps;
+    StringInterner strings(strings_table);
+    std::string_view remaining = contents;
+    maps.reserve(std::count(contents.begin(), contents.end(), '\n'));
+    while (!remaining.empty()) {
+        size_t newline = remaining.find('\n');
+        std::string_view line = remaining.substr(0, newline);
+        remaining.remove_prefix(newline == std::string_view::npos ? remaining.size() : newline + 1);
+        if (line.empty()) {
+            continue;
+        }
+
+        auto map = parseMapsLine(line, strings);
+        if (!map) {
             LOG(DEBUG) << "Line cannot be recognized: " << line;
             continue;
         }
+        maps.push_back(std::move(*map));
+    }
+
+    return maps;
+}
+
+ProcMapQuery::ProcMapQuery(pid_t pid)
+{
+    std::string maps_path = "/proc/" + std::to_string(pid) + "/maps";
+    d_fd = open(maps_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (d_fd == -1) {
+        return;
+    }
+
+    // Probe the ioctl: kernels without it fail with ENOTTY (or EINVAL), while
+    // a kernel that supports it answers the query or reports ENOENT.
+    struct procmap_query query = {};
+    query.size = sizeof(query);
+    query.query_flags = PROCMAP_QUERY_COVERING_OR_NEXT_VMA;
+    query.query_addr = 0;
+    d_supported = ioctl(d_fd, PROCMAP_QUERY, &query) == 0 || errno == ENOENT;
+    LOG(DEBUG) << "PROCMAP_QUERY ioctl is " << (d_supported ? "" : "not ") << "supported for pid "
+               << pid;
+}
 
-        uintptr_t start = std::stoull(match[1].str(), nullptr, 16);
-        uintptr_t end = std::stoull(match[2].str(), nullptr, 16);
-        std::string permissions = match[3].str();
-        unsigned long offset = std::stoul(match[4].str(), nullptr, 16);
-        std::string device = match[5].str();
-        unsigned long inode = std::stoul(match[6].str());
-        std::string pathname = match[7].str();
-
-        size_t start_pos = pathname.find_first_not_of(" \t");
-        if (start_pos != std::string::npos) {
-            pathname = pathname.substr(start_pos);
-        } else {
-            pathname = "";
+ProcMapQuery::~ProcMapQuery()
+{
+    if (d_fd != -1) {
+        close(d_fd);
+    }
+}
+
+bool
+ProcMapQuery::isSupported() const
+{
+    return d_supported;
+}
+
+std::optional<VirtualMap>
+ProcMapQuery::findMapForAddress(uintptr_t addr) const
+{
+    return query(addr, 0);
+}
+
+std::optional<VirtualMap>
+ProcMapQuery::query(uintptr_t addr, uint64_t flags) const
+{
+    if (!d_supported) {
+        return std::nullopt;
+    }
+
+    char name[PATH_MAX + 64];
+    struct procmap_query query = {};
+    query.size = sizeof(query);
+    query.query_flags = flags;
+    query.query_addr = addr;
+    query.vma_name_addr = reinterpret_cast<uintptr_t>(name);
+    query.vma_name_size = sizeof(name);
+    if (ioctl(d_fd, PROCMAP_QUERY, &query) != 0) {
+        if (errno != ENOENT) {
+            LOG(DEBUG) << "PROCMAP_QUERY failed for address " << std::hex << std::showbase << addr
+                       << ": " << std::strerror(errno);
         }
+        return std::nullopt;
+    }
 
-        maps.emplace_back(
-                start,
-                end,
-                end - start,  // filesize
-                permissions,
-                offset,
-                device,
-                inode,
-                pathname);
+    uint8_t permissions = (query.vma_flags & PROCMAP_QUERY_VMA_SHARED) ? VirtualMap::SHARED
+                                                                       : VirtualMap::PRIVATE;
+    if (query.vma_flags & PROCMAP_QUERY_VMA_READABLE) {
+        permissions |= VirtualMap::READ;
+    }
+    if (query.vma_flags & PROCMAP_QUERY_VMA_WRITABLE) {
+        permissions |= VirtualMap::WRITE;
+    }
+    if (query.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE) {
+        permissions |= VirtualMap::EXECUTE;
     }
 
-    return maps;
+    char device[32];
+    snprintf(device, sizeof(device), "%02x:%02x", query.dev_major, query.dev_minor);
+
+    return VirtualMap(
+            query.vma_start,
+            query.vma_end,
+            query.vma_end - query.vma_start,  // filesize
+            permissions,
+            query.vma_offset,
+            d_strings.intern(device),
+            query.inode,
+            query.vma_name_size ? d_strings.intern(name) : StringTable::EMPTY);
+}
+
+const StringTable&
+ProcMapQuery::Strings() const
+{
+    return d_strings;
 }
 
 std::vector<VirtualMap>
 parseCoreFileMaps(
         const std::vector<CoreVirtualMap>& mapped_files,
-        const std::vector<CoreVirtualMap>& memory_maps)
+        const std::vector<CoreVirtualMap>& memory_maps,
+        StringTable& strings)
 {
     std::set<std::pair<uintptr_t, uintptr_t>> memory_map_ranges;
     for (const auto& map : memory_maps) {
@@ -146,7 +411,8 @@ parseCoreFileMaps(
                 elem.offset,
                 elem.device,
                 elem.inode,
-                path);
+                path,
+                strings);
     }
 
     return result;
@@ -156,7 +422,7 @@ static VirtualMap
 getBaseMap(const std::vector<VirtualMap>& binary_maps)
 {
     for (const auto& map : binary_maps) {
-        if (!map.Path().empty()) {
+        if (map.hasPath()) {
             return map;
         }
     }
@@ -167,19 +433,19 @@ getBaseMap(const std::vector<VirtualMap>& binary_maps)
 }
 
 static std::optional<VirtualMap>
-getBss(const std::vector<VirtualMap>& elf_maps, uintptr_t load_point)
+getBss(const std::vector<VirtualMap>& elf_maps, uintptr_t load_point, const StringTable& strings)
 {
     if (elf_maps.empty()) {
         return std::nullopt;
     }
 
     VirtualMap binary_map = getBaseMap(elf_maps);
-    if (binary_map.Path().empty()) {
+    if (!binary_map.hasPath()) {
         return std::nullopt;
     }
 
     SectionInfo bss_info;
-    if (!getSectionInfo(binary_map.Path(), ".bss", &bss_info)) {
+    if (!getSectionInfo(binary_map.Path(strings), ".bss", &bss_info)) {
         return std::nullopt;
     }
 
@@ -207,17 +473,18 @@ getBss(const std::vector<VirtualMap>& elf_maps, uintptr_t load_point)
             start,
             start + bss_info.size,
             bss_info.size,
-            "",  // flags
+            0,  // permissions
             offset,  // offset
-            "",  // device
+            StringTable::EMPTY,  // device
             0,  // inode
-            "");  // path
+            StringTable::EMPTY);  // path
 }
 
 ProcessMemoryMapInfo
 parseMapInformation(
         const std::string& binary,
         const std::vector<VirtualMap>& maps,
+        const StringTable& strings,
         const std::unordered_map<std::string, uintptr_t>* load_point_by_module)
 {
     std::unordered_map<std::string, std::vector<VirtualMap>> maps_by_library;
@@ -226,27 +493,27 @@ parseMapInformation(
     std::unordered_map<std::string, uintptr_t> computed_load_points;
     if (!load_point_by_module) {
         for (const auto& map : maps) {
-            if (!map.Path().empty()) {
-                std::string name = fs::path(map.Path()).filename().string();
-                if (computed_load_points.find(name) == computed_load_points.end()) {
-                    computed_load_points[name] = map.Start();
-                } else {
-                    computed_load_points[name] = std::min(computed_load_points[name], map.Start());
+            if (map.hasPath()) {
+                std::string name(pathFilename(map.Path(strings)));
+                auto [it, inserted] = computed_load_points.emplace(std::move(name), map.Start());
+                if (!inserted) {
+                    it->second = std::min(it->second, map.Start());
                 }
             }
         }
         load_point_by_module = &computed_load_points;
     }
 
+    std::vector<VirtualMap>* current_maps = &maps_by_library[current_lib];
     for (const auto& memory_range : maps) {
-        std::string path_name;
-        if (!memory_range.Path().empty()) {
-            path_name = fs::path(memory_range.Path()).filename().string();
-            current_lib = path_name;
-        } else {
-            path_name = current_lib;
+        if (memory_range.hasPath()) {
+            std::string_view path_name = pathFilename(memory_range.Path(strings));
+            if (path_name != current_lib) {
+                current_lib = path_name;
+                current_maps = &maps_by_library[current_lib];
+            }
         }
-        maps_by_library[path_name].push_back(memory_range);
+        current_maps->push_back(memory_range);
     }
 
     std::string binary_name = fs::path(binary).filename().string();
@@ -256,8 +523,8 @@ parseMapInformation(
         // Construct error message with available maps
         std::ostringstream available;
         for (const auto& map : maps) {
-            if (!map.Path().empty() && map.Path().find(".so") == std::string::npos) {
-                available << map.Path() << ", ";
+            if (map.hasPath() && map.Path(strings).find(".so") == std::string::npos) {
+                available << map.Path(strings) << ", ";
             }
         }
         std::string available_str = available.str();
@@ -271,7 +538,7 @@ parseMapInformation(
 
     const std::vector<VirtualMap>& binary_maps = python_it->second;
     VirtualMap python = getBaseMap(binary_maps);
-    LOG(INFO) << "python binary first map found: " << python.Path();
+    LOG(INFO) << "python binary first map found: " << python.Path(strings);
 
     std::optional<VirtualMap> libpython;
     const std::vector<VirtualMap>* elf_maps = nullptr;
@@ -296,7 +563,7 @@ parseMapInformation(
         auto load_it = load_point_by_module->find(libpython_name);
         load_point = (load_it != load_point_by_module->end()) ? load_it->second : UINTPTR_MAX;
         libpython = getBaseMap(libpython_maps);
-        LOG(INFO) << libpython_name << " first map found: " << libpython->Path();
+        LOG(INFO) << libpython_name << " first map found: " << libpython->Path(strings);
     } else {
         LOG(INFO) << "Process does not have a libpython.so, reading from binary";
         elf_maps = &binary_maps;
@@ -311,10 +578,10 @@ parseMapInformation(
         LOG(INFO) << "Heap map found";
     }
 
-    std::optional<VirtualMap> bss = getBss(*elf_maps, load_point);
+    std::optional<VirtualMap> bss = getBss(*elf_maps, load_point, strings);
     if (!bss) {
         for (const auto& map : *elf_maps) {
-            if (map.Path().empty() && map.Flags().find('r') != std::string::npos) {
+            if (!map.hasPath() && map.isReadable()) {
                 bss = map;
                 break;
             }
@@ -328,7 +595,7 @@ parseMapInformation(
 }
 
 ProcessMemoryMapInfo
-parseMapInformationForProcess(pid_t pid, const std::vector<VirtualMap>& maps)
+parseMapInformationForProcess(pid_t pid, const std::vector<VirtualMap>& maps, const StringTable& strings)
 {
     std::string exe_link = "/proc/" + std::to_string(pid) + "/exe";
     char exe_path[PATH_MAX];
@@ -337,7 +604,7 @@ parseMapInformationForProcess(pid_t pid, const std::vector<VirtualMap>& maps)
         throw std::runtime_error("Failed to read /proc/" + std::to_string(pid) + "/exe");
     }
     exe_path[len] = '\0';
-    return parseMapInformation(exe_path, maps);
+    return parseMapInformation(exe_path, maps, strings);
 }
 
 std::optional<std::string>
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <fstream>
+#include <linux/fs.h>
+#include <memory>
 #include <optional>
-#include <regex>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -11,6 +14,40 @@
 #include "elf_common.h"
 #include "mem.h"
 
+#ifndef PROCMAP_QUERY
+// Definitions from the Linux 6.11 UAPI headers, for building against older ones.
+#    define PROCFS_IOCTL_MAGIC 'f'
+#    define PROCMAP_QUERY _IOWR(PROCFS_IOCTL_MAGIC, 17, struct procmap_query)
+
+enum procmap_query_flags {
+    PROCMAP_QUERY_VMA_READABLE = 0x01,
+    PROCMAP_QUERY_VMA_WRITABLE = 0x02,
+    PROCMAP_QUERY_VMA_EXECUTABLE = 0x04,
+    PROCMAP_QUERY_VMA_SHARED = 0x08,
+    PROCMAP_QUERY_COVERING_OR_NEXT_VMA = 0x10,
+    PROCMAP_QUERY_FILE_BACKED_VMA = 0x20,
+};
+
+struct procmap_query
+{
+    uint64_t size;
+    uint64_t query_flags;
+    uint64_t query_addr;
+    uint64_t vma_start;
+    uint64_t vma_end;
+    uint64_t vma_flags;
+    uint64_t vma_page_size;
+    uint64_t vma_offset;
+    uint64_t inode;
+    uint32_t dev_major;
+    uint32_t dev_minor;
+    uint32_t vma_name_size;
+    uint32_t build_id_size;
+    uint64_t vma_name_addr;
+    uint64_t build_id_addr;
+};
+#endif
+
 namespace pystack {
 
 struct ProcessMemoryMapInfo
@@ -21,22 +58,58 @@ struct ProcessMemoryMapInfo
     std::optional<VirtualMap> libpython;
 };
 
+// The paths and devices of the maps are interned in the given table, which
+// must outlive them.
+std::vector<VirtualMap>
+parseProcMaps(pid_t pid, StringTable& strings);
+
+// Parses the contents of a /proc/PID/maps file, skipping unrecognized lines.
 std::vector<VirtualMap>
-parseProcMaps(pid_t pid);
+parseMaps(std::string_view contents, StringTable& strings);
+
+// On-demand address to VMA lookups through the PROCMAP_QUERY ioctl on
+// /proc/PID/maps (Linux 6.11+), avoiding reading and parsing the whole file.
+class ProcMapQuery
+{
+  public:
+    // Constructors
+    explicit ProcMapQuery(pid_t pid);
+    ProcMapQuery(const ProcMapQuery&) = delete;
+    ProcMapQuery& operator=(const ProcMapQuery&) = delete;
+
+    // Destructors
+    ~ProcMapQuery();
+
+    // Methods
+    bool isSupported() const;
+    std::optional<VirtualMap> findMapForAddress(uintptr_t addr) const;
+    const StringTable& Strings() const;
+
+  private:
+    // Methods
+    std::optional<VirtualMap> query(uintptr_t addr, uint64_t flags) const;
+
+    // Data members
+    int d_fd{-1};
+    bool d_supported{false};
+    mutable StringTable d_strings;
+};
 
 std::vector<VirtualMap>
 parseCoreFileMaps(
         const std::vector<CoreVirtualMap>& mapped_files,
-        const std::vector<CoreVirtualMap>& memory_maps);
+        const std::vector<CoreVirtualMap>& memory_maps,
+        StringTable& strings);
 
 ProcessMemoryMapInfo
 parseMapInformation(
         const std::string& binary,
         const std::vector<VirtualMap>& maps,
+        const StringTable& strings,
         const std::unordered_map<std::string, uintptr_t>* load_point_by_module = nullptr);
 
 ProcessMemoryMapInfo
-parseMapInformationForProcess(pid_t pid, const std::vector<VirtualMap>& maps);
+parseMapInformationForProcess(pid_t pid, const std::vector<VirtualMap>& maps, const StringTable& strings);
 
 std::optional<std::string>
 getThreadName(pid_t pid, pid_t tid);
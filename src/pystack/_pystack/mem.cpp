@@ -1,9 +1,11 @@
 #include <algorithm>
+#include <bit>
 #include <cerrno>
 #include <cstring>
 #include <fstream>
 #include <ios>
 #include <memory>
+#include <mutex>
 #include <sys/uio.h>
 #include <syscall.h>
 #include <system_error>
@@ -12,6 +14,7 @@
 
 #include "corefile.h"
 #include "logging.h"
+#include "maps_parser.h"
 #include "mem.h"
 
 namespace pystack {
@@ -33,26 +36,131 @@ _process_vm_readv(
 static const std::string PERM_MESSAGE = "Operation not permitted";
 static const size_t CACHE_CAPACITY = 5e+7;  // 50MB
 
+StringTable::StringTable()
+{
+    intern("");
+}
+
+StringTable::~StringTable()
+{
+    for (auto& chunk : d_chunks) {
+        delete[] chunk.load(std::memory_order_relaxed);
+    }
+}
+
+std::pair<size_t, size_t>
+StringTable::locate(Index index)
+{
+    size_t chunk = std::bit_width(index / FIRST_CHUNK_SIZE + 1) - 1;
+    size_t chunk_start = FIRST_CHUNK_SIZE * ((size_t{1} << chunk) - 1);
+    return {chunk, index - chunk_start};
+}
+
+StringTable::Index
+StringTable::intern(std::string_view str)
+{
+    {
+        std::shared_lock lock(d_mutex);
+        auto it = d_indices.find(str);
+        if (it != d_indices.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock lock(d_mutex);
+    auto it = d_indices.find(str);
+    if (it != d_indices.end()) {
+        return it->second;
+    }
+    auto index = static_cast<Index>(d_size);
+    auto [chunk, offset] = locate(index);
+    std::string* strings = d_chunks[chunk].load(std::memory_order_relaxed);
+    if (!strings) {
+        strings = new std::string[FIRST_CHUNK_SIZE << chunk];
+        d_chunks[chunk].store(strings, std::memory_order_release);
+    }
+    // Chunks never move, so the key can view the stored string.
+    strings[offset] = str;
+    ++d_size;
+    d_indices.emplace(strings[offset], index);
+    return index;
+}
+
+const std::string&
+StringTable::get(Index index) const
+{
+    auto [chunk, offset] = locate(index);
+    return d_chunks[chunk].load(std::memory_order_acquire)[offset];
+}
+
 VirtualMap::VirtualMap(
         uintptr_t start,
         uintptr_t end,
         unsigned long filesize,
-        std::string flags,
+        uint8_t permissions,
         unsigned long offset,
-        std::string device,
+        StringTable::Index device,
         unsigned long inode,
-        std::string pathname)
+        StringTable::Index path)
 : d_start(start)
 , d_end(end)
 , d_filesize(filesize)
-, d_flags(std::move(flags))
 , d_offset(offset)
-, d_device(std::move(device))
 , d_inode(inode)
-, d_path(std::move(pathname))
+, d_path(path)
+, d_device(device)
+, d_permissions(permissions)
 {
 }
 
+VirtualMap::VirtualMap(
+        uintptr_t start,
+        uintptr_t end,
+        unsigned long filesize,
+        std::string_view flags,
+        unsigned long offset,
+        std::string_view device,
+        unsigned long inode,
+        std::string_view pathname,
+        StringTable& strings)
+: VirtualMap(
+          start,
+          end,
+          filesize,
+          parsePermissions(flags),
+          offset,
+          strings.intern(device),
+          inode,
+          strings.intern(pathname))
+{
+}
+
+uint8_t
+VirtualMap::parsePermissions(std::string_view flags)
+{
+    uint8_t permissions = 0;
+    for (char flag : flags) {
+        switch (flag) {
+            case 'r':
+                permissions |= READ;
+                break;
+            case 'w':
+                permissions |= WRITE;
+                break;
+            case 'x':
+                permissions |= EXECUTE;
+                break;
+            case 'p':
+                permissions |= PRIVATE;
+                break;
+            case 's':
+                permissions |= SHARED;
+                break;
+        }
+    }
+    return permissions;
+}
+
 bool
 VirtualMap::containsAddr(remote_addr_t addr) const
 {
@@ -77,10 +185,46 @@ VirtualMap::FileSize() const
     return d_filesize;
 }
 
-const std::string&
+uint8_t
+VirtualMap::Permissions() const
+{
+    return d_permissions;
+}
+
+std::string
 VirtualMap::Flags() const
 {
-    return d_flags;
+    // Maps from /proc/PID/maps always say whether they are private or shared
+    // and use the fixed-width "rwxp" format. Maps from core files only list
+    // the permissions that are present.
+    if (d_permissions & (PRIVATE | SHARED)) {
+        std::string flags = "---p";
+        if (d_permissions & READ) {
+            flags[0] = 'r';
+        }
+        if (d_permissions & WRITE) {
+            flags[1] = 'w';
+        }
+        if (d_permissions & EXECUTE) {
+            flags[2] = 'x';
+        }
+        if (d_permissions & SHARED) {
+            flags[3] = 's';
+        }
+        return flags;
+    }
+
+    std::string flags;
+    if (d_permissions & READ) {
+        flags += 'r';
+    }
+    if (d_permissions & WRITE) {
+        flags += 'w';
+    }
+    if (d_permissions & EXECUTE) {
+        flags += 'x';
+    }
+    return flags;
 }
 
 unsigned long
@@ -90,9 +234,9 @@ VirtualMap::Offset() const
 }
 
 const std::string&
-VirtualMap::Device() const
+VirtualMap::Device(const StringTable& strings) const
 {
-    return d_device;
+    return strings.get(d_device);
 }
 
 unsigned long
@@ -102,7 +246,13 @@ VirtualMap::Inode() const
 }
 
 const std::string&
-VirtualMap::Path() const
+VirtualMap::Path(const StringTable& strings) const
+{
+    return strings.get(d_path);
+}
+
+StringTable::Index
+VirtualMap::PathIndex() const
 {
     return d_path;
 }
@@ -169,15 +319,24 @@ LRUCache::can_fit(size_t size)
     return d_cache_capacity >= size;
 }
 
-ProcessMemoryManager::ProcessMemoryManager(pid_t pid, const std::vector<VirtualMap>& vmaps)
+void
+LRUCache::clear()
+{
+    d_cache.clear();
+    d_cache_list.clear();
+    d_size = 0;
+}
+
+ProcessMemoryManager::ProcessMemoryManager(pid_t pid, SharedVirtualMaps vmaps)
 : d_pid(pid)
-, d_vmaps(vmaps)
+, d_vmaps(std::move(vmaps))
 , d_lru_cache(CACHE_CAPACITY)
 {
 }
 
 ProcessMemoryManager::ProcessMemoryManager(pid_t pid)
 : d_pid(pid)
+, d_vmaps(std::make_shared<const VirtualMaps>())
 , d_lru_cache(CACHE_CAPACITY)
 {
 }
@@ -249,14 +408,67 @@ ProcessMemoryManager::readChunkThroughMemFile(remote_addr_t addr, size_t len, ch
     return static_cast<ssize_t>(len);
 }
 
+const VirtualMap*
+ProcessMemoryManager::findVmap(remote_addr_t addr, size_t len) const
+{
+    auto containsRange = [&](const VirtualMap& vmap) {
+        return vmap.containsAddr(addr) && vmap.containsAddr(addr + len - 1);
+    };
+
+    auto vmap = std::find_if(d_vmaps->begin(), d_vmaps->end(), containsRange);
+    if (vmap != d_vmaps->end()) {
+        return &*vmap;
+    }
+    vmap = std::find_if(d_queried_vmaps.begin(), d_queried_vmaps.end(), containsRange);
+    if (vmap != d_queried_vmaps.end()) {
+        return &*vmap;
+    }
+
+    // The address is not covered by our snapshot of the maps (or we don't
+    // have one). If the kernel supports it, ask it directly for the VMA so
+    // that further reads from it can be served from the cache. What it
+    // answers, including that nothing is mapped, holds until the next refresh.
+    const remote_addr_t page = addr / getpagesize();
+    auto containsAddr = [&](const VirtualMap& vmap) { return vmap.containsAddr(addr); };
+    if (d_unmapped_pages.count(page)
+        || std::any_of(d_queried_vmaps.begin(), d_queried_vmaps.end(), containsAddr))
+    {
+        return nullptr;
+    }
+    if (!d_map_query) {
+        d_map_query = std::make_shared<ProcMapQuery>(d_pid);
+    }
+    if (!d_map_query->isSupported()) {
+        return nullptr;
+    }
+    auto queried_vmap = d_map_query->findMapForAddress(addr);
+    if (!queried_vmap) {
+        d_unmapped_pages.insert(page);
+        return nullptr;
+    }
+    LOG(DEBUG) << std::hex << std::showbase << "Found map " << queried_vmap->Start() << "-"
+               << queried_vmap->End() << " for address " << addr << " using PROCMAP_QUERY";
+    d_queried_vmaps.push_back(std::move(*queried_vmap));
+    return containsRange(d_queried_vmaps.back()) ? &d_queried_vmaps.back() : nullptr;
+}
+
+bool
+AbstractRemoteMemoryManager::visitResidentMemory(
+        remote_addr_t addr,
+        size_t size,
+        const MemoryVisitor& visitor) const
+{
+    std::vector<char> buffer(size);
+    copyMemoryFromProcess(addr, size, buffer.data());
+    return visitor(addr, buffer.data(), size);
+}
+
 ssize_t
 ProcessMemoryManager::copyMemoryFromProcess(remote_addr_t addr, size_t len, void* dst) const
 {
-    auto vmap = std::find_if(d_vmaps.begin(), d_vmaps.end(), [&](const auto& vmap) {
-        return vmap.containsAddr(addr) && vmap.containsAddr(addr + len - 1);
-    });
+    const VirtualMap* vmap = findVmap(addr, len);
 
-    if (vmap == d_vmaps.end() || !d_lru_cache.can_fit(vmap->Size())) {
+    if (vmap == nullptr || !d_lru_cache.can_fit(vmap->Size())) {
         return readChunk(addr, len, reinterpret_cast<char*>(dst));
     }
 
@@ -282,6 +494,15 @@ ProcessMemoryManager::copyMemoryFromProcess(remote_addr_t addr, size_t len, void
     return len;
 }
 
+void
+ProcessMemoryManager::refresh(SharedVirtualMaps vmaps)
+{
+    d_vmaps = std::move(vmaps);
+    d_queried_vmaps.clear();
+    d_unmapped_pages.clear();
+    d_lru_cache.clear();
+}
+
 bool
 ProcessMemoryManager::isAddressValid(remote_addr_t addr, const VirtualMap& map) const
 {
@@ -291,11 +512,99 @@ ProcessMemoryManager::isAddressValid(remote_addr_t addr, const VirtualMap& map)
     return map.Start() <= addr && addr < map.End();
 }
 
+std::optional<std::vector<std::pair<remote_addr_t, size_t>>>
+ProcessMemoryManager::findResidentRanges(remote_addr_t addr, size_t size) const
+{
+    static constexpr uint64_t PAGEMAP_PRESENT = 1ULL << 63;
+    static constexpr size_t PAGEMAP_BATCH = 4096;
+
+    if (d_pagemap_unavailable || size == 0) {
+        return std::nullopt;
+    }
+    if (!d_pagemap) {
+        std::string filepath = "/proc/" + std::to_string(d_pid) + "/pagemap";
+        d_pagemap = file_unique_ptr(fopen(filepath.c_str(), "r"), fclose);
+        if (!d_pagemap) {
+            LOG(DEBUG) << "Cannot open " << filepath << " (" << std::strerror(errno)
+                       << "), memory residency information is not available";
+            d_pagemap_unavailable = true;
+            return std::nullopt;
+        }
+    }
+
+    const size_t page_size = getpagesize();
+    const remote_addr_t end = addr + size;
+    const remote_addr_t first_page = addr / page_size;
+    const remote_addr_t last_page = (end - 1) / page_size;
+
+    std::vector<std::pair<remote_addr_t, size_t>> ranges;
+    std::vector<uint64_t> entries(std::min<size_t>(PAGEMAP_BATCH, last_page - first_page + 1));
+    for (remote_addr_t page = first_page; page <= last_page; page += entries.size()) {
+        size_t count = std::min<size_t>(entries.size(), last_page - page + 1);
+        size_t bytes = count * sizeof(uint64_t);
+        if (pread(fileno(d_pagemap.get()), entries.data(), bytes, page * sizeof(uint64_t))
+            != static_cast<ssize_t>(bytes))
+        {
+            LOG(DEBUG) << "Failed to read the page map of process " << d_pid << " ("
+                       << std::strerror(errno) << ")";
+            return std::nullopt;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!(entries[i] & PAGEMAP_PRESENT)) {
+                continue;
+            }
+            remote_addr_t range_start = std::max<remote_addr_t>(addr, (page + i) * page_size);
+            remote_addr_t range_end = std::min<remote_addr_t>(end, (page + i + 1) * page_size);
+            if (!ranges.empty() && ranges.back().first + ranges.back().second == range_start) {
+                ranges.back().second += range_end - range_start;
+            } else {
+                ranges.emplace_back(range_start, range_end - range_start);
+            }
+        }
+    }
+    return ranges;
+}
+
+bool
+ProcessMemoryManager::visitResidentMemory(
+        remote_addr_t addr,
+        size_t size,
+        const MemoryVisitor& visitor) const
+{
+    std::optional<std::vector<std::pair<remote_addr_t, size_t>>> ranges;
+    if (getenv("_PYSTACK_NO_PAGEMAP") == nullptr) {
+        ranges = findResidentRanges(addr, size);
+    }
+    if (!ranges) {
+        return AbstractRemoteMemoryManager::visitResidentMemory(addr, size, visitor);
+    }
+
+    LOG(DEBUG) << std::hex << std::showbase << "Found " << std::dec << ranges->size()
+               << " runs of resident pages between " << std::hex << addr << " and " << addr + size;
+
+    // Read the resident pages directly: caching the whole map would fault in
+    // exactly the pages that we are trying not to touch.
+    std::vector<char> buffer;
+    for (const auto& [range_start, range_size] : *ranges) {
+        buffer.resize(range_size);
+        try {
+            readChunk(range_start, range_size, buffer.data());
+        } catch (const InvalidRemoteAddress&) {
+            // The page may have been unmapped since we looked at the page map
+            continue;
+        }
+        if (visitor(range_start, buffer.data(), range_size)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 CorefileRemoteMemoryManager::CorefileRemoteMemoryManager(
         std::shared_ptr<CoreFileAnalyzer> analyzer,
-        std::vector<VirtualMap>& vmaps)
+        SharedVirtualMaps vmaps)
 : d_analyzer(std::move(analyzer))
-, d_vmaps(vmaps)
+, d_vmaps(std::move(vmaps))
 {
     CoreFileExtractor extractor{d_analyzer};
     d_shared_libs = extractor.ModuleInformation();
@@ -396,10 +705,49 @@ CorefileRemoteMemoryManager::copyMemoryFromProcess(remote_addr_t addr, size_t si
     return size;
 }
 
+bool
+CorefileRemoteMemoryManager::visitResidentMemory(
+        remote_addr_t addr,
+        size_t size,
+        const MemoryVisitor& visitor) const
+{
+    // Only the pages that were dumped into the core file are "resident": any
+    // other part of the range was either never touched by the process or
+    // only exists in the file that backs the map.
+    const remote_addr_t end = addr + size;
+    bool found_dumped_memory = false;
+    for (const auto& map : *d_vmaps) {
+        if (map.FileSize() == 0 || map.Offset() == 0) {
+            continue;
+        }
+        remote_addr_t range_start = std::max<remote_addr_t>(addr, map.Start());
+        remote_addr_t range_end = std::min<remote_addr_t>(end, map.Start() + map.FileSize());
+        if (range_start >= range_end) {
+            continue;
+        }
+        off_t offset_in_file = map.Offset() + (range_start - map.Start());
+        size_t range_size = range_end - range_start;
+        if (range_size > d_corefile_size
+            || static_cast<size_t>(offset_in_file) > d_corefile_size - range_size)
+        {
+            continue;
+        }
+        found_dumped_memory = true;
+        if (visitor(range_start, d_corefile_data.get() + offset_in_file, range_size)) {
+            return true;
+        }
+    }
+
+    if (!found_dumped_memory) {
+        return AbstractRemoteMemoryManager::visitResidentMemory(addr, size, visitor);
+    }
+    return false;
+}
+
 CorefileRemoteMemoryManager::StatusCode
 CorefileRemoteMemoryManager::getMemoryLocationFromCore(remote_addr_t addr, off_t* offset_in_file) const
 {
-    auto corefile_it = std::find_if(d_vmaps.cbegin(), d_vmaps.cend(), [&](auto& map) {
+    auto corefile_it = std::find_if(d_vmaps->cbegin(), d_vmaps->cend(), [&](auto& map) {
         // When considering if the data is in the core file, we need to check if the address is
         // within the chunk of the segment in the core file. map.End() corresponds
         // to the end of the segment in memory when the process was alive but when the core was
@@ -408,7 +756,7 @@ CorefileRemoteMemoryManager::getMemoryLocationFromCore(remote_addr_t addr, off_t
         uintptr_t fileEnd = map.Start() + map.FileSize();
         return (map.Start() <= addr && addr < fileEnd) && (map.FileSize() != 0 && map.Offset() != 0);
     });
-    if (corefile_it == d_vmaps.cend()) {
+    if (corefile_it == d_vmaps->cend()) {
         return StatusCode::ERROR;
     }
 
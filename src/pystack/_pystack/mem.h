@@ -1,15 +1,22 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <fcntl.h>
 #include <functional>
 #include <list>
 #include <memory>
 #include <optional>
+#include <shared_mutex>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "elf_common.h"
@@ -43,9 +50,62 @@ struct InvalidCopiedMemory : public RemoteMemCopyError
     }
 };
 
+// Table of interned strings. Memory maps reference their path and device by
+// index, so that the thousands of maps of a process (and the copies that
+// different components keep of them) share a single copy of each string.
+// Whoever owns a list of maps owns the table they were interned in (each
+// process manager has its own), so the strings of a process are released
+// together with it. Indices are stable for the lifetime of the table.
+class StringTable
+{
+  public:
+    // Types
+    using Index = uint32_t;
+
+    // Constructors
+    StringTable();
+    StringTable(const StringTable&) = delete;
+    StringTable& operator=(const StringTable&) = delete;
+
+    // Destructors
+    ~StringTable();
+
+    // Methods
+    Index intern(std::string_view str);
+    // Doesn't lock: strings are stored in chunks that never move, so an
+    // index can be resolved while other strings are being interned.
+    const std::string& get(Index index) const;
+
+    // Constants
+    static constexpr Index EMPTY = 0;
+
+  private:
+    // Chunk i holds FIRST_CHUNK_SIZE << i strings, enough chunks for any Index.
+    static constexpr size_t FIRST_CHUNK_SIZE = 64;
+    static constexpr size_t MAX_CHUNKS = 27;
+
+    // Methods
+    static std::pair<size_t, size_t> locate(Index index);
+
+    // Data members
+    mutable std::shared_mutex d_mutex;
+    size_t d_size{0};
+    std::array<std::atomic<std::string*>, MAX_CHUNKS> d_chunks{};
+    std::unordered_map<std::string_view, Index> d_indices;
+};
+
 class VirtualMap
 {
   public:
+    // Enums
+    enum Permission : uint8_t {
+        READ = 1 << 0,
+        WRITE = 1 << 1,
+        EXECUTE = 1 << 2,
+        PRIVATE = 1 << 3,
+        SHARED = 1 << 4,
+    };
+
     // Constructors
     VirtualMap() = default;
 
@@ -53,11 +113,22 @@ class VirtualMap
             uintptr_t start,
             uintptr_t end,
             unsigned long filesize,
-            std::string flags,
+            uint8_t permissions,
             unsigned long offset,
-            std::string dev,
+            StringTable::Index device,
             unsigned long inode,
-            std::string pathname);
+            StringTable::Index path);
+
+    VirtualMap(
+            uintptr_t start,
+            uintptr_t end,
+            unsigned long filesize,
+            std::string_view flags,
+            unsigned long offset,
+            std::string_view dev,
+            unsigned long inode,
+            std::string_view pathname,
+            StringTable& strings);
 
     // Getters
     uintptr_t Start() const;
@@ -66,40 +137,53 @@ class VirtualMap
 
     unsigned long FileSize() const;
 
-    const std::string& Flags() const;
+    uint8_t Permissions() const;
+
+    std::string Flags() const;
 
     unsigned long Offset() const;
 
-    const std::string& Device() const;
+    const std::string& Device(const StringTable& strings) const;
 
     unsigned long Inode() const;
 
-    const std::string& Path() const;
+    const std::string& Path(const StringTable& strings) const;
+
+    StringTable::Index PathIndex() const;
 
     size_t Size() const;
 
     // Methods
     bool containsAddr(remote_addr_t addr) const;
+    static uint8_t parsePermissions(std::string_view flags);
+
+    // Operators
+    bool operator==(const VirtualMap& other) const = default;
 
     // Permission helpers
     bool isExecutable() const
     {
-        return d_flags.find('x') != std::string::npos;
+        return d_permissions & EXECUTE;
     }
 
     bool isReadable() const
     {
-        return d_flags.find('r') != std::string::npos;
+        return d_permissions & READ;
     }
 
     bool isWritable() const
     {
-        return d_flags.find('w') != std::string::npos;
+        return d_permissions & WRITE;
     }
 
     bool isPrivate() const
     {
-        return d_flags.find('p') != std::string::npos;
+        return d_permissions & PRIVATE;
+    }
+
+    bool hasPath() const
+    {
+        return d_path != StringTable::EMPTY;
     }
 
   private:
@@ -107,13 +191,18 @@ class VirtualMap
     uintptr_t d_start{};
     uintptr_t d_end{};
     unsigned long d_filesize{};
-    std::string d_flags{};
     unsigned long d_offset{};
-    std::string d_device{};
     unsigned long d_inode{};
-    std::string d_path{};
+    StringTable::Index d_path{StringTable::EMPTY};
+    StringTable::Index d_device{StringTable::EMPTY};
+    uint8_t d_permissions{};
 };
 
+static_assert(std::is_trivially_copyable_v<VirtualMap>);
+
+using VirtualMaps = std::vector<VirtualMap>;
+using SharedVirtualMaps = std::shared_ptr<const VirtualMaps>;
+
 class LRUCache
 {
   private:
@@ -136,6 +225,7 @@ class LRUCache
     const std::vector<char>& get(uintptr_t key);
     bool exists(uintptr_t key);
     bool can_fit(size_t size);
+    void clear();
 
   private:
     std::list<ListNode> d_cache_list;
@@ -153,30 +243,56 @@ class AbstractRemoteMemoryManager
     // Destructors
     virtual ~AbstractRemoteMemoryManager() = default;
 
+    // Types
+    using MemoryVisitor = std::function<bool(remote_addr_t addr, const char* data, size_t size)>;
+
     // Methods
     virtual ssize_t copyMemoryFromProcess(remote_addr_t addr, size_t size, void* destination) const = 0;
     virtual bool isAddressValid(remote_addr_t addr, const VirtualMap& map) const = 0;
+
+    // Calls the visitor with the contents of every run of pages in the range
+    // [addr, addr + size) that is resident in the target, until the visitor
+    // returns true. Pages that are not resident are neither read nor cached,
+    // so scanning a region doesn't fault them in. Returns whether the visitor
+    // stopped the iteration.
+    virtual bool visitResidentMemory(remote_addr_t addr, size_t size, const MemoryVisitor& visitor)
+            const;
 };
 
+class ProcMapQuery;
+
 class ProcessMemoryManager : public AbstractRemoteMemoryManager
 {
     // Constructors
   public:
     explicit ProcessMemoryManager(pid_t pid);
-    explicit ProcessMemoryManager(pid_t pid, const std::vector<VirtualMap>& vmaps);
+    explicit ProcessMemoryManager(pid_t pid, SharedVirtualMaps vmaps);
 
     // Methods
     ssize_t copyMemoryFromProcess(remote_addr_t addr, size_t size, void* dst) const override;
     bool isAddressValid(remote_addr_t addr, const VirtualMap& map) const override;
+    bool visitResidentMemory(remote_addr_t addr, size_t size, const MemoryVisitor& visitor)
+            const override;
+    // Forgets every cached page, as the process may have run since they
+    // were read, and starts using the given maps.
+    void refresh(SharedVirtualMaps vmaps);
 
   private:
     // Data members
     pid_t d_pid;
-    std::vector<VirtualMap> d_vmaps;
+    SharedVirtualMaps d_vmaps;
+    mutable std::vector<VirtualMap> d_queried_vmaps;
+    mutable std::unordered_set<remote_addr_t> d_unmapped_pages;
+    mutable std::shared_ptr<ProcMapQuery> d_map_query;
     mutable LRUCache d_lru_cache;
     mutable file_unique_ptr d_memfile;
+    mutable file_unique_ptr d_pagemap;
+    mutable bool d_pagemap_unavailable{false};
 
     // Methods
+    const VirtualMap* findVmap(remote_addr_t addr, size_t len) const;
+    std::optional<std::vector<std::pair<remote_addr_t, size_t>>>
+    findResidentRanges(remote_addr_t addr, size_t size) const;
     ssize_t readChunk(remote_addr_t addr, size_t len, char* dst) const;
     ssize_t readChunkDirect(remote_addr_t addr, size_t len, char* dst) const;
     ssize_t readChunkThroughMemFile(remote_addr_t addr, size_t len, char* dst) const;
@@ -196,13 +312,16 @@ class CorefileRemoteMemoryManager : public AbstractRemoteMemoryManager
     // Constructors
     explicit CorefileRemoteMemoryManager(
             std::shared_ptr<CoreFileAnalyzer> analyzer,
-            std::vector<VirtualMap>& vmaps);
+            SharedVirtualMaps vmaps);
 
     // Methods
     ssize_t copyMemoryFromProcess(remote_addr_t addr, size_t size, void* destination) const override;
 
     bool isAddressValid(remote_addr_t addr, const VirtualMap& map) const override;
 
+    bool visitResidentMemory(remote_addr_t addr, size_t size, const MemoryVisitor& visitor)
+            const override;
+
   private:
     // Structs and Enums
     enum class StatusCode {
@@ -221,7 +340,7 @@ class CorefileRemoteMemoryManager : public AbstractRemoteMemoryManager
 
     // Data members
     std::shared_ptr<CoreFileAnalyzer> d_analyzer;
-    std::vector<VirtualMap> d_vmaps;
+    SharedVirtualMaps d_vmaps;
     std::vector<SimpleVirtualMap> d_shared_libs;
     size_t d_corefile_size;
     std::unique_ptr<char, std::function<void(char*)>> d_corefile_data;
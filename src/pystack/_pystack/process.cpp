@@ -1,18 +1,25 @@
 #include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <dirent.h>
 #include <filesystem>
+#include <fstream>
 #include <memory>
+#include <mutex>
 
 #include <iostream>
 #include <stdexcept>
 #include <string>
+#include <signal.h>
 #include <sys/ptrace.h>
 #include <sys/wait.h>
+#include <thread>
+#include <tuple>
 #include <utility>
 #include <vector>
 
 #include "corefile.h"
+#include "deadline.h"
 #include "logging.h"
 #include "maps_parser.h"
 #include "mem.h"
@@ -23,6 +30,7 @@
 #include "pyframe.h"
 #include "pythread.h"
 #include "pytypes.h"
+#include "timing.h"
 #include "version.h"
 #include "version_detector.h"
 
@@ -77,6 +85,27 @@ getMainMap(const ProcessMemoryMapInfo& map_info)
     return map_info.libpython ? *map_info.libpython : map_info.python;
 }
 
+// Symbols that pystack may look up in the interpreter. They are resolved
+// together the first time any symbol is needed.
+const char* const PREFETCHED_SYMBOLS[] = {
+        "_PyRuntime",
+        "interp_head",
+        "_PyThreadState_Current",
+        "Py_Version",
+        "float_repr",
+        "none_repr",
+        "bool_repr",
+        "code_repr",
+};
+
+// Offsets from the load point of the main map of the symbols resolved so
+// far, keyed by the build id of the main map's file. Processes running the
+// same binary share them, so its symbol tables only need to be loaded and
+// indexed for the first one. Symbols that don't exist are stored as nullopt.
+std::mutex g_symbol_offsets_mutex;
+std::unordered_map<std::string, std::unordered_map<std::string, std::optional<remote_addr_t>>>
+        g_symbol_offsets_by_build_id;
+
 }  // namespace
 
 namespace {  // unnamed
@@ -149,9 +178,40 @@ getProcessTids(pid_t pid)
     return tids;
 }
 
-ProcessTracer::ProcessTracer(pid_t pid)
+ProcessTracer::ProcessTracer(pid_t pid, AttachStrategy strategy)
+{
+    ScopedTimer timer("attach");
+    if (strategy == AttachStrategy::BURST && !attachInBurst(pid)) {
+        LOG(INFO) << "PTRACE_SEIZE is not supported, stopping threads one at a time";
+        strategy = AttachStrategy::SEQUENTIAL;
+    }
+    if (strategy == AttachStrategy::SEQUENTIAL) {
+        attachSequentially(pid);
+    }
+    LOG(INFO) << "All " << d_tids.size() << " threads stopped within "
+              << std::chrono::duration_cast<std::chrono::microseconds>(d_stop_skew).count() << "us";
+    if (TimingReport* report = TimingReport::current()) {
+        report->recordStopSkew(d_stop_skew);
+    }
+}
+
+void
+ProcessTracer::throwAttachError(int error)
+{
+    // We got an error for a TID on a previous iteration. Since we found the
+    // TID again, it still belongs to us and should have been stoppable.
+    detachFromProcess();
+    if (error == EPERM) {
+        throw std::runtime_error(PERM_MESSAGE);
+    }
+    throw std::system_error(error, std::generic_category());
+}
+
+void
+ProcessTracer::attachSequentially(pid_t pid)
 {
     std::unordered_map<int, int> error_by_tid;
+    std::optional<std::chrono::steady_clock::time_point> first_attach;
 
     bool found_new_tid = true;
     while (found_new_tid) {
@@ -165,21 +225,16 @@ ProcessTracer::ProcessTracer(pid_t pid)
 
             auto err_it = error_by_tid.find(tid);
             if (err_it != error_by_tid.end()) {
-                // We got an error for this TID on the last iteration.
-                // Since we found the TID again this iteration, it still
-                // belongs to us and should have been stoppable.
-                detachFromProcess();
-
-                int error = err_it->second;
-                if (error == EPERM) {
-                    throw std::runtime_error(PERM_MESSAGE);
-                }
-                throw std::system_error(error, std::generic_category());
+                throwAttachError(err_it->second);
             }
 
             found_new_tid = true;
 
             LOG(INFO) << "Trying to stop thread " << tid;
+            if (!first_attach) {
+                first_attach = std::chrono::steady_clock::now();
+                d_stopped_at = first_attach;
+            }
             long ret = ptrace(PTRACE_ATTACH, tid, nullptr, nullptr);
             if (ret < 0) {
                 int error = errno;
@@ -201,17 +256,172 @@ ProcessTracer::ProcessTracer(pid_t pid)
                 }
             }
             LOG(INFO) << "Thread " << tid << " stopped";
+            d_stop_skew = std::chrono::steady_clock::now() - *first_attach;
+        }
+    }
+}
+
+bool
+ProcessTracer::attachInBurst(pid_t pid)
+{
+    std::unordered_map<int, int> error_by_tid;
+    std::optional<std::chrono::steady_clock::time_point> first_interrupt;
+
+    // Seizing a thread doesn't stop it, so every thread is seized first and
+    // then all of them are stopped at once with PTRACE_INTERRUPT. Nothing is
+    // logged between the first interrupt and the last stop, as every log
+    // message goes through the Python logger.
+    bool found_new_tid = true;
+    while (found_new_tid) {
+        found_new_tid = false;
+
+        std::vector<int> seized;
+        auto tids = getProcessTids(pid);
+        for (auto& tid : tids) {
+            auto err_it = error_by_tid.find(tid);
+            if (err_it != error_by_tid.end()) {
+                throwAttachError(err_it->second);
+            }
+
+            if (d_tids.count(tid)) {
+                continue;  // already stopped
+            }
+
+            found_new_tid = true;
+
+            if (ptrace(PTRACE_SEIZE, tid, nullptr, nullptr) < 0) {
+                int error = errno;
+                if (error == EIO && d_tids.empty()) {
+                    // The kernel predates PTRACE_SEIZE.
+                    return false;
+                }
+                LOG(WARNING) << "Failed to seize thread " << tid << ": " << strerror(error);
+                error_by_tid.emplace(tid, error);
+                continue;
+            }
+            // Add each tid as we seize it: these are the tids we detach from,
+            // whether or not we manage to stop them.
+            d_tids.insert(tid);
+            seized.push_back(tid);
+        }
+        if (seized.empty()) {
+            continue;
+        }
+        LOG(INFO) << "Seized " << seized.size() << " threads, stopping them";
+
+        auto burst_start = std::chrono::steady_clock::now();
+        if (!first_interrupt) {
+            first_interrupt = burst_start;
+            d_stopped_at = first_interrupt;
+        }
+        std::vector<int> interrupted;
+        std::vector<std::pair<int, int>> interrupt_errors;
+        for (int tid : seized) {
+            if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0) {
+                interrupt_errors.emplace_back(tid, errno);
+                continue;
+            }
+            interrupted.push_back(tid);
+        }
+        std::vector<std::pair<int, int>> wait_errors;
+        for (int tid : interrupted) {
+            if (int error = waitForInterruptStop(tid)) {
+                wait_errors.emplace_back(tid, error);
+            }
         }
+        auto burst_end = std::chrono::steady_clock::now();
+        d_stop_skew = burst_end - *first_interrupt;
+        LOG(INFO) << "Stopped " << seized.size() - interrupt_errors.size() - wait_errors.size()
+                  << " threads in "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(burst_end - burst_start)
+                             .count()
+                  << "us";
+        // Threads that couldn't be stopped are still detached from. If they
+        // are still alive, the next scan finds them again and fails.
+        for (const auto& [tid, error] : interrupt_errors) {
+            LOG(WARNING) << "Failed to interrupt thread " << tid << ": " << strerror(error);
+            error_by_tid.emplace(tid, error);
+        }
+        for (const auto& [tid, error] : wait_errors) {
+            LOG(WARNING) << "Failed to wait for thread " << tid << " to stop: " << strerror(error);
+            error_by_tid.emplace(tid, error);
+        }
+    }
+    return true;
+}
+
+int
+ProcessTracer::waitForInterruptStop(int tid)
+{
+    int status;
+    pid_t ret;
+    do {
+        ret = waitpid(tid, &status, __WALL);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        return errno;
+    }
+    if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        // The thread finished before it could be stopped.
+        d_tids.erase(tid);
+    } else if (WIFSTOPPED(status) && (status >> 16) != PTRACE_EVENT_STOP) {
+        // A signal-delivery-stop won the race against the interrupt. The
+        // thread is stopped all the same, but the signal has to be handed
+        // back to it when we detach.
+        d_pending_signals[tid] = WSTOPSIG(status);
+    }
+    return 0;
+}
+
+void
+ProcessTracer::detachFromThread(int tid)
+{
+    auto signal = d_pending_signals.find(tid);
+    intptr_t data = signal != d_pending_signals.end() ? signal->second : 0;
+    if (ptrace(PTRACE_DETACH, tid, nullptr, reinterpret_cast<void*>(data)) == 0 || errno != ESRCH) {
+        return;
+    }
+
+    // A thread can only be detached from while it is stopped. A seized
+    // thread that we failed to stop would otherwise stay traced, and hang
+    // on its next signal, until we exit: stop it once more to let it go.
+    if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0) {
+        return;  // It isn't seized, or it is gone.
     }
-    LOG(INFO) << "All " << d_tids.size() << " threads stopped";
+    int status;
+    pid_t ret;
+    do {
+        ret = waitpid(tid, &status, __WALL);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0 || !WIFSTOPPED(status)) {
+        return;
+    }
+    if ((status >> 16) != PTRACE_EVENT_STOP) {
+        data = WSTOPSIG(status);
+    }
+    ptrace(PTRACE_DETACH, tid, nullptr, reinterpret_cast<void*>(data));
 }
 
 void
 ProcessTracer::detachFromProcess()
 {
+    LOG(INFO) << "Detaching from " << d_tids.size() << " threads";
     for (auto& tid : d_tids) {
-        LOG(INFO) << "Detaching from thread " << tid;
-        ptrace(PTRACE_DETACH, tid, nullptr, nullptr);
+        detachFromThread(tid);
+    }
+    d_tids.clear();
+    d_pending_signals.clear();
+
+    if (d_stopped_at) {
+        auto stopped_for = std::chrono::steady_clock::now() - *d_stopped_at;
+        d_stopped_at.reset();
+        LOG(INFO) << "Threads were stopped for "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(stopped_for).count()
+                  << "us";
+        if (TimingReport* report = TimingReport::current()) {
+            report->recordTargetStopped(stopped_for);
+        }
     }
 }
 
@@ -220,15 +430,238 @@ ProcessTracer::~ProcessTracer()
     detachFromProcess();
 }
 
+std::chrono::nanoseconds
+ProcessTracer::stopSkew() const
+{
+    return d_stop_skew;
+}
+
 std::vector<int>
 ProcessTracer::getTids() const
 {
     return {d_tids.begin(), d_tids.end()};
 }
 
+namespace {
+
+const std::chrono::seconds FREEZE_TIMEOUT(5);
+const std::chrono::milliseconds FREEZE_POLL_INTERVAL(1);
+
+std::string
+readFirstLine(const std::string& path)
+{
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+std::string
+findCgroup2Mount()
+{
+    std::ifstream mounts("/proc/self/mounts");
+    std::string device, mount_point, type, rest;
+    while (mounts >> device >> mount_point >> type && std::getline(mounts, rest)) {
+        if (type == "cgroup2") {
+            return mount_point;
+        }
+    }
+    return "/sys/fs/cgroup";
+}
+
+// Returns the state letter from /proc/PID/task/TID/stat, or '\0' if the
+// thread is gone.
+char
+getThreadState(pid_t pid, int tid)
+{
+    std::string stat =
+            readFirstLine("/proc/" + std::to_string(pid) + "/task/" + std::to_string(tid) + "/stat");
+    // The command name can contain spaces and parentheses, so look for the
+    // state after the last closing parenthesis.
+    size_t pos = stat.rfind(')');
+    if (pos == std::string::npos || pos + 2 >= stat.size()) {
+        return '\0';
+    }
+    return stat[pos + 2];
+}
+
+bool
+allThreadsStopped(pid_t pid)
+{
+    for (int tid : getProcessTids(pid)) {
+        char state = getThreadState(pid, tid);
+        if (state != '\0' && state != 'T' && state != 't' && state != 'Z' && state != 'X') {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename Predicate>
+bool
+pollUntil(Predicate predicate)
+{
+    auto deadline = std::chrono::steady_clock::now() + FREEZE_TIMEOUT;
+    while (!predicate()) {
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(FREEZE_POLL_INTERVAL);
+    }
+    return true;
+}
+
+}  // namespace
+
+ProcessFreezer::ProcessFreezer(pid_t pid, StopMethod method)
+: d_pid(pid)
+, d_method(method)
+{
+    ScopedTimer timer("attach");
+    auto start = std::chrono::steady_clock::now();
+    d_stopped_at = start;
+    switch (method) {
+        case StopMethod::CGROUP:
+            freezeCgroup();
+            break;
+        case StopMethod::SIGNAL:
+            stopWithSignal();
+            break;
+        case StopMethod::PTRACE:
+            throw std::invalid_argument("ptrace can't be used to freeze a whole process");
+    }
+    LOG(INFO) << "Process " << pid << " stopped in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+              << "us";
+}
+
+ProcessFreezer::~ProcessFreezer()
+{
+    resume();
+}
+
+void
+ProcessFreezer::freezeCgroup()
+{
+    std::ifstream cgroups("/proc/" + std::to_string(d_pid) + "/cgroup");
+    std::string line;
+    std::string cgroup;
+    while (std::getline(cgroups, line)) {
+        // The unified (v2) hierarchy is the one with id 0 and no controllers.
+        if (line.rfind("0::", 0) == 0) {
+            cgroup = line.substr(3);
+        }
+    }
+    if (cgroup.empty()) {
+        throw std::runtime_error(
+                "Process " + std::to_string(d_pid) + " is not part of a cgroup v2 hierarchy");
+    }
+    d_cgroup_dir = findCgroup2Mount() + cgroup;
+
+    // Freezing affects every process in the cgroup, so refuse to do it unless
+    // the target is alone in it.
+    std::ifstream procs(d_cgroup_dir + "/cgroup.procs");
+    if (!procs) {
+        throw std::runtime_error("Could not read the processes of cgroup " + d_cgroup_dir);
+    }
+    pid_t member;
+    while (procs >> member) {
+        if (member != d_pid) {
+            throw std::runtime_error(
+                    "The cgroup " + d_cgroup_dir + " contains processes other than "
+                    + std::to_string(d_pid) + ", refusing to freeze it");
+        }
+    }
+
+    if (readFirstLine(d_cgroup_dir + "/cgroup.freeze") == "1") {
+        LOG(INFO) << "The cgroup " << d_cgroup_dir << " is already frozen";
+    } else {
+        LOG(INFO) << "Freezing cgroup " << d_cgroup_dir;
+        std::ofstream freeze(d_cgroup_dir + "/cgroup.freeze");
+        if (!(freeze << "1" << std::flush)) {
+            int error = errno;
+            if (error == EPERM || error == EACCES) {
+                throw std::runtime_error(PERM_MESSAGE);
+            }
+            throw std::runtime_error("Could not freeze the cgroup " + d_cgroup_dir);
+        }
+        d_needs_resume = true;
+    }
+
+    auto is_frozen = [&] {
+        std::ifstream events(d_cgroup_dir + "/cgroup.events");
+        std::string key;
+        std::string value;
+        while (events >> key >> value) {
+            if (key == "frozen") {
+                return value == "1";
+            }
+        }
+        return false;
+    };
+    if (!pollUntil(is_frozen)) {
+        resume();
+        throw std::runtime_error("Timed out waiting for the cgroup " + d_cgroup_dir + " to freeze");
+    }
+}
+
+void
+ProcessFreezer::stopWithSignal()
+{
+    if (allThreadsStopped(d_pid)) {
+        LOG(INFO) << "Process " << d_pid << " is already stopped";
+        return;
+    }
+
+    LOG(INFO) << "Sending SIGSTOP to process " << d_pid;
+    if (kill(d_pid, SIGSTOP) != 0) {
+        int error = errno;
+        if (error == EPERM) {
+            throw std::runtime_error(PERM_MESSAGE);
+        }
+        throw std::system_error(error, std::generic_category());
+    }
+    d_needs_resume = true;
+
+    if (!pollUntil([&] { return allThreadsStopped(d_pid); })) {
+        resume();
+        throw std::runtime_error(
+                "Timed out waiting for process " + std::to_string(d_pid) + " to stop");
+    }
+}
+
+void
+ProcessFreezer::resume()
+{
+    if (!d_needs_resume) {
+        return;
+    }
+    d_needs_resume = false;
+
+    if (d_method == StopMethod::CGROUP) {
+        LOG(INFO) << "Thawing cgroup " << d_cgroup_dir;
+        std::ofstream freeze(d_cgroup_dir + "/cgroup.freeze");
+        if (!(freeze << "0" << std::flush)) {
+            LOG(ERROR) << "Failed to thaw the cgroup " << d_cgroup_dir;
+        }
+    } else {
+        LOG(INFO) << "Sending SIGCONT to process " << d_pid;
+        if (kill(d_pid, SIGCONT) != 0) {
+            LOG(ERROR) << "Failed to resume process " << d_pid << ": " << strerror(errno);
+        }
+    }
+
+    if (TimingReport* report = TimingReport::current()) {
+        report->recordTargetStopped(std::chrono::steady_clock::now() - d_stopped_at);
+    }
+}
+
 AbstractProcessManager::AbstractProcessManager(
         pid_t pid,
         std::vector<VirtualMap>&& memory_maps,
+        std::unique_ptr<StringTable> strings,
         std::optional<VirtualMap> main_map,
         std::optional<VirtualMap> bss,
         std::optional<VirtualMap> heap)
@@ -236,7 +669,8 @@ AbstractProcessManager::AbstractProcessManager(
 , d_main_map(std::move(main_map))
 , d_bss(std::move(bss))
 , d_heap(std::move(heap))
-, d_memory_maps(std::move(memory_maps))
+, d_memory_maps(std::make_shared<const VirtualMaps>(std::move(memory_maps)))
+, d_strings(std::move(strings))
 , d_manager(nullptr)
 , d_unwinder(nullptr)
 , d_analyzer(nullptr)
@@ -249,7 +683,31 @@ AbstractProcessManager::AbstractProcessManager(
 const std::vector<VirtualMap>&
 AbstractProcessManager::MemoryMaps() const
 {
-    return d_memory_maps;
+    return *d_memory_maps;
+}
+
+const StringTable&
+AbstractProcessManager::Strings() const
+{
+    return *d_strings;
+}
+
+PthreadTidResolver&
+AbstractProcessManager::tidResolver() const
+{
+    if (!d_tid_resolver) {
+        d_tid_resolver = std::make_shared<PthreadTidResolver>();
+    }
+    return *d_tid_resolver;
+}
+
+CodeObjectCache&
+AbstractProcessManager::codeObjectCache() const
+{
+    if (!d_code_object_cache) {
+        d_code_object_cache = std::make_shared<CodeObjectCache>();
+    }
+    return *d_code_object_cache;
 }
 
 std::pair<int, int>
@@ -405,36 +863,41 @@ AbstractProcessManager::findInterpreterStateFromPyRuntime(remote_addr_t runtime_
 remote_addr_t
 AbstractProcessManager::scanMemoryAreaForInterpreterState(const VirtualMap& map) const
 {
-    void* result = nullptr;
-    size_t size = map.Size();
-    std::vector<char> memory_buffer(size);
-    remote_addr_t base = map.Start();
-    copyMemoryFromProcess(base, size, memory_buffer.data());
-
-    void* upper_bound = (void*)(memory_buffer.data() + size);
+    remote_addr_t result = 0;
 
     LOG(INFO) << std::showbase << std::hex
               << "Searching for PyInterpreterState in memory area spanning from " << map.Start()
               << " to " << map.End();
 
-    for (void** raddr = (void**)memory_buffer.data(); (void*)raddr < upper_bound; raddr++) {
-        if (!isValidInterpreterState((remote_addr_t)*raddr)) {
-            continue;
+    // The interpreter state is always in resident memory, so only the pages
+    // that are present in the target need to be scanned.
+    auto scanRun = [&](remote_addr_t base, const char* data, size_t size) {
+        size_t misalignment = (base - map.Start()) % sizeof(remote_addr_t);
+        size_t first = misalignment ? sizeof(remote_addr_t) - misalignment : 0;
+        for (size_t offset = first; offset + sizeof(remote_addr_t) <= size;
+             offset += sizeof(remote_addr_t))
+        {
+            remote_addr_t candidate;
+            std::memcpy(&candidate, data + offset, sizeof(candidate));
+            if (!isValidInterpreterState(candidate)) {
+                continue;
+            }
+            LOG(DEBUG) << std::hex << std::showbase
+                       << "Possible interpreter state referenced by memory segment " << base + offset
+                       << " (offset " << base + offset - map.Start() << ") -> addr " << candidate;
+            result = candidate;
+            return true;
         }
-        LOG(DEBUG) << std::hex << std::showbase
-                   << "Possible interpreter state referenced by memory segment "
-                   << reinterpret_cast<void*>((char*)raddr - (char*)memory_buffer.data() + (char*)base)
-                   << " (offset " << reinterpret_cast<void*>((char*)raddr - (char*)memory_buffer.data())
-                   << " ) -> addr " << static_cast<void*>((char*)raddr);
-        result = *raddr;
-        break;
-    }
-    if (result == nullptr) {
+        return false;
+    };
+    d_manager->visitResidentMemory(map.Start(), map.Size(), scanRun);
+
+    if (result == 0) {
         LOG(INFO) << std::showbase << std::hex
                   << "Could not find a valid PyInterpreterState in memory area spanning from "
                   << map.Start() << " to " << map.End();
     }
-    return (remote_addr_t)result;
+    return result;
 }
 
 remote_addr_t
@@ -463,7 +926,7 @@ AbstractProcessManager::scanMemoryAreaForDebugOffsets(const VirtualMap& map) con
                 auto offset = (remote_addr_t)raddr - (remote_addr_t)memory_buffer.data();
                 auto addr = offset + base;
                 LOG(DEBUG) << std::hex << std::showbase << "Possible debug offsets found at address "
-                           << addr << " in a mapping of " << map.Path();
+                           << addr << " in a mapping of " << map.Path(*d_strings);
                 return addr;
             }
         }
@@ -486,8 +949,8 @@ remote_addr_t
 AbstractProcessManager::scanAllAnonymousMaps() const
 {
     LOG(INFO) << "Scanning all anonymous maps for PyInterpreterState";
-    for (auto& map : d_memory_maps) {
-        if (!map.Path().empty()) {
+    for (auto& map : *d_memory_maps) {
+        if (map.hasPath()) {
             continue;
         }
         LOG(DEBUG) << std::hex << std::showbase
@@ -515,10 +978,10 @@ remote_addr_t
 AbstractProcessManager::findDebugOffsetsFromMaps() const
 {
     LOG(INFO) << "Scanning all writable path-backed maps for _Py_DebugOffsets";
-    for (auto& map : d_memory_maps) {
-        if (map.Flags().find("w") != std::string::npos && !map.Path().empty()) {
+    for (auto& map : *d_memory_maps) {
+        if (map.isWritable() && map.hasPath()) {
             LOG(DEBUG) << std::hex << std::showbase << "Attempting to locate _Py_DebugOffsets in map of "
-                       << map.Path() << " starting at " << map.Start() << " and ending at " << map.End();
+                       << map.Path(*d_strings) << " starting at " << map.Start() << " and ending at " << map.End();
             LOG(DEBUG) << "Flags: " << map.Flags();
             try {
                 if (remote_addr_t result = scanMemoryAreaForDebugOffsets(map)) {
@@ -541,7 +1004,7 @@ AbstractProcessManager::copyMemoryFromProcess(remote_addr_t addr, size_t size, v
 bool
 AbstractProcessManager::isAddressValid(remote_addr_t addr) const
 {
-    return std::any_of(d_memory_maps.cbegin(), d_memory_maps.cend(), [&](const VirtualMap& map) {
+    return std::any_of(d_memory_maps->cbegin(), d_memory_maps->cend(), [&](const VirtualMap& map) {
         return d_manager->isAddressValid(addr, map);
     });
 }
@@ -633,12 +1096,100 @@ remote_addr_t
 AbstractProcessManager::findSymbol(const std::string& symbol) const
 {
     const auto elem = d_symbol_cache.find(symbol);
-    if (elem == d_symbol_cache.cend()) {
-        remote_addr_t addr = d_unwinder->getAddressforSymbol(symbol, d_main_map.value().Path());
-        d_symbol_cache.emplace(symbol, addr);
-        return addr;
+    if (elem != d_symbol_cache.cend()) {
+        return elem->second;
+    }
+
+    // Resolve every symbol we may need in a single pass over the symbol
+    // tables instead of searching them again for each one.
+    std::vector<std::string> symbols(std::begin(PREFETCHED_SYMBOLS), std::end(PREFETCHED_SYMBOLS));
+    if (std::find(symbols.begin(), symbols.end(), symbol) == symbols.end()) {
+        symbols.push_back(symbol);
+    }
+    symbols.erase(
+            std::remove_if(
+                    symbols.begin(),
+                    symbols.end(),
+                    [&](const std::string& name) { return d_symbol_cache.count(name) != 0; }),
+            symbols.end());
+
+    const std::string& build_id = mainMapBuildId();
+    const remote_addr_t load_point = findLoadPointOfMainMap();
+    if (!build_id.empty()) {
+        std::lock_guard<std::mutex> lock(g_symbol_offsets_mutex);
+        auto known = g_symbol_offsets_by_build_id.find(build_id);
+        if (known != g_symbol_offsets_by_build_id.end()) {
+            auto is_known = [&](const std::string& name) {
+                auto offset = known->second.find(name);
+                if (offset == known->second.end()) {
+                    return false;
+                }
+                remote_addr_t addr = offset->second ? load_point + *offset->second : 0;
+                LOG(DEBUG) << "Symbol '" << name << "' resolved to " << std::hex << std::showbase
+                           << addr << " using the symbols of build id " << build_id;
+                d_symbol_cache.emplace(name, addr);
+                return true;
+            };
+            symbols.erase(std::remove_if(symbols.begin(), symbols.end(), is_known), symbols.end());
+        }
+    }
+
+    if (!symbols.empty()) {
+        auto addresses = unwinder().getAddressesForSymbols(symbols, d_main_map.value().Path(*d_strings));
+        std::unique_lock<std::mutex> lock(g_symbol_offsets_mutex, std::defer_lock);
+        if (!build_id.empty()) {
+            lock.lock();
+        }
+        for (auto& [name, addr] : addresses) {
+            d_symbol_cache.emplace(name, addr);
+            if (!build_id.empty()) {
+                g_symbol_offsets_by_build_id[build_id][name] =
+                        addr ? std::make_optional(addr - load_point) : std::nullopt;
+            }
+        }
     }
-    return elem->second;
+    return d_symbol_cache.at(symbol);
+}
+
+const std::string&
+AbstractProcessManager::mainMapBuildId() const
+{
+    if (!d_main_map_build_id) {
+        d_main_map_build_id = getBuildId(d_main_map.value().Path(*d_strings));
+    }
+    return *d_main_map_build_id;
+}
+
+remote_addr_t
+AbstractProcessManager::findPyRuntime() const
+{
+    // _Py_DebugOffsets live at the start of _PyRuntime, so when we found them
+    // there is no need to look up the symbol.
+    if (d_debug_offsets_addr) {
+        return d_debug_offsets_addr;
+    }
+    return findSymbol("_PyRuntime");
+}
+
+const AbstractUnwinder&
+AbstractProcessManager::unwinder() const
+{
+    if (!d_unwinder) {
+        createUnwinder();
+        d_unwinder->setSymbolsOnly(d_native_symbols_only);
+    }
+    return *d_unwinder;
+}
+
+void
+AbstractProcessManager::createUnwinder() const
+{
+    throw std::runtime_error("No unwinder is available for this process");
+}
+
+void
+AbstractProcessManager::prepareForUnwinding() const
+{
 }
 
 remote_addr_t
@@ -659,10 +1210,40 @@ AbstractProcessManager::findInterpreterStateFromSymbols() const
     return 0;
 }
 
+void
+AbstractProcessManager::setNativeSymbolsOnly(bool symbols_only)
+{
+    d_native_symbols_only = symbols_only;
+    if (d_unwinder) {
+        d_unwinder->setSymbolsOnly(symbols_only);
+    }
+}
+
 std::vector<NativeFrame>
 AbstractProcessManager::unwindThread(pid_t tid) const
 {
-    return d_unwinder->unwindThread(tid);
+    ScopedTimer timer("native_unwind");
+    if (Deadline::expired()) {
+        LOG(DEBUG) << "Deadline passed, not unwinding thread " << tid;
+        Deadline::recordTruncatedThread(tid);
+        return {};
+    }
+    prepareForUnwinding();
+    return unwinder().unwindThread(tid);
+}
+
+std::unordered_map<pid_t, std::vector<NativeFrame>>
+AbstractProcessManager::unwindThreads(const std::vector<pid_t>& tids) const
+{
+    ScopedTimer timer("native_unwind");
+    // Threads left out of the result are reported as incomplete, and the
+    // unwinder isn't even set up.
+    if (Deadline::expired()) {
+        LOG(DEBUG) << "Deadline passed, not unwinding any thread";
+        return {};
+    }
+    prepareForUnwinding();
+    return unwinder().unwindThreads(tids);
 }
 
 pid_t
@@ -699,7 +1280,7 @@ AbstractProcessManager::getCStringFromAddress(remote_addr_t addr) const
 AbstractProcessManager::InterpreterStatus
 AbstractProcessManager::isInterpreterActive() const
 {
-    remote_addr_t runtime_addr = findSymbol("_PyRuntime");
+    remote_addr_t runtime_addr = findPyRuntime();
     if (runtime_addr) {
         Structure<py_runtime_v> py_runtime(shared_from_this(), runtime_addr);
         remote_addr_t p = py_runtime.getField(&py_runtime_v::o_finalizing);
@@ -712,9 +1293,11 @@ AbstractProcessManager::isInterpreterActive() const
 void
 AbstractProcessManager::setPythonVersionFromDebugOffsets()
 {
-    remote_addr_t pyruntime_addr = findSymbol("_PyRuntime");
+    // Try the ELF data first, as resolving symbols needs the (expensive)
+    // ELF/DWARF analysis of the whole process.
+    remote_addr_t pyruntime_addr = findPyRuntimeFromElfData();
     if (!pyruntime_addr) {
-        pyruntime_addr = findPyRuntimeFromElfData();
+        pyruntime_addr = findSymbol("_PyRuntime");
     }
     if (!pyruntime_addr) {
         pyruntime_addr = findDebugOffsetsFromMaps();
@@ -1338,17 +1921,34 @@ AbstractProcessManager::offsets() const
     return *d_py_v;
 }
 
+remote_addr_t
+AbstractProcessManager::findLoadPointOfMainMap() const
+{
+    // This matches the module start reported by libdwfl: the lowest address
+    // at which the file is mapped.
+    const std::string& path = d_main_map.value().Path(*d_strings);
+    remote_addr_t load_point = 0;
+    for (const auto& map : *d_memory_maps) {
+        if (map.Path(*d_strings) == path && (!load_point || map.Start() < load_point)) {
+            load_point = map.Start();
+        }
+    }
+    LOG(DEBUG) << "Load point of module " << path << " found at " << std::hex << std::showbase
+               << load_point;
+    return load_point;
+}
+
 remote_addr_t
 AbstractProcessManager::findPyRuntimeFromElfData() const
 {
     LOG(INFO) << "Trying to resolve PyInterpreterState from Elf data";
     SectionInfo section_info;
-    if (!getSectionInfo(d_main_map.value().Path(), ".PyRuntime", &section_info)) {
+    if (!getSectionInfo(d_main_map.value().Path(*d_strings), ".PyRuntime", &section_info)) {
         LOG(INFO) << "Failed to resolve PyInterpreterState from Elf data because .PyRuntime section "
                      "could not be found";
         return 0;
     }
-    remote_addr_t load_addr = getLoadPointOfModule(d_analyzer->getDwfl(), d_main_map.value().Path());
+    remote_addr_t load_addr = findLoadPointOfMainMap();
     if (load_addr == 0) {
         LOG(INFO) << "Failed to resolve PyInterpreterState from Elf data because module load point "
                      "could not be found";
@@ -1398,25 +1998,36 @@ AbstractProcessManager::findInterpreterStateFromDebugOffsets() const
 }
 
 std::shared_ptr<ProcessManager>
-ProcessManager::create(pid_t pid, bool stop_process)
+ProcessManager::create(pid_t pid, bool stop_process, bool use_frame_pointers, StopMethod stop_method)
 {
     std::shared_ptr<ProcessTracer> tracer;
-    if (stop_process) {
+    std::shared_ptr<ProcessFreezer> freezer;
+    if (stop_process && stop_method == StopMethod::PTRACE) {
         tracer = std::make_shared<ProcessTracer>(pid);
+    } else if (stop_process) {
+        freezer = std::make_shared<ProcessFreezer>(pid, stop_method);
     }
 
-    auto virtual_maps = parseProcMaps(pid);
-    auto map_info = parseMapInformationForProcess(pid, virtual_maps);
-    auto analyzer = std::make_shared<ProcessAnalyzer>(pid);
+    auto strings = std::make_unique<StringTable>();
+    std::vector<VirtualMap> virtual_maps;
+    ProcessMemoryMapInfo map_info;
+    {
+        ScopedTimer timer("maps_parsing");
+        virtual_maps = parseProcMaps(pid, *strings);
+        map_info = parseMapInformationForProcess(pid, virtual_maps, *strings);
+    }
 
     auto manager = std::make_shared<ProcessManager>(
             pid,
             tracer,
-            analyzer,
+            freezer,
             std::move(virtual_maps),
+            std::move(strings),
             getMainMap(map_info),
             map_info.bss,
-            map_info.heap);
+            map_info.heap,
+            use_frame_pointers,
+            stop_method);
 
     manager->initializeVersion(pid, map_info);
     return manager;
@@ -1425,18 +2036,25 @@ ProcessManager::create(pid_t pid, bool stop_process)
 ProcessManager::ProcessManager(
         pid_t pid,
         const std::shared_ptr<ProcessTracer>& tracer,
-        const std::shared_ptr<ProcessAnalyzer>& analyzer,
+        const std::shared_ptr<ProcessFreezer>& freezer,
         std::vector<VirtualMap> memory_maps,
+        std::unique_ptr<StringTable> strings,
         std::optional<VirtualMap> main_map,
         std::optional<VirtualMap> bss,
-        std::optional<VirtualMap> heap)
+        std::optional<VirtualMap> heap,
+        bool use_frame_pointers,
+        StopMethod stop_method)
 : AbstractProcessManager(
           pid,
           std::move(memory_maps),
+          std::move(strings),
           std::move(main_map),
           std::move(bss),
           std::move(heap))
+, d_freezer(freezer)
 , d_tracer(tracer)
+, d_use_frame_pointers(use_frame_pointers)
+, d_stop_method(stop_method)
 {
     if (d_tracer) {
         d_tids = d_tracer->getTids();
@@ -1444,20 +2062,61 @@ ProcessManager::ProcessManager(
         d_tids = getProcessTids(pid);
     }
     d_manager = std::make_unique<ProcessMemoryManager>(pid, d_memory_maps);
+}
+
+void
+ProcessManager::createUnwinder() const
+{
+    // Reporting every module of the process to libdwfl is expensive, so it is
+    // only done once symbols or native stacks are actually needed. When the
+    // interpreter exposes _Py_DebugOffsets, Python stacks never need it.
+    LOG(INFO) << "Loading ELF and DWARF information for process " << d_pid;
+    ScopedTimer timer("dwfl_setup");
+    auto analyzer = std::make_shared<ProcessAnalyzer>(d_pid);
     d_analyzer = analyzer;
-    d_unwinder = std::make_unique<Unwinder>(analyzer);
+    if (d_use_frame_pointers) {
+        d_unwinder = std::make_unique<FramePointerUnwinder>(
+                analyzer,
+                d_manager.get(),
+                d_memory_maps,
+                d_tids);
+    } else {
+        d_unwinder = std::make_unique<Unwinder>(analyzer, d_manager.get(), d_memory_maps, d_tids);
+    }
+}
+
+void
+ProcessManager::prepareForUnwinding() const
+{
+    // A frozen process can be read without ptrace, but the registers of its
+    // threads can't. Attaching doesn't let the threads run: ptrace stops
+    // take precedence over both the cgroup freezer and SIGSTOP.
+    if (d_freezer && !d_tracer) {
+        LOG(INFO) << "Attaching to the threads of the stopped process to read their registers";
+        d_tracer = std::make_shared<ProcessTracer>(d_pid);
+    }
+
+    // Nothing keeps the threads of a running process still, so each one is
+    // only stopped for as long as it takes to copy its registers and stack.
+    bool running = !d_tracer;
+    unwinder();
+    auto live_unwinder = dynamic_cast<Unwinder*>(d_unwinder.get());
+    if (live_unwinder && !live_unwinder->setStopThreadsIndividually(running)) {
+        LOG(WARNING) << "Native stacks of running processes are not supported on this platform";
+    }
 }
 
 void
 ProcessManager::initializeVersion(pid_t pid, const ProcessMemoryMapInfo& map_info)
 {
+    ScopedTimer timer("version_detection");
     // Try to get version from debug offsets first
     setPythonVersionFromDebugOffsets();
     auto python_version = findPythonVersion();
 
     // Fallback to external version detection if needed
     if (python_version.first == -1 && python_version.second == -1) {
-        python_version = getVersionForProcess(pid, map_info, d_manager.get());
+        python_version = getVersionForProcess(pid, map_info, *d_strings, d_manager.get());
     }
 
     setPythonVersion(python_version);
@@ -1475,6 +2134,77 @@ ProcessManager::Tids() const
     return d_tids;
 }
 
+void
+ProcessManager::resumeProcess()
+{
+    d_tracer.reset();
+    d_freezer.reset();
+}
+
+void
+ProcessManager::stopProcess()
+{
+    if (d_tracer || d_freezer) {
+        return;
+    }
+    if (d_stop_method == StopMethod::PTRACE) {
+        d_tracer = std::make_shared<ProcessTracer>(d_pid);
+    } else {
+        d_freezer = std::make_shared<ProcessFreezer>(d_pid, d_stop_method);
+    }
+    refresh();
+}
+
+static bool
+executableMapsDiffer(const VirtualMaps& lhs, const VirtualMaps& rhs)
+{
+    auto is_executable_file = [](const VirtualMap& map) { return map.hasPath() && map.isExecutable(); };
+    auto lhs_it = std::find_if(lhs.begin(), lhs.end(), is_executable_file);
+    auto rhs_it = std::find_if(rhs.begin(), rhs.end(), is_executable_file);
+    while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+        // Both lists are interned in the same table, so comparing indices is enough.
+        if (lhs_it->Start() != rhs_it->Start() || lhs_it->End() != rhs_it->End()
+            || lhs_it->PathIndex() != rhs_it->PathIndex())
+        {
+            return true;
+        }
+        lhs_it = std::find_if(std::next(lhs_it), lhs.end(), is_executable_file);
+        rhs_it = std::find_if(std::next(rhs_it), rhs.end(), is_executable_file);
+    }
+    return lhs_it != lhs.end() || rhs_it != rhs.end();
+}
+
+void
+ProcessManager::refresh()
+{
+    ScopedTimer timer("maps_parsing");
+    if (d_tracer) {
+        d_tids = d_tracer->getTids();
+    } else {
+        d_tids = getProcessTids(d_pid);
+    }
+
+    auto virtual_maps = parseProcMaps(d_pid, *d_strings);
+    if (virtual_maps != *d_memory_maps) {
+        if (executableMapsDiffer(virtual_maps, *d_memory_maps)) {
+            // libdwfl can't forget modules, and both the unwinder's caches
+            // and the symbols found so far are only valid for the modules
+            // that were reported to it: start from scratch.
+            LOG(INFO) << "Shared libraries of process " << d_pid
+                      << " changed, reloading ELF and DWARF information";
+            d_unwinder.reset();
+            d_analyzer.reset();
+            d_symbol_cache.clear();
+        }
+        d_memory_maps = std::make_shared<const VirtualMaps>(std::move(virtual_maps));
+    }
+
+    static_cast<ProcessMemoryManager&>(*d_manager).refresh(d_memory_maps);
+    if (auto unwinder = dynamic_cast<Unwinder*>(d_unwinder.get())) {
+        unwinder->refresh(d_memory_maps, d_tids);
+    }
+}
+
 std::pair<int, int>
 AbstractProcessManager::pythonVersion() const
 {
@@ -1488,31 +2218,42 @@ CoreFileProcessManager::create(
         const std::optional<std::string>& lib_search_path)
 {
     std::shared_ptr<CoreFileAnalyzer> analyzer;
-    if (lib_search_path) {
-        analyzer = std::make_shared<CoreFileAnalyzer>(core_file, executable, *lib_search_path);
-    } else {
-        analyzer = std::make_shared<CoreFileAnalyzer>(core_file, executable);
+    {
+        ScopedTimer timer("dwfl_setup");
+        if (lib_search_path) {
+            analyzer = std::make_shared<CoreFileAnalyzer>(core_file, executable, *lib_search_path);
+        } else {
+            analyzer = std::make_shared<CoreFileAnalyzer>(core_file, executable);
+        }
     }
 
-    auto extractor = std::make_unique<CoreFileExtractor>(analyzer);
+    auto strings = std::make_unique<StringTable>();
+    std::vector<VirtualMap> virtual_maps;
+    ProcessMemoryMapInfo map_info;
+    pid_t pid;
+    {
+        ScopedTimer timer("maps_parsing");
+        auto extractor = std::make_unique<CoreFileExtractor>(analyzer);
 
-    auto mapped_files = extractor->extractMappedFiles();
-    auto memory_maps = extractor->MemoryMaps();
+        auto mapped_files = extractor->extractMappedFiles();
+        auto memory_maps = extractor->MemoryMaps();
 
-    std::unordered_map<std::string, uintptr_t> load_point_by_module;
-    for (const auto& mod : extractor->ModuleInformation()) {
-        auto name = fs::path(mod.filename).filename().string();
-        load_point_by_module[name] = mod.start;
-    }
+        std::unordered_map<std::string, uintptr_t> load_point_by_module;
+        for (const auto& mod : extractor->ModuleInformation()) {
+            auto name = fs::path(mod.filename).filename().string();
+            load_point_by_module[name] = mod.start;
+        }
 
-    auto virtual_maps = parseCoreFileMaps(mapped_files, memory_maps);
-    pid_t pid = extractor->Pid();
-    auto map_info = parseMapInformation(executable, virtual_maps, &load_point_by_module);
+        virtual_maps = parseCoreFileMaps(mapped_files, memory_maps, *strings);
+        pid = extractor->Pid();
+        map_info = parseMapInformation(executable, virtual_maps, *strings, &load_point_by_module);
+    }
 
     auto manager = std::make_shared<CoreFileProcessManager>(
             pid,
             analyzer,
             std::move(virtual_maps),
+            std::move(strings),
             getMainMap(map_info),
             map_info.bss,
             map_info.heap);
@@ -1525,12 +2266,14 @@ CoreFileProcessManager::CoreFileProcessManager(
         pid_t pid,
         const std::shared_ptr<CoreFileAnalyzer>& analyzer,
         std::vector<VirtualMap> memory_maps,
+        std::unique_ptr<StringTable> strings,
         std::optional<VirtualMap> main_map,
         std::optional<VirtualMap> bss,
         std::optional<VirtualMap> heap)
 : AbstractProcessManager(
           pid,
           std::move(memory_maps),
+          std::move(strings),
           std::move(main_map),
           std::move(bss),
           std::move(heap))
@@ -1547,13 +2290,14 @@ CoreFileProcessManager::initializeVersion(
         const std::string& core_file,
         const ProcessMemoryMapInfo& map_info)
 {
+    ScopedTimer timer("version_detection");
     // Try to get version from debug offsets first
     setPythonVersionFromDebugOffsets();
     auto python_version = findPythonVersion();
 
     // Fallback to external version detection if needed
     if (python_version.first == -1 && python_version.second == -1) {
-        python_version = getVersionForCore(core_file, map_info);
+        python_version = getVersionForCore(core_file, map_info, *d_strings);
     }
 
     setPythonVersion(python_version);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <optional>
 #include <stdexcept>
@@ -22,6 +23,9 @@ namespace pystack {
 template<typename OffsetsStruct>
 class Structure;
 
+class CodeObjectCache;
+class PthreadTidResolver;
+
 struct InvalidRemoteObject : public InvalidCopiedMemory
 {
     const char* what() const noexcept override
@@ -30,11 +34,33 @@ struct InvalidRemoteObject : public InvalidCopiedMemory
     }
 };
 
+// How the threads of a live process are kept still while it is inspected.
+enum class StopMethod {
+    // Attach to and stop every thread with ptrace.
+    PTRACE = 0,
+    // Freeze the cgroup v2 the process runs in. The cgroup must not contain
+    // any other process.
+    CGROUP = 1,
+    // Stop the whole process with SIGSTOP and resume it with SIGCONT.
+    SIGNAL = 2,
+};
+
 class ProcessTracer
 {
   public:
+    // Enums
+    enum class AttachStrategy {
+        // PTRACE_ATTACH each thread and wait for it to stop before moving on
+        // to the next one.
+        SEQUENTIAL,
+        // PTRACE_SEIZE every thread, stop all of them with a burst of
+        // PTRACE_INTERRUPT and only then wait for the stops. Falls back to
+        // SEQUENTIAL on kernels without PTRACE_SEIZE.
+        BURST,
+    };
+
     // Constructors
-    ProcessTracer(pid_t pid);
+    explicit ProcessTracer(pid_t pid, AttachStrategy strategy = AttachStrategy::BURST);
     ProcessTracer(const ProcessTracer&) = delete;
     ProcessTracer& operator=(const ProcessTracer&) = delete;
 
@@ -43,15 +69,55 @@ class ProcessTracer
 
     // Methods
     std::vector<int> getTids() const;
+    // Time between asking the first thread to stop and seeing the last one
+    // stopped: the window in which the threads' states can be inconsistent.
+    std::chrono::nanoseconds stopSkew() const;
 
   private:
     // Data members
     std::unordered_set<int> d_tids;
+    std::unordered_map<int, int> d_pending_signals;
+    std::chrono::nanoseconds d_stop_skew{0};
+    std::optional<std::chrono::steady_clock::time_point> d_stopped_at;
 
     // Methods
+    void attachSequentially(pid_t pid);
+    bool attachInBurst(pid_t pid);
+    int waitForInterruptStop(int tid);
+    [[noreturn]] void throwAttachError(int error);
+    void detachFromThread(int tid);
     void detachFromProcess();
 };
 
+// Stops a whole process at once without ptrace, and resumes it when
+// destroyed. Memory can be read with process_vm_readv while the process is
+// stopped, but reading the registers of its threads still needs a
+// ProcessTracer.
+class ProcessFreezer
+{
+  public:
+    // Constructors
+    ProcessFreezer(pid_t pid, StopMethod method);
+    ProcessFreezer(const ProcessFreezer&) = delete;
+    ProcessFreezer& operator=(const ProcessFreezer&) = delete;
+
+    // Destructors
+    ~ProcessFreezer();
+
+  private:
+    // Data members
+    pid_t d_pid;
+    StopMethod d_method;
+    std::string d_cgroup_dir;
+    bool d_needs_resume{false};
+    std::chrono::steady_clock::time_point d_stopped_at;
+
+    // Methods
+    void freezeCgroup();
+    void stopWithSignal();
+    void resume();
+};
+
 class AbstractProcessManager : public std::enable_shared_from_this<AbstractProcessManager>
 {
   public:
@@ -62,6 +128,7 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     AbstractProcessManager(
             pid_t pid,
             std::vector<VirtualMap>&& memory_maps,
+            std::unique_ptr<StringTable> strings,
             std::optional<VirtualMap> main_map,
             std::optional<VirtualMap> bss,
             std::optional<VirtualMap> heap);
@@ -70,12 +137,16 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     pid_t Pid() const;
     virtual const std::vector<int>& Tids() const = 0;
     const std::vector<VirtualMap>& MemoryMaps() const;
+    const StringTable& Strings() const;
     std::pair<int, int> Version() const;
     remote_addr_t getAddressFromCache(const std::string& symbol) const;
     void registerAddressInCache(const std::string& symbol, remote_addr_t address) const;
 
     // Methods
     std::vector<NativeFrame> unwindThread(pid_t tid) const;
+    std::unordered_map<pid_t, std::vector<NativeFrame>>
+    unwindThreads(const std::vector<pid_t>& tids) const;
+    void setNativeSymbolsOnly(bool symbols_only);
     bool isAddressValid(remote_addr_t addr) const;
     remote_addr_t findInterpreterStateFromPointer(remote_addr_t pointer) const;
     remote_addr_t findInterpreterStateFromPyRuntime(remote_addr_t runtime_addr) const;
@@ -83,6 +154,7 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     remote_addr_t findInterpreterStateFromElfData() const;
     remote_addr_t findInterpreterStateFromDebugOffsets() const;
     remote_addr_t findSymbol(const std::string& symbol) const;
+    remote_addr_t findPyRuntime() const;
     ssize_t copyMemoryFromProcess(remote_addr_t addr, size_t size, void* destination) const;
     template<typename T>
     ssize_t copyObjectFromProcess(remote_addr_t addr, T* destination) const;
@@ -94,6 +166,8 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     remote_addr_t scanHeap() const;
     InterpreterStatus isInterpreterActive() const;
     std::pair<int, int> findPythonVersion() const;
+    PthreadTidResolver& tidResolver() const;
+    CodeObjectCache& codeObjectCache() const;
 
     void setPythonVersionFromDebugOffsets();
     void setPythonVersion(const std::pair<int, int>& version);
@@ -101,6 +175,7 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     std::pair<int, int> pythonVersion() const;
     bool isFreeThreaded() const;
     const python_v& offsets() const;
+    bool isValidInterpreterState(remote_addr_t addr) const;
 
   protected:
     // Data members
@@ -108,11 +183,16 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     std::optional<VirtualMap> d_main_map{std::nullopt};
     std::optional<VirtualMap> d_bss{std::nullopt};
     std::optional<VirtualMap> d_heap{std::nullopt};
-    std::vector<VirtualMap> d_memory_maps;
+    SharedVirtualMaps d_memory_maps;
+    // The paths and devices of the memory maps are interned in this table.
+    // Maps parsed again are interned in it too, so that their indices can
+    // be compared with those of the current ones.
+    std::unique_ptr<StringTable> d_strings;
     std::unique_ptr<AbstractRemoteMemoryManager> d_manager;
-    std::unique_ptr<AbstractUnwinder> d_unwinder;
+    mutable std::unique_ptr<AbstractUnwinder> d_unwinder;
+    bool d_native_symbols_only{false};
     mutable std::unordered_map<std::string, remote_addr_t> d_symbol_cache;
-    std::shared_ptr<Analyzer> d_analyzer;
+    mutable std::shared_ptr<Analyzer> d_analyzer;
     int d_major{};
     int d_minor{};
     const python_v* d_py_v{};
@@ -120,13 +200,22 @@ class AbstractProcessManager : public std::enable_shared_from_this<AbstractProce
     remote_addr_t d_debug_offsets_addr{};
     std::unique_ptr<python_v> d_debug_offsets{};
     mutable std::unordered_map<std::string, remote_addr_t> d_type_cache;
+    mutable std::shared_ptr<PthreadTidResolver> d_tid_resolver;
+    mutable std::shared_ptr<CodeObjectCache> d_code_object_cache;
+    mutable std::optional<std::string> d_main_map_build_id;
 
     // Methods
-    bool isValidInterpreterState(remote_addr_t addr) const;
     bool isValidDictionaryObject(remote_addr_t addr) const;
+    const AbstractUnwinder& unwinder() const;
+    // Creates d_analyzer and d_unwinder for managers that build them lazily.
+    virtual void createUnwinder() const;
+    // Called before any thread is unwound.
+    virtual void prepareForUnwinding() const;
 
   private:
     void warnIfOffsetsAreMismatched(remote_addr_t addr) const;
+    remote_addr_t findLoadPointOfMainMap() const;
+    const std::string& mainMapBuildId() const;
     remote_addr_t findPyRuntimeFromElfData() const;
     remote_addr_t findDebugOffsetsFromMaps() const;
 
@@ -149,17 +238,24 @@ class ProcessManager : public AbstractProcessManager
 {
   public:
     // Factory method
-    static std::shared_ptr<ProcessManager> create(pid_t pid, bool stop_process = true);
+    static std::shared_ptr<ProcessManager> create(
+            pid_t pid,
+            bool stop_process = true,
+            bool use_frame_pointers = false,
+            StopMethod stop_method = StopMethod::PTRACE);
 
     // Constructors
     ProcessManager(
             pid_t pid,
             const std::shared_ptr<ProcessTracer>& tracer,
-            const std::shared_ptr<ProcessAnalyzer>& analyzer,
+            const std::shared_ptr<ProcessFreezer>& freezer,
             std::vector<VirtualMap> memory_maps,
+            std::unique_ptr<StringTable> strings,
             std::optional<VirtualMap> main_map,
             std::optional<VirtualMap> bss,
-            std::optional<VirtualMap> heap);
+            std::optional<VirtualMap> heap,
+            bool use_frame_pointers = false,
+            StopMethod stop_method = StopMethod::PTRACE);
 
     // Destructors
     virtual ~ProcessManager() = default;
@@ -167,13 +263,35 @@ class ProcessManager : public AbstractProcessManager
     // Getters
     const std::vector<int>& Tids() const override;
 
+    // Methods
+
+    // Lets a process that was stopped when the manager was created run
+    // again. Everything learnt about it is kept, so that it can be cheaply
+    // inspected again after stopProcess() or refresh().
+    void resumeProcess();
+    // Stops the process again with the method it was first stopped with,
+    // and refreshes the manager.
+    void stopProcess();
+    // Forgets everything that may have changed since the process was last
+    // inspected: the cached memory, the threads and, if they changed, the
+    // memory maps. ELF and DWARF information is only reloaded if shared
+    // libraries were loaded or unloaded.
+    void refresh();
+
   private:
     // Data members
-    std::shared_ptr<ProcessTracer> d_tracer;
+    // The freezer must outlive the tracer: threads are detached from before
+    // the process is resumed.
+    std::shared_ptr<ProcessFreezer> d_freezer;
+    mutable std::shared_ptr<ProcessTracer> d_tracer;
     std::vector<int> d_tids;
+    bool d_use_frame_pointers;
+    StopMethod d_stop_method;
 
     // Methods
     void initializeVersion(pid_t pid, const ProcessMemoryMapInfo& map_info);
+    void createUnwinder() const override;
+    void prepareForUnwinding() const override;
 };
 
 class CoreFileProcessManager : public AbstractProcessManager
@@ -190,6 +308,7 @@ class CoreFileProcessManager : public AbstractProcessManager
             pid_t pid,
             const std::shared_ptr<CoreFileAnalyzer>& analyzer,
             std::vector<VirtualMap> memory_maps,
+            std::unique_ptr<StringTable> strings,
             std::optional<VirtualMap> main_map,
             std::optional<VirtualMap> bss,
             std::optional<VirtualMap> heap);
@@ -101,18 +101,49 @@ parse_linetable(const uintptr_t addrq, const std::string& linetable, int firstli
     return false;
 }
 
+// Beyond this many entries the cache is emptied, so that sampling a process
+// that keeps creating code objects doesn't grow it without bound.
+static const size_t MAX_CACHED_CODE_OBJECTS = 1 << 16;
+
+const CodeObjectCache::Entry*
+CodeObjectCache::find(remote_addr_t addr, const Entry& key) const
+{
+    auto it = d_entries.find(addr);
+    if (it == d_entries.end()) {
+        return nullptr;
+    }
+    // A code object created where a freed one was can get the same interned
+    // filename and name, and even its line table where the old one was, so
+    // the line table is compared by content.
+    const Entry& entry = it->second;
+    if (entry.filename_addr != key.filename_addr || entry.name_addr != key.name_addr
+        || entry.varnames_addr != key.varnames_addr || entry.lnotab_addr != key.lnotab_addr
+        || entry.firstlineno != key.firstlineno || entry.lnotab != key.lnotab)
+    {
+        return nullptr;
+    }
+    return &entry;
+}
+
+const CodeObjectCache::Entry&
+CodeObjectCache::store(remote_addr_t addr, Entry entry)
+{
+    if (d_entries.size() >= MAX_CACHED_CODE_OBJECTS) {
+        d_entries.clear();
+    }
+    return d_entries.insert_or_assign(addr, std::move(entry)).first->second;
+}
+
 static LocationInfo
 getLocationInfo(
         const std::shared_ptr<const AbstractProcessManager>& manager,
         remote_addr_t code_addr,
         Structure<py_code_v>& code,
+        const std::string& lnotab,
         uintptr_t last_instruction_index,
         int tlbc_index)
 {
     int code_lineno = code.getField(&py_code_v::o_firstlineno);
-    remote_addr_t lnotab_addr = code.getField(&py_code_v::o_lnotab);
-    LOG(DEBUG) << std::hex << std::showbase << "Copying lnotab data from address " << lnotab_addr;
-    std::string lnotab = manager->getBytesFromAddress(lnotab_addr);
 
     assert(manager->versionIsAtLeast(3, 11) || lnotab.size() % 2 == 0);
     std::string::size_type last_executed_instruction = last_instruction_index;
@@ -197,34 +228,59 @@ CodeObject::CodeObject(
     LOG(DEBUG) << std::hex << std::showbase << "Copying code struct from address " << addr;
     Structure<py_code_v> code(manager, addr);
 
-    remote_addr_t filename_addr = code.getField(&py_code_v::o_filename);
-    LOG(DEBUG) << std::hex << std::showbase << "Copying filename Python string from address "
-               << filename_addr;
-    d_filename = manager->getStringFromAddress(filename_addr);
-    LOG(DEBUG) << "Code object filename: " << d_filename;
+    CodeObjectCache::Entry entry;
+    entry.filename_addr = code.getField(&py_code_v::o_filename);
+    entry.name_addr = code.getField(&py_code_v::o_name);
+    entry.varnames_addr = code.getField(&py_code_v::o_varnames);
+    entry.lnotab_addr = code.getField(&py_code_v::o_lnotab);
+    entry.firstlineno = code.getField(&py_code_v::o_firstlineno);
+    LOG(DEBUG) << std::hex << std::showbase << "Copying lnotab data from address "
+               << entry.lnotab_addr;
+    entry.lnotab = manager->getBytesFromAddress(entry.lnotab_addr);
 
-    remote_addr_t name_addr = code.getField(&py_code_v::o_name);
-    LOG(DEBUG) << std::hex << std::showbase << "Copying code name Python string from address "
-               << name_addr;
-    d_scope = manager->getStringFromAddress(name_addr);
-    LOG(DEBUG) << "Code object scope: " << d_filename;
+    CodeObjectCache& cache = manager->codeObjectCache();
+    const CodeObjectCache::Entry* cached = cache.find(addr, entry);
+    if (cached) {
+        LOG(DEBUG) << std::hex << std::showbase << "Using cached code object data for " << addr;
+    } else {
+        readStaticData(manager, entry);
+        cached = &cache.store(addr, std::move(entry));
+    }
+    d_filename = cached->filename;
+    d_scope = cached->scope;
+    d_varnames = cached->varnames;
 
     LOG(DEBUG) << "Obtaining location info location";
-    d_location_info = getLocationInfo(manager, addr, code, lasti, tlbc_index);
+    d_location_info = getLocationInfo(manager, addr, code, cached->lnotab, lasti, tlbc_index);
     LOG(DEBUG) << "Code object location info: line_range=(" << d_location_info.lineno << ", "
                << d_location_info.end_lineno << ") column_range=(" << d_location_info.column << ", "
                << d_location_info.end_column << ")";
 
     d_narguments = code.getField(&py_code_v::o_argcount);
     LOG(DEBUG) << "Code object n arguments: " << d_narguments;
+}
+
+void
+CodeObject::readStaticData(
+        const std::shared_ptr<const AbstractProcessManager>& manager,
+        CodeObjectCache::Entry& entry)
+{
+    LOG(DEBUG) << std::hex << std::showbase << "Copying filename Python string from address "
+               << entry.filename_addr;
+    entry.filename = manager->getStringFromAddress(entry.filename_addr);
+    LOG(DEBUG) << "Code object filename: " << entry.filename;
+
+    LOG(DEBUG) << std::hex << std::showbase << "Copying code name Python string from address "
+               << entry.name_addr;
+    entry.scope = manager->getStringFromAddress(entry.name_addr);
+    LOG(DEBUG) << "Code object scope: " << entry.scope;
 
     LOG(DEBUG) << "Copying variable names";
-    remote_addr_t varnames_addr = code.getField(&py_code_v::o_varnames);
-    TupleObject varnames(manager, varnames_addr);
+    TupleObject varnames(manager, entry.varnames_addr);
     std::transform(
             varnames.Items().cbegin(),
             varnames.Items().cend(),
-            std::back_inserter(d_varnames),
+            std::back_inserter(entry.varnames),
             [&](auto& addr) {
                 const std::string varname = manager->getStringFromAddress(addr);
                 LOG(DEBUG) << "Variable name found: '" << varname << "'";
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "mem.h"
@@ -19,6 +20,38 @@ struct LocationInfo
     int end_column;
 };
 
+// The parts of code objects that don't depend on the instruction being
+// executed, keyed by the address of the code object. An entry is only used
+// while the code object still points to the same name, filename, variable
+// names and line table objects, and has the same first line and line table
+// contents, so a code object freed and replaced by a different one at the
+// same address is read again. The line table itself is read every time.
+class CodeObjectCache
+{
+  public:
+    // Classes
+    struct Entry
+    {
+        remote_addr_t filename_addr;
+        remote_addr_t name_addr;
+        remote_addr_t varnames_addr;
+        remote_addr_t lnotab_addr;
+        int firstlineno;
+        std::string filename;
+        std::string scope;
+        std::vector<std::string> varnames;
+        std::string lnotab;
+    };
+
+    // Methods
+    const Entry* find(remote_addr_t addr, const Entry& key) const;
+    const Entry& store(remote_addr_t addr, Entry entry);
+
+  private:
+    // Data members
+    std::unordered_map<remote_addr_t, Entry> d_entries;
+};
+
 class CodeObject
 {
   public:
@@ -44,5 +77,10 @@ class CodeObject
     LocationInfo d_location_info;
     int d_narguments;
     std::vector<std::string> d_varnames;
+
+    // Methods
+    static void readStaticData(
+            const std::shared_ptr<const AbstractProcessManager>& manager,
+            CodeObjectCache::Entry& entry);
 };
 }  // namespace pystack
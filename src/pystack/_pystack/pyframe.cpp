@@ -1,6 +1,7 @@
 #include <memory>
 #include <sstream>
 
+#include "deadline.h"
 #include "logging.h"
 #include "mem.h"
 #include "process.h"
@@ -36,7 +37,10 @@ FrameObject::FrameObject(
 
     auto prev_addr = frame.getField(&py_frame_v::o_back);
     LOG(DEBUG) << std::hex << std::showbase << "Previous frame address: " << prev_addr;
-    if (prev_addr) {
+    if (prev_addr && Deadline::expired()) {
+        LOG(DEBUG) << "Deadline passed, not decoding frames older than frame number " << frame_no;
+        d_truncated = true;
+    } else if (prev_addr) {
         try {
             d_prev = std::make_shared<FrameObject>(manager, prev_addr, next_frame_no);
         } catch (const RemoteMemCopyError& ex) {
@@ -219,4 +223,10 @@ FrameObject::IsShim() const
     return this->d_is_shim;
 }
 
+bool
+FrameObject::Truncated() const
+{
+    return d_truncated;
+}
+
 }  // namespace pystack
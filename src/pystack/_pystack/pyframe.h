@@ -27,6 +27,8 @@ class FrameObject
     const std::unordered_map<std::string, std::string>& Locals() const;
     bool IsEntryFrame() const;
     bool IsShim() const;
+    // Whether older frames were not decoded because the deadline passed.
+    bool Truncated() const;
 
     // Methods
     void resolveLocalVariables();
@@ -53,5 +55,6 @@ class FrameObject
     std::unordered_map<std::string, std::string> d_locals{};
     bool d_is_entry;
     bool d_is_shim;
+    bool d_truncated{false};
 };
 }  // namespace pystack
@@ -1,7 +1,12 @@
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
 
+#include "deadline.h"
 #include "logging.h"
 #include "mem.h"
 #include "native_frame.h"
@@ -9,6 +14,7 @@
 #include "pyframe.h"
 #include "pythread.h"
 #include "structure.h"
+#include "timing.h"
 #include "version.h"
 
 #include "cpython/pthread.h"
@@ -39,84 +45,195 @@ Thread::populateNativeStackTrace(const std::shared_ptr<const AbstractProcessMana
     d_native_frames = manager->unwindThread(d_tid);
 }
 
-off_t tid_offset_in_pthread_struct = 0;
+void
+Thread::setNativeStackTrace(std::vector<NativeFrame> native_frames)
+{
+    d_native_frames = std::move(native_frames);
+}
+
+namespace {
+
+// Offsets of the tid in the known layouts of glibc's 'struct pthread'
+std::vector<off_t>
+glibcTidOffsetCandidates()
+{
+#if defined(__GLIBC__)
+    return {offsetof(_pthread_structure_with_simple_header, tid),
+            offsetof(_pthread_structure_with_tcbhead, tid)};
+#else
+    return {};
+#endif
+}
+
+// Tid offsets discovered so far, keyed by the build id of the libc that
+// defines the layout of 'struct pthread'.
+std::mutex g_tid_offset_cache_mutex;
+std::unordered_map<std::string, off_t> g_tid_offset_by_libc_build_id;
+
+bool
+isLibcPath(std::string_view path)
+{
+    std::string_view filename = path.substr(path.rfind('/') + 1);
+    return filename.rfind("libc.so", 0) == 0 || filename.rfind("libc-", 0) == 0
+           || filename.rfind("libc.musl", 0) == 0 || filename.rfind("ld-musl", 0) == 0;
+}
+
+}  // namespace
 
-static off_t
-findPthreadTidOffset(
+bool
+PthreadTidResolver::isKnownTid(int tid) const
+{
+    return d_known_tids.find(tid) != d_known_tids.end();
+}
+
+const std::string&
+PthreadTidResolver::libcBuildId(const std::shared_ptr<const AbstractProcessManager>& manager)
+{
+    if (!d_libc_build_id) {
+        d_libc_build_id = "";
+        for (const auto& map : manager->MemoryMaps()) {
+            const std::string& path = map.Path(manager->Strings());
+            if (map.hasPath() && isLibcPath(path)) {
+                d_libc_build_id = getBuildId(path);
+                LOG(DEBUG) << "Found libc " << path << " with build id " << *d_libc_build_id;
+                break;
+            }
+        }
+    }
+    return *d_libc_build_id;
+}
+
+void
+PthreadTidResolver::prepare(
         const std::shared_ptr<const AbstractProcessManager>& manager,
         remote_addr_t interp_state_addr)
 {
-    LOG(DEBUG) << "Attempting to locate tid offset in pthread structure";
+    const auto& tids = manager->Tids();
+    d_known_tids = std::unordered_set<int>(tids.begin(), tids.end());
+
+    if (d_offset || manager->versionIsAtLeast(3, 11)) {
+        return;
+    }
+
     Structure<py_is_v> is(manager, interp_state_addr);
+    remote_addr_t thread_head = is.getField(&py_is_v::o_tstate_head);
+
+    const std::string& build_id = libcBuildId(manager);
+    if (!build_id.empty()) {
+        std::optional<off_t> cached_offset;
+        {
+            std::lock_guard<std::mutex> lock(g_tid_offset_cache_mutex);
+            auto it = g_tid_offset_by_libc_build_id.find(build_id);
+            if (it != g_tid_offset_by_libc_build_id.end()) {
+                cached_offset = it->second;
+            }
+        }
+        if (cached_offset && validateOffset(manager, thread_head, *cached_offset)) {
+            LOG(DEBUG) << "Using tid offset " << std::showbase << std::hex << *cached_offset
+                       << " previously found for libc build id " << build_id;
+            d_offset = cached_offset;
+            return;
+        }
+    }
+
+    off_t offset = findOffset(manager, thread_head);
+    if (offset == 0) {
+        // Nothing is remembered, so that the search is tried again next time.
+        return;
+    }
+    d_offset = offset;
+    if (!build_id.empty()) {
+        std::lock_guard<std::mutex> lock(g_tid_offset_cache_mutex);
+        g_tid_offset_by_libc_build_id[build_id] = offset;
+    }
+}
 
-    auto current_thread_addr = is.getField(&py_is_v::o_tstate_head);
+bool
+PthreadTidResolver::validateOffset(
+        const std::shared_ptr<const AbstractProcessManager>& manager,
+        remote_addr_t thread_head,
+        off_t offset) const
+{
+    if (thread_head == (remote_addr_t) nullptr) {
+        return false;
+    }
+    try {
+        Structure<py_thread_v> thread(manager, thread_head);
+        auto pthread_id = thread.getField(&py_thread_v::o_thread_id);
+        pid_t the_tid;
+        manager->copyObjectFromProcess((remote_addr_t)(pthread_id + offset), &the_tid);
+        return isKnownTid(the_tid);
+    } catch (const RemoteMemCopyError& ex) {
+        return false;
+    }
+}
 
-    auto thread_head = current_thread_addr;
+off_t
+PthreadTidResolver::findOffset(
+        const std::shared_ptr<const AbstractProcessManager>& manager,
+        remote_addr_t thread_head) const
+{
+    LOG(DEBUG) << "Attempting to locate tid offset in pthread structure";
 
     // Iterate over all Python threads until we find a thread that has a tid equal to
     // the process pid. This works because in the main thread the tid is equal to the pid,
     // so when this happens it has to happen on the main thread. Note that the main thread
-    // is not necessarily at the head of the Python thread linked list
+    // is not necessarily at the head of the Python thread linked list.
+    //
+    // Each pthread structure is copied with a single read that covers both
+    // the offsets used by the known glibc layouts (which are preferred, to
+    // avoid guess-work) and the window that we scan for unknown layouts.
+    const std::vector<off_t> glibc_candidates = glibcTidOffsetCandidates();
+    size_t window_size = 100 * sizeof(uintptr_t);
+    for (off_t candidate : glibc_candidates) {
+        window_size = std::max(window_size, candidate + sizeof(pid_t));
+    }
+    std::vector<char> buffer(window_size);
 
-#if defined(__GLIBC__)
-    // If we detect GLIBC, we can try the two main known structs for 'struct
-    // pthread' that we know about to avoid having to do guess-work by doing a
-    // linear scan over the struct.
+    std::optional<off_t> scanned_offset;
+    remote_addr_t current_thread_addr = thread_head;
     while (current_thread_addr != (remote_addr_t) nullptr) {
         Structure<py_thread_v> current_thread(manager, current_thread_addr);
         auto pthread_id_addr = current_thread.getField(&py_thread_v::o_thread_id);
 
-        pid_t the_tid;
-        std::vector<off_t> glibc_pthread_offset_candidates = {
-                offsetof(_pthread_structure_with_simple_header, tid),
-                offsetof(_pthread_structure_with_tcbhead, tid)};
-        for (off_t candidate : glibc_pthread_offset_candidates) {
+        size_t buffer_size = buffer.size();
+        while (buffer_size > 0) {
             try {
-                manager->copyObjectFromProcess((remote_addr_t)(pthread_id_addr + candidate), &the_tid);
+                LOG(DEBUG) << "Trying to copy a buffer of " << buffer_size << " bytes to get pthread ID";
+                manager->copyMemoryFromProcess(pthread_id_addr, buffer_size, buffer.data());
+                break;
             } catch (const RemoteMemCopyError& ex) {
+                LOG(DEBUG) << "Failed to copy buffer to get pthread ID";
+                buffer_size /= 2;
+            }
+        }
+        LOG(DEBUG) << "Copied a buffer of " << buffer_size << " bytes to get pthread ID";
+
+        for (off_t candidate : glibc_candidates) {
+            pid_t the_tid;
+            if (candidate + sizeof(the_tid) > buffer_size) {
                 continue;
             }
+            std::memcpy(&the_tid, buffer.data() + candidate, sizeof(the_tid));
             if (the_tid == manager->Pid()) {
                 LOG(DEBUG) << "Tid offset located using GLIBC offsets at offset " << std::showbase
                            << std::hex << candidate << " in pthread structure";
                 return candidate;
             }
         }
-        remote_addr_t next_thread_addr = current_thread.getField(&py_thread_v::o_next);
-        if (next_thread_addr == current_thread_addr) {
-            break;
-        }
-        current_thread_addr = next_thread_addr;
-    }
-#endif
-
-    current_thread_addr = thread_head;
-
-    while (current_thread_addr != (remote_addr_t) nullptr) {
-        Structure<py_thread_v> current_thread(manager, current_thread_addr);
-        auto pthread_id_addr = current_thread.getField(&py_thread_v::o_thread_id);
 
         // Attempt to locate a field in the pthread struct that's equal to the pid.
-        uintptr_t buffer[100];
-        size_t buffer_size = sizeof(buffer);
-        while (buffer_size > 0) {
-            try {
-                LOG(DEBUG) << "Trying to copy a buffer of " << buffer_size << " bytes to get pthread ID";
-                manager->copyMemoryFromProcess(pthread_id_addr, buffer_size, &buffer);
-                break;
-            } catch (const RemoteMemCopyError& ex) {
-                LOG(DEBUG) << "Failed to copy buffer to get pthread ID";
-                buffer_size /= 2;
+        for (size_t offset = 0; !scanned_offset && offset + sizeof(uintptr_t) <= buffer_size;
+             offset += sizeof(uintptr_t))
+        {
+            uintptr_t value;
+            std::memcpy(&value, buffer.data() + offset, sizeof(value));
+            if (static_cast<pid_t>(value) == manager->Pid()) {
+                scanned_offset = offset;
             }
         }
-        LOG(DEBUG) << "Copied a buffer of " << buffer_size << " bytes to get pthread ID";
-        for (size_t i = 0; i < buffer_size / sizeof(uintptr_t); i++) {
-            if (static_cast<pid_t>(buffer[i]) == manager->Pid()) {
-                off_t offset = sizeof(uintptr_t) * i;
-                LOG(DEBUG) << "Tid offset located by scanning at offset " << std::showbase << std::hex
-                           << offset << " in pthread structure";
-                return offset;
-            }
+        if (scanned_offset && glibc_candidates.empty()) {
+            break;
         }
 
         remote_addr_t next_thread_addr = current_thread.getField(&py_thread_v::o_next);
@@ -125,10 +242,33 @@ findPthreadTidOffset(
         }
         current_thread_addr = next_thread_addr;
     }
+
+    if (scanned_offset) {
+        LOG(DEBUG) << "Tid offset located by scanning at offset " << std::showbase << std::hex
+                   << *scanned_offset << " in pthread structure";
+        return *scanned_offset;
+    }
     LOG(ERROR) << "Could not find tid offset in pthread structure";
     return 0;
 }
 
+int
+PthreadTidResolver::resolveTid(
+        const std::shared_ptr<const AbstractProcessManager>& manager,
+        unsigned long pthread_id) const
+{
+    int the_tid;
+    manager->copyObjectFromProcess((remote_addr_t)(pthread_id + d_offset.value_or(0)), &the_tid);
+
+    // To double check that this number is correct, we then check that this is one
+    // of the tids that we know. A thread id of 0 means that the thread was terminated
+    // but not joined.
+    if (the_tid != 0 && !isKnownTid(the_tid)) {
+        throw std::runtime_error("Invalid thread ID found!");
+    }
+    return the_tid;
+}
+
 remote_addr_t
 getStackAnchor(const std::shared_ptr<const AbstractProcessManager>& manager, remote_addr_t frame_addr)
 {
@@ -184,14 +324,9 @@ PyThread::PyThread(const std::shared_ptr<const AbstractProcessManager>& manager,
     LOG(DEBUG) << std::hex << std::showbase << "Copying main thread struct from address " << addr;
     Structure<py_thread_v> ts(manager, addr);
 
-    remote_addr_t frame_addr = getFrameAddr(manager, ts);
-    if (frame_addr != (remote_addr_t) nullptr) {
-        LOG(DEBUG) << std::hex << std::showbase << "Attempting to construct frame from address "
-                   << frame_addr;
-        d_first_frame = std::make_unique<FrameObject>(manager, frame_addr, 0);
-
-        d_stack_anchor = getStackAnchor(manager, frame_addr);
-    }
+    // The frames themselves are only decoded by decodeFrames(), so that the
+    // threads can be decoded in order of importance.
+    d_frame_addr = getFrameAddr(manager, ts);
 
     d_addr = addr;
     remote_addr_t candidate_next_addr = ts.getField(&py_thread_v::o_next);
@@ -201,7 +336,10 @@ PyThread::PyThread(const std::shared_ptr<const AbstractProcessManager>& manager,
     d_tid = getThreadTid(manager, ts, d_pthread_id);
     d_next = nullptr;
 
-    if (d_next_addr != (remote_addr_t)NULL) {
+    if (d_next_addr != (remote_addr_t)NULL && Deadline::expired()) {
+        LOG(WARNING) << "Deadline passed, not inspecting the Python threads after thread " << d_tid;
+        d_later_threads_skipped = true;
+    } else if (d_next_addr != (remote_addr_t)NULL) {
         LOG(DEBUG) << std::hex << std::showbase << "Attempting to construct a new thread address "
                    << d_next_addr;
         d_next = std::make_unique<PyThread>(manager, d_next_addr);
@@ -250,17 +388,7 @@ PyThread::inferTidFromPThreadStructure(
     //   ...
     //   }
     //
-    int the_tid;
-    manager->copyObjectFromProcess((remote_addr_t)(pthread_id + tid_offset_in_pthread_struct), &the_tid);
-
-    // To double check that this number is correct, we then check that this is one
-    // of the tids that we know. A thread id of 0 means that the thread was terminated
-    // but not joined.
-    const auto& tids = manager->Tids();
-    if (the_tid != 0 && std::find(tids.begin(), tids.end(), the_tid) == tids.end()) {
-        throw std::runtime_error("Invalid thread ID found!");
-    }
-    return the_tid;
+    return manager->tidResolver().resolveTid(manager, pthread_id);
 }
 
 remote_addr_t
@@ -281,6 +409,34 @@ PyThread::getFrameAddr(
     }
 }
 
+void
+PyThread::decodeFrames(const std::shared_ptr<const AbstractProcessManager>& manager)
+{
+    if (d_frames_decoded || d_frame_addr == (remote_addr_t) nullptr) {
+        return;
+    }
+    if (Deadline::expired()) {
+        LOG(DEBUG) << "Deadline passed, not decoding the frames of thread " << d_tid;
+        return;
+    }
+    d_frames_decoded = true;
+
+    LOG(DEBUG) << std::hex << std::showbase << "Attempting to construct frame from address "
+               << d_frame_addr;
+    {
+        ScopedTimer timer("frame_decode");
+        d_first_frame = std::make_unique<FrameObject>(manager, d_frame_addr, 0);
+    }
+
+    d_stack_anchor = getStackAnchor(manager, d_frame_addr);
+}
+
+bool
+PyThread::framesDecoded() const
+{
+    return d_frames_decoded || d_frame_addr == (remote_addr_t) nullptr;
+}
+
 std::shared_ptr<FrameObject>
 PyThread::FirstFrame() const
 {
@@ -293,6 +449,12 @@ PyThread::NextThread() const
     return d_next;
 }
 
+bool
+PyThread::laterThreadsSkipped() const
+{
+    return d_later_threads_skipped;
+}
+
 PyThread::GilStatus
 PyThread::isGilHolder() const
 {
@@ -312,7 +474,7 @@ PyThread::calculateGilStatus(
 {
     LOG(DEBUG) << "Attempting to determine GIL Status";
     remote_addr_t thread_addr;
-    remote_addr_t pyruntime = manager->findSymbol("_PyRuntime");
+    remote_addr_t pyruntime = manager->findPyRuntime();
     if (pyruntime) {
         assert(manager->versionIsAtLeast(3, 0));
         LOG(DEBUG) << "_PyRuntime symbol detected. Searching for GIL status within _PyRuntime structure";
@@ -390,7 +552,7 @@ PyThread::calculateGCStatus(
         Structure<py_is_v> interp(manager, is_addr);
         gcstate_addr = interp.getFieldRemoteAddress(&py_is_v::o_gc);
     } else if (manager->versionIsAtLeast(3, 7)) {
-        remote_addr_t pyruntime = manager->findSymbol("_PyRuntime");
+        remote_addr_t pyruntime = manager->findPyRuntime();
         if (!pyruntime) {
             LOG(DEBUG) << "Failed to get GC status because the _PyRuntime symbol is unavailable";
             return GCStatus::COLLECTING_UNKNOWN;
@@ -415,9 +577,7 @@ getThreadFromInterpreterState(
         const std::shared_ptr<const AbstractProcessManager>& manager,
         remote_addr_t addr)
 {
-    if (tid_offset_in_pthread_struct == 0 && !manager->versionIsAtLeast(3, 11)) {
-        tid_offset_in_pthread_struct = findPthreadTidOffset(manager, addr);
-    }
+    manager->tidResolver().prepare(manager, addr);
 
     LOG(DEBUG) << std::hex << std::showbase << "Copying PyInterpreterState struct from address " << addr;
     Structure<py_is_v> is(manager, addr);
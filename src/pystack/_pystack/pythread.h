@@ -1,7 +1,10 @@
 #pragma once
 #include "memory"
 #include <memory>
+#include <optional>
+#include <string>
 #include <sys/types.h>
+#include <unordered_set>
 #include <vector>
 
 #include "mem.h"
@@ -20,6 +23,7 @@ class Thread
 
     // Methods
     void populateNativeStackTrace(const std::shared_ptr<const AbstractProcessManager>& manager);
+    void setNativeStackTrace(std::vector<NativeFrame> native_frames);
 
   protected:
     // Data members
@@ -28,6 +32,40 @@ class Thread
     std::vector<NativeFrame> d_native_frames;
 };
 
+// Maps the pthread_t of a thread (the address of its 'struct pthread') to its
+// OS thread id, for interpreters that don't record the latter (< 3.11). The
+// offset of the tid in the structure is discovered once per manager and
+// remembered for every process that uses the same libc build.
+class PthreadTidResolver
+{
+  public:
+    // Methods
+    void prepare(
+            const std::shared_ptr<const AbstractProcessManager>& manager,
+            remote_addr_t interp_state_addr);
+    int resolveTid(
+            const std::shared_ptr<const AbstractProcessManager>& manager,
+            unsigned long pthread_id) const;
+
+  private:
+    // Data members
+    std::optional<off_t> d_offset;
+    std::optional<std::string> d_libc_build_id;
+    std::unordered_set<int> d_known_tids;
+
+    // Methods
+    bool isKnownTid(int tid) const;
+    const std::string&
+    libcBuildId(const std::shared_ptr<const AbstractProcessManager>& manager);
+    bool validateOffset(
+            const std::shared_ptr<const AbstractProcessManager>& manager,
+            remote_addr_t thread_head,
+            off_t offset) const;
+    off_t findOffset(
+            const std::shared_ptr<const AbstractProcessManager>& manager,
+            remote_addr_t thread_head) const;
+};
+
 class PyThread : public Thread
 {
   public:
@@ -43,6 +81,13 @@ class PyThread : public Thread
     std::shared_ptr<PyThread> NextThread() const;
 
     // Methods
+    // Decodes the frames of the thread, unless the deadline has passed.
+    void decodeFrames(const std::shared_ptr<const AbstractProcessManager>& manager);
+    // Whether decodeFrames() decoded the frames, or there were none.
+    bool framesDecoded() const;
+    // Whether the threads after this one were not inspected because the
+    // deadline had passed.
+    bool laterThreadsSkipped() const;
     GilStatus isGilHolder() const;
     GCStatus isGCCollecting() const;
     remote_addr_t stackAnchor() const;
@@ -58,7 +103,10 @@ class PyThread : public Thread
     GilStatus d_gil_status;
     GCStatus d_gc_status;
     remote_addr_t d_addr;
+    remote_addr_t d_frame_addr;
+    bool d_frames_decoded{false};
     remote_addr_t d_next_addr;
+    bool d_later_threads_skipped{false};
     std::shared_ptr<PyThread> d_next;
     std::shared_ptr<FrameObject> d_first_frame;
     remote_addr_t d_stack_anchor{};
@@ -0,0 +1,127 @@
+#include <algorithm>
+
+#include "stack_aggregator.h"
+
+namespace pystack {
+
+static const uint32_t ROOT = 0;
+
+static std::string
+frameLabel(const PyFrameData& frame)
+{
+    return frame.code.scope + " (" + frame.code.filename + ":"
+           + std::to_string(frame.code.location.lineno) + ")";
+}
+
+StackAggregator::StackAggregator(size_t max_nodes)
+: d_max_nodes(std::max<size_t>(max_nodes, 1))
+{
+    clear();
+}
+
+void
+StackAggregator::addThread(const PyThreadData& thread)
+{
+    uint32_t node = ROOT;
+    bool seen_frames = false;
+    // Frames are stored from the innermost to the outermost one.
+    for (auto it = thread.frames.rbegin(); it != thread.frames.rend(); ++it) {
+        if (it->is_shim) {
+            continue;
+        }
+        seen_frames = true;
+
+        std::string label = frameLabel(*it);
+        auto label_it = d_label_ids.find(label);
+        if (label_it != d_label_ids.end()) {
+            auto& children = d_nodes[node].children;
+            auto child = children.find(label_it->second);
+            if (child != children.end()) {
+                node = child->second;
+                continue;
+            }
+        }
+
+        if (d_nodes.size() >= d_max_nodes) {
+            ++d_truncated_samples;
+            break;
+        }
+        if (label_it == d_label_ids.end()) {
+            label_it = d_label_ids.emplace(label, d_labels.size()).first;
+            d_labels.push_back(std::move(label));
+        }
+        uint32_t child = d_nodes.size();
+        d_nodes.push_back(Node{label_it->second, node});
+        d_nodes[node].children.emplace(label_it->second, child);
+        node = child;
+    }
+
+    if (!seen_frames) {
+        return;
+    }
+    ++d_nodes[node].count;
+    ++d_samples;
+}
+
+StackAggregator::CollapsedStacks
+StackAggregator::collapsed() const
+{
+    CollapsedStacks result;
+    // Depth-first walk that keeps a single copy of the current stack, with
+    // the length of the stack of each pending node's parent.
+    std::string stack;
+    std::vector<std::pair<uint32_t, size_t>> pending;
+    for (const auto& [label, child] : d_nodes[ROOT].children) {
+        pending.emplace_back(child, 0);
+    }
+    while (!pending.empty()) {
+        auto [node, parent_length] = pending.back();
+        pending.pop_back();
+
+        const Node& entry = d_nodes[node];
+        stack.resize(parent_length);
+        if (parent_length) {
+            stack += ';';
+        }
+        stack += d_labels[entry.label];
+        if (entry.count) {
+            result.emplace_back(stack, entry.count);
+        }
+        for (const auto& [label, child] : entry.children) {
+            pending.emplace_back(child, stack.size());
+        }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void
+StackAggregator::clear()
+{
+    d_nodes.clear();
+    d_nodes.push_back(Node{0, ROOT});
+    d_labels.clear();
+    d_label_ids.clear();
+    d_samples = 0;
+    d_truncated_samples = 0;
+}
+
+uint64_t
+StackAggregator::samples() const
+{
+    return d_samples;
+}
+
+uint64_t
+StackAggregator::truncatedSamples() const
+{
+    return d_truncated_samples;
+}
+
+size_t
+StackAggregator::nodes() const
+{
+    return d_nodes.size() - 1;
+}
+
+}  // namespace pystack
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "thread_builder.h"
+
+namespace pystack {
+
+// Counts how many times each Python stack was seen across many samples.
+//
+// Stacks are stored in a trie whose nodes are keyed by interned frame labels,
+// so a sample only costs one lookup per frame and shared prefixes are stored
+// once. Once the trie holds max_nodes nodes no new nodes are created: the
+// part of a stack that doesn't fit is dropped and the sample is counted in
+// the deepest node that already exists.
+class StackAggregator
+{
+  public:
+    using CollapsedStacks = std::vector<std::pair<std::string, uint64_t>>;
+
+    // Constructors
+    explicit StackAggregator(size_t max_nodes = DEFAULT_MAX_NODES);
+
+    // Methods
+    void addThread(const PyThreadData& thread);
+    // Stacks in the "outermost;...;innermost" format read by flame graph
+    // tools, with the number of samples that ended in each of them.
+    CollapsedStacks collapsed() const;
+    void clear();
+
+    // Getters
+    uint64_t samples() const;
+    uint64_t truncatedSamples() const;
+    size_t nodes() const;
+
+    static constexpr size_t DEFAULT_MAX_NODES = 1 << 20;
+
+  private:
+    // Classes
+    struct Node
+    {
+        uint32_t label;
+        uint32_t parent;
+        uint64_t count{0};
+        std::unordered_map<uint32_t, uint32_t> children;
+    };
+
+    // Data members
+    size_t d_max_nodes;
+    std::vector<Node> d_nodes;
+    std::vector<std::string> d_labels;
+    std::unordered_map<std::string, uint32_t> d_label_ids;
+    uint64_t d_samples{0};
+    uint64_t d_truncated_samples{0};
+};
+
+}  // namespace pystack
@@ -0,0 +1,523 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <iterator>
+#include <string>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <syscall.h>
+#include <unistd.h>
+#include <utility>
+
+#include "logging.h"
+#include "stack_snapshot.h"
+#include "timing.h"
+
+namespace pystack {
+
+// The x86_64 ABI allows leaf functions to use the 128 bytes below the stack
+// pointer, so include them in the snapshot too.
+static const size_t STACK_RED_ZONE = 128;
+// Upper bound for a single snapshot. Anything past this is still readable
+// through the memory manager, it just isn't prefetched.
+static const size_t MAX_STACK_SNAPSHOT_SIZE = 8 * 1024 * 1024;  // 8MB
+
+StackSnapshot::StackSnapshot(pid_t tid, remote_addr_t stack_pointer, const VirtualMaps& maps)
+{
+    auto it = std::upper_bound(
+            maps.begin(),
+            maps.end(),
+            stack_pointer,
+            [](remote_addr_t addr, const VirtualMap& map) { return addr < map.Start(); });
+    if (it == maps.begin() || !(--it)->containsAddr(stack_pointer)) {
+        d_error = "no map contains the stack pointer";
+        return;
+    }
+
+    remote_addr_t start = stack_pointer > STACK_RED_ZONE ? stack_pointer - STACK_RED_ZONE : 0;
+    start = std::max(start, it->Start());
+    size_t size = std::min(it->End() - start, MAX_STACK_SNAPSHOT_SIZE);
+
+    d_data.resize(size);
+    struct iovec local = {d_data.data(), size};
+    struct iovec remote = {reinterpret_cast<void*>(start), size};
+    ssize_t read = syscall(SYS_process_vm_readv, tid, &local, 1, &remote, 1, 0);
+    if (read < 0) {
+        d_error = std::strerror(errno);
+        d_data.clear();
+        return;
+    }
+    d_data.resize(read);
+    d_start = start;
+}
+
+void
+StackSnapshot::log(pid_t tid) const
+{
+    if (!d_error.empty()) {
+        LOG(DEBUG) << "Failed to snapshot the stack of thread " << tid << ": " << d_error;
+        return;
+    }
+    LOG(DEBUG) << std::hex << std::showbase << "Captured " << std::dec << d_data.size()
+               << " bytes of stack for thread " << tid << std::hex << " starting at " << d_start;
+}
+
+bool
+StackSnapshot::read(remote_addr_t addr, Dwarf_Word* result) const
+{
+    if (addr < d_start || addr - d_start + sizeof(Dwarf_Word) > d_data.size()) {
+        return false;
+    }
+    std::memcpy(result, d_data.data() + (addr - d_start), sizeof(Dwarf_Word));
+    return true;
+}
+
+bool
+StackSnapshot::empty() const
+{
+    return d_data.empty();
+}
+
+size_t
+StackSnapshot::size() const
+{
+    return d_data.size();
+}
+
+namespace {
+
+// Reads the registers of a thread that is ptrace-stopped by us. Returns
+// nullopt and sets errno if they can't be read.
+std::optional<ThreadRegisters>
+readRegisters(pid_t tid)
+{
+#ifdef PYSTACK_HAS_REMOTE_THREAD_STATE
+    struct user_regs_struct regs;
+    struct iovec iov = {&regs, sizeof(regs)};
+    if (ptrace(PTRACE_GETREGSET, tid, NT_PRSTATUS, &iov) == -1) {
+        return std::nullopt;
+    }
+
+    // The DWARF register numbers are part of each platform's ABI.
+    ThreadRegisters result;
+#    if defined(__x86_64__)
+    // https://refspecs.linuxbase.org/elf/x86_64-abi-0.99.pdf
+    // Figure 3.36: DWARF Register Number Mapping
+    result.dwarf_regs = {
+            regs.rax,
+            regs.rdx,
+            regs.rcx,
+            regs.rbx,
+            regs.rsi,
+            regs.rdi,
+            regs.rbp,
+            regs.rsp,
+            regs.r8,
+            regs.r9,
+            regs.r10,
+            regs.r11,
+            regs.r12,
+            regs.r13,
+            regs.r14,
+            regs.r15,
+            regs.rip,
+    };
+    result.pc = regs.rip;
+    result.sp = regs.rsp;
+    result.fp = regs.rbp;
+#    elif defined(__aarch64__)
+    // https://github.com/ARM-software/abi-aa/blob/main/aadwarf64/aadwarf64.rst
+    // x0-x30 are 0-30 and sp is 31. The pc has no DWARF number of its own.
+    result.dwarf_regs.assign(std::begin(regs.regs), std::end(regs.regs));
+    result.dwarf_regs.push_back(regs.sp);
+    result.pc = regs.pc;
+    result.sp = regs.sp;
+    result.fp = regs.regs[29];
+#    endif
+    return result;
+#else
+    (void)tid;
+    errno = ENOSYS;
+    return std::nullopt;
+#endif
+}
+
+// Stops a single thread of a running process with PTRACE_SEIZE and
+// PTRACE_INTERRUPT, and lets it run again when destroyed. Nothing is logged
+// while the thread is stopped, as every log message goes through the Python
+// logger.
+class ThreadStop
+{
+  public:
+    explicit ThreadStop(pid_t tid)
+    : d_tid(tid)
+    {
+        if (ptrace(PTRACE_SEIZE, tid, nullptr, nullptr) < 0) {
+            d_error = errno;
+            return;
+        }
+        d_seized = true;
+        d_stopped_at = TimingReport::Clock::now();
+        if (ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) < 0) {
+            d_error = errno;
+            return;
+        }
+
+        d_error = waitForStop();
+    }
+
+    ~ThreadStop()
+    {
+        if (!d_seized) {
+            return;
+        }
+        if (!detach() && errno == ESRCH && ptrace(PTRACE_INTERRUPT, d_tid, nullptr, nullptr) == 0
+            && waitForStop() == 0)
+        {
+            // We failed to stop the thread, and a thread can only be detached
+            // from while it is stopped: left seized, it would hang on its next
+            // signal until we exit.
+            detach();
+        }
+        if (TimingReport* report = TimingReport::current()) {
+            report->recordTargetStopped(TimingReport::Clock::now() - d_stopped_at);
+        }
+    }
+
+    ThreadStop(const ThreadStop&) = delete;
+    ThreadStop& operator=(const ThreadStop&) = delete;
+
+    // errno of the step that failed, or 0 if the thread is stopped.
+    int error() const
+    {
+        return d_error;
+    }
+
+  private:
+    // Returns the errno of the failure, or ESRCH if the thread finished
+    // before it could be stopped.
+    int waitForStop()
+    {
+        int status;
+        pid_t ret;
+        do {
+            ret = waitpid(d_tid, &status, __WALL);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0) {
+            return errno;
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            d_seized = false;
+            return ESRCH;
+        }
+        if (WIFSTOPPED(status) && (status >> 16) != PTRACE_EVENT_STOP) {
+            // A signal-delivery-stop won the race against the interrupt. The
+            // signal has to be handed back to the thread when we detach.
+            d_pending_signal = WSTOPSIG(status);
+        }
+        return 0;
+    }
+
+    bool detach()
+    {
+        return ptrace(PTRACE_DETACH, d_tid, nullptr, reinterpret_cast<void*>(intptr_t(d_pending_signal)))
+               == 0;
+    }
+
+    pid_t d_tid;
+    bool d_seized{false};
+    int d_error{0};
+    int d_pending_signal{0};
+    TimingReport::Clock::time_point d_stopped_at;
+};
+
+}  // namespace
+
+const Dwfl_Thread_Callbacks RemoteThreadState::s_callbacks = {
+        RemoteThreadState::nextThread,
+        RemoteThreadState::getThread,
+        RemoteThreadState::memoryRead,
+        RemoteThreadState::setInitialRegistersCallback,
+        RemoteThreadState::detach,
+        nullptr,
+};
+
+RemoteThreadState::RemoteThreadState(
+        pid_t pid,
+        std::vector<int> tids,
+        const AbstractRemoteMemoryManager* manager,
+        SharedVirtualMaps maps)
+: d_pid(pid)
+, d_tids(std::move(tids))
+, d_manager(manager)
+, d_maps(std::move(maps))
+{
+}
+
+RemoteThreadState::~RemoteThreadState()
+{
+    d_elf.reset();
+    if (d_elf_fd != -1) {
+        close(d_elf_fd);
+    }
+}
+
+RemoteThreadState*
+RemoteThreadState::attach(
+        Dwfl* dwfl,
+        pid_t pid,
+        std::vector<int> tids,
+        const AbstractRemoteMemoryManager* manager,
+        SharedVirtualMaps maps)
+{
+#ifdef PYSTACK_HAS_REMOTE_THREAD_STATE
+    auto state = std::make_unique<RemoteThreadState>(pid, std::move(tids), manager, std::move(maps));
+
+    // Like dwfl_linux_proc_attach, give libdwfl the main executable so it can
+    // pick the right backend for the process' architecture.
+    std::string exe = "/proc/" + std::to_string(pid) + "/exe";
+    state->d_elf_fd = open(exe.c_str(), O_RDONLY);
+    if (state->d_elf_fd != -1 && elf_version(EV_CURRENT) != EV_NONE) {
+        state->d_elf = elf_unique_ptr(elf_begin(state->d_elf_fd, ELF_C_READ_MMAP, nullptr), elf_end);
+    }
+
+    if (!dwfl_attach_state(dwfl, state->d_elf.get(), pid, &s_callbacks, state.get())) {
+        throw ElfAnalyzerError("Could not attach the DWARF process analyzer");
+    }
+    // From now on the state is owned by libdwfl and freed by the detach callback.
+    return state.release();
+#else
+    if (dwfl_linux_proc_attach(dwfl, pid, true) != 0) {
+        throw ElfAnalyzerError("Could not attach the DWARF process analyzer");
+    }
+    return nullptr;
+#endif
+}
+
+const ThreadRegisters*
+RemoteThreadState::registers(pid_t tid)
+{
+    auto it = d_registers.find(tid);
+    if (it == d_registers.end()) {
+        if (d_stop_threads_individually) {
+            captureThread(tid);
+            it = d_registers.find(tid);
+        } else {
+            std::optional<ThreadRegisters> regs = readRegisters(tid);
+            if (!regs) {
+                LOG(DEBUG) << "Failed to fetch the registers of thread " << tid << ": "
+                           << std::strerror(errno);
+            }
+            it = d_registers.emplace(tid, std::move(regs)).first;
+        }
+    }
+    return it->second ? &it->second.value() : nullptr;
+}
+
+void
+RemoteThreadState::setStopThreadsIndividually(bool stop_threads_individually)
+{
+    d_stop_threads_individually = stop_threads_individually;
+}
+
+void
+RemoteThreadState::captureThread(pid_t tid)
+{
+    std::optional<ThreadRegisters> regs;
+    std::optional<StackSnapshot> snapshot;
+    int error;
+    {
+        ThreadStop stop(tid);
+        error = stop.error();
+        if (!error) {
+            regs = readRegisters(tid);
+            if (regs) {
+                snapshot.emplace(tid, regs->sp, *d_maps);
+            } else {
+                error = errno;
+            }
+        }
+    }
+
+    if (!regs) {
+        LOG(WARNING) << "Failed to stop thread " << tid
+                     << " to capture its native stack: " << std::strerror(error);
+    } else {
+        snapshot->log(tid);
+        d_snapshots.emplace(tid, std::move(*snapshot));
+    }
+    d_registers.emplace(tid, std::move(regs));
+}
+
+const StackSnapshot*
+RemoteThreadState::stackSnapshot(pid_t tid)
+{
+    auto it = d_snapshots.find(tid);
+    if (it == d_snapshots.end()) {
+        const ThreadRegisters* regs = registers(tid);
+        if (!regs) {
+            return nullptr;
+        }
+        // Threads that are stopped individually have their stack captured
+        // together with their registers.
+        it = d_snapshots.find(tid);
+        if (it == d_snapshots.end()) {
+            StackSnapshot snapshot(tid, regs->sp, *d_maps);
+            snapshot.log(tid);
+            it = d_snapshots.emplace(tid, std::move(snapshot)).first;
+        }
+    }
+    return &it->second;
+}
+
+void
+RemoteThreadState::overrideInitialRegisters(pid_t tid, const ThreadRegisters& regs)
+{
+    d_register_overrides[tid] = regs;
+}
+
+void
+RemoteThreadState::clearInitialRegistersOverride(pid_t tid)
+{
+    d_register_overrides.erase(tid);
+}
+
+bool
+RemoteThreadState::setInitialRegisters(Dwfl_Thread* thread)
+{
+#ifdef PYSTACK_HAS_REMOTE_THREAD_STATE
+    pid_t tid = dwfl_thread_tid(thread);
+    const ThreadRegisters* regs = nullptr;
+    auto override = d_register_overrides.find(tid);
+    if (override != d_register_overrides.end()) {
+        regs = &override->second;
+    } else {
+        regs = registers(tid);
+    }
+    if (!regs) {
+        return false;
+    }
+
+    if (regs->dwarf_regs.empty()) {
+        // Only the registers needed to find the CFA of a frame are known. The
+        // rest are left undefined.
+        if (!dwfl_thread_state_registers(thread, STACK_POINTER_REGNO, 1, &regs->sp)
+            || !dwfl_thread_state_registers(thread, FRAME_POINTER_REGNO, 1, &regs->fp))
+        {
+            return false;
+        }
+    } else if (!dwfl_thread_state_registers(
+                       thread,
+                       0,
+                       regs->dwarf_regs.size(),
+                       regs->dwarf_regs.data()))
+    {
+        return false;
+    }
+    dwfl_thread_state_register_pc(thread, regs->pc);
+
+    d_current_snapshot = stackSnapshot(tid);
+    return true;
+#else
+    (void)thread;
+    return false;
+#endif
+}
+
+bool
+RemoteThreadState::readMemory(Dwarf_Addr addr, Dwarf_Word* result) const
+{
+    if (d_current_snapshot && d_current_snapshot->read(addr, result)) {
+        return true;
+    }
+    try {
+        d_manager->copyMemoryFromProcess(addr, sizeof(Dwarf_Word), result);
+    } catch (const std::exception& e) {
+        LOG(DEBUG) << std::hex << std::showbase << "Failed to read memory at " << addr
+                   << " while unwinding: " << e.what();
+        return false;
+    }
+    return true;
+}
+
+void
+RemoteThreadState::releaseThread(pid_t tid)
+{
+    d_registers.erase(tid);
+    d_register_overrides.erase(tid);
+    auto it = d_snapshots.find(tid);
+    if (it == d_snapshots.end()) {
+        return;
+    }
+    if (d_current_snapshot == &it->second) {
+        d_current_snapshot = nullptr;
+    }
+    d_snapshots.erase(it);
+}
+
+void
+RemoteThreadState::refresh(std::vector<int> tids, SharedVirtualMaps maps)
+{
+    d_tids = std::move(tids);
+    d_maps = std::move(maps);
+    d_next_thread = 0;
+    d_registers.clear();
+    d_register_overrides.clear();
+    d_snapshots.clear();
+    d_current_snapshot = nullptr;
+}
+
+pid_t
+RemoteThreadState::nextThread(Dwfl*, void* dwfl_arg, void** thread_argp)
+{
+    auto state = static_cast<RemoteThreadState*>(dwfl_arg);
+    if (*thread_argp == nullptr) {
+        state->d_next_thread = 0;
+    }
+    *thread_argp = state;
+    if (state->d_next_thread >= state->d_tids.size()) {
+        return 0;
+    }
+    return state->d_tids[state->d_next_thread++];
+}
+
+bool
+RemoteThreadState::getThread(Dwfl*, pid_t tid, void* dwfl_arg, void** thread_argp)
+{
+    auto state = static_cast<RemoteThreadState*>(dwfl_arg);
+    if (std::find(state->d_tids.begin(), state->d_tids.end(), tid) == state->d_tids.end()) {
+        return false;
+    }
+    *thread_argp = state;
+    return true;
+}
+
+bool
+RemoteThreadState::memoryRead(Dwfl*, Dwarf_Addr addr, Dwarf_Word* result, void* dwfl_arg)
+{
+    return static_cast<const RemoteThreadState*>(dwfl_arg)->readMemory(addr, result);
+}
+
+bool
+RemoteThreadState::setInitialRegistersCallback(Dwfl_Thread* thread, void* thread_arg)
+{
+    try {
+        return static_cast<RemoteThreadState*>(thread_arg)->setInitialRegisters(thread);
+    } catch (const std::exception& e) {
+        LOG(DEBUG) << "Failed to set the initial registers of thread " << dwfl_thread_tid(thread)
+                   << ": " << e.what();
+        return false;
+    }
+}
+
+void
+RemoteThreadState::detach(Dwfl*, void* dwfl_arg)
+{
+    delete static_cast<RemoteThreadState*>(dwfl_arg);
+}
+
+}  // namespace pystack
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+#include <vector>
+
+#include <elfutils/libdwfl.h>
+
+#include "elf_common.h"
+#include "mem.h"
+
+namespace pystack {
+
+// A copy of the live part of a thread's stack, taken with a single read so
+// that the unwinder doesn't need one syscall for every word it inspects.
+// Nothing is logged while taking it: use log() once the thread may run again.
+class StackSnapshot
+{
+  public:
+    // Constructors
+    StackSnapshot() = default;
+    StackSnapshot(pid_t tid, remote_addr_t stack_pointer, const VirtualMaps& maps);
+
+    // Methods
+    bool read(remote_addr_t addr, Dwarf_Word* result) const;
+    bool empty() const;
+    size_t size() const;
+    void log(pid_t tid) const;
+
+  private:
+    // Data members
+    remote_addr_t d_start{0};
+    std::vector<char> d_data;
+    std::string d_error;
+};
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#    define PYSTACK_HAS_REMOTE_THREAD_STATE 1
+#endif
+
+// DWARF numbers of the stack pointer and frame pointer registers.
+#if defined(__x86_64__)
+inline constexpr unsigned STACK_POINTER_REGNO = 7;  // rsp
+inline constexpr unsigned FRAME_POINTER_REGNO = 6;  // rbp
+#elif defined(__aarch64__)
+inline constexpr unsigned STACK_POINTER_REGNO = 31;  // sp
+inline constexpr unsigned FRAME_POINTER_REGNO = 29;  // x29
+#endif
+
+// Register state of a stopped thread.
+struct ThreadRegisters
+{
+    // Registers 0..N in the platform's DWARF numbering. Empty when only the
+    // pc, stack pointer and frame pointer are known.
+    std::vector<Dwarf_Word> dwarf_regs;
+    Dwarf_Word pc{0};
+    Dwarf_Word sp{0};
+    Dwarf_Word fp{0};
+};
+
+// State handed to libdwfl through dwfl_attach_state. It replaces the
+// callbacks installed by dwfl_linux_proc_attach: registers are fetched with a
+// single PTRACE_GETREGSET per thread and stack memory is served from a
+// StackSnapshot, falling back to the (cached) memory manager for any address
+// outside of it. The threads must either be ptrace-stopped by us already, or
+// be stopped individually (see setStopThreadsIndividually).
+class RemoteThreadState
+{
+  public:
+    // Constructors
+    RemoteThreadState(
+            pid_t pid,
+            std::vector<int> tids,
+            const AbstractRemoteMemoryManager* manager,
+            SharedVirtualMaps maps);
+    RemoteThreadState(const RemoteThreadState&) = delete;
+    RemoteThreadState& operator=(const RemoteThreadState&) = delete;
+
+    // Destructors
+    ~RemoteThreadState();
+
+    // Static methods
+
+    // Attaches a new state to the Dwfl, which takes ownership of it. Returns
+    // nullptr if the platform is not supported, in which case libdwfl's own
+    // ptrace based callbacks are used instead.
+    static RemoteThreadState* attach(
+            Dwfl* dwfl,
+            pid_t pid,
+            std::vector<int> tids,
+            const AbstractRemoteMemoryManager* manager,
+            SharedVirtualMaps maps);
+
+    // Methods
+    const ThreadRegisters* registers(pid_t tid);
+    // When set, the process is expected to be running. The registers and the
+    // stack of each thread are then captured by stopping just that thread
+    // with PTRACE_SEIZE and PTRACE_INTERRUPT, and it is resumed right away:
+    // the unwinding itself happens from the captured data.
+    void setStopThreadsIndividually(bool stop_threads_individually);
+    const StackSnapshot* stackSnapshot(pid_t tid);
+    // Makes the next unwind of the thread start from the given registers
+    // instead of the ones the thread is stopped at.
+    void overrideInitialRegisters(pid_t tid, const ThreadRegisters& regs);
+    void clearInitialRegistersOverride(pid_t tid);
+    // Drops everything captured for the thread.
+    void releaseThread(pid_t tid);
+    // Drops everything captured for every thread and starts serving the
+    // given threads of the process, which has been stopped again.
+    void refresh(std::vector<int> tids, SharedVirtualMaps maps);
+
+  private:
+    // Data members
+    pid_t d_pid;
+    std::vector<int> d_tids;
+    size_t d_next_thread{0};
+    const AbstractRemoteMemoryManager* d_manager;
+    SharedVirtualMaps d_maps;
+    elf_unique_ptr d_elf;
+    int d_elf_fd{-1};
+    std::unordered_map<pid_t, std::optional<ThreadRegisters>> d_registers;
+    std::unordered_map<pid_t, ThreadRegisters> d_register_overrides;
+    std::unordered_map<pid_t, StackSnapshot> d_snapshots;
+    const StackSnapshot* d_current_snapshot{nullptr};
+    bool d_stop_threads_individually{false};
+
+    // Methods
+    void captureThread(pid_t tid);
+    bool setInitialRegisters(Dwfl_Thread* thread);
+    bool readMemory(Dwarf_Addr addr, Dwarf_Word* result) const;
+
+    // libdwfl callbacks
+    static pid_t nextThread(Dwfl* dwfl, void* dwfl_arg, void** thread_argp);
+    static bool getThread(Dwfl* dwfl, pid_t tid, void* dwfl_arg, void** thread_argp);
+    static bool memoryRead(Dwfl* dwfl, Dwarf_Addr addr, Dwarf_Word* result, void* dwfl_arg);
+    static bool setInitialRegistersCallback(Dwfl_Thread* thread, void* thread_arg);
+    static void detach(Dwfl* dwfl, void* dwfl_arg);
+
+    static const Dwfl_Thread_Callbacks s_callbacks;
+};
+
+}  // namespace pystack
@@ -0,0 +1,374 @@
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logging.h"
+#include "symbol_cache.h"
+
+namespace pystack {
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'P', 'Y', 'S', 'T', 'K', 'S', 'Y', 'M'};
+const uint32_t CACHE_VERSION = 2;
+const size_t HEADER_SIZE = sizeof(CACHE_MAGIC) + sizeof(CACHE_VERSION);
+// Nothing more is appended to a file once it reaches this size.
+const off_t MAX_CACHE_FILE_SIZE = 256 * 1024 * 1024;
+
+// Record layout (native endianness):
+//
+//   uint32 RECORD_MAGIC
+//   uint32 size of the payload
+//   uint32 CRC-32 of the payload
+// followed by the payload:
+//   uint64 module-relative pc
+//   uint8  whether the frame is an activation
+//   uint16 number of frames
+//   For every frame:
+//     int32 line, int32 column
+//     uint32 length + bytes of the symbol
+//     uint32 length + bytes of the source file path
+const uint32_t RECORD_MAGIC = 0x50534352;
+const size_t RECORD_HEADER_SIZE = 3 * sizeof(uint32_t);
+const size_t RECORD_FIXED_SIZE = sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint16_t);
+
+std::mutex g_caches_mutex;
+std::unordered_map<std::string, std::shared_ptr<SymbolCache>> g_caches_by_build_id;
+
+uint64_t
+makeKey(uint64_t relative_pc, bool is_activation)
+{
+    return (relative_pc << 1) | static_cast<uint64_t>(is_activation);
+}
+
+uint32_t
+crc32(const char* data, size_t size)
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t i = 0; i < table.size(); ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? 0xEDB88320 ^ (value >> 1) : value >> 1;
+            }
+            table[i] = value;
+        }
+        return table;
+    }();
+
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFF;
+}
+
+class RecordReader
+{
+  public:
+    RecordReader(const char* data, size_t size)
+    : d_data(data)
+    , d_size(size)
+    {
+    }
+
+    template<typename T>
+    bool read(T* value)
+    {
+        if (d_size - d_pos < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(value, d_data + d_pos, sizeof(T));
+        d_pos += sizeof(T);
+        return true;
+    }
+
+    bool readString(std::string* value)
+    {
+        uint32_t length;
+        if (!read(&length) || d_size - d_pos < length) {
+            return false;
+        }
+        value->assign(d_data + d_pos, length);
+        d_pos += length;
+        return true;
+    }
+
+  private:
+    const char* d_data;
+    size_t d_size;
+    size_t d_pos{0};
+};
+
+template<typename T>
+void
+append(std::string& buffer, T value)
+{
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+void
+appendString(std::string& buffer, const std::string& value)
+{
+    append<uint32_t>(buffer, value.size());
+    buffer.append(value);
+}
+
+bool
+writeAll(int fd, const std::string& buffer)
+{
+    size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t ret = write(fd, buffer.data() + written, buffer.size() - written);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += ret;
+    }
+    return true;
+}
+
+}  // namespace
+
+SymbolCache::SymbolCache(int fd, const char* data, size_t size)
+: d_fd(fd)
+, d_data(data)
+, d_size(size)
+{
+    buildIndex();
+}
+
+SymbolCache::~SymbolCache()
+{
+    if (d_data) {
+        munmap(const_cast<char*>(d_data), d_size);
+    }
+    close(d_fd);
+}
+
+bool
+SymbolCache::enabled()
+{
+    const char* dir = getenv("PYSTACK_SYMBOL_CACHE_DIR");
+    return dir != nullptr && *dir != '\0';
+}
+
+std::shared_ptr<SymbolCache>
+SymbolCache::forBuildId(const std::string& build_id)
+{
+    if (!enabled() || build_id.empty()) {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(g_caches_mutex);
+    auto it = g_caches_by_build_id.find(build_id);
+    if (it == g_caches_by_build_id.end()) {
+        std::string dir = getenv("PYSTACK_SYMBOL_CACHE_DIR");
+        std::error_code error;
+        std::filesystem::create_directories(dir, error);
+        if (error) {
+            LOG(DEBUG) << "Cannot create symbol cache directory " << dir << ": " << error.message();
+        }
+        it = g_caches_by_build_id.emplace(build_id, open(dir + "/" + build_id + ".symbols")).first;
+    }
+    return it->second;
+}
+
+std::shared_ptr<SymbolCache>
+SymbolCache::open(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOG(DEBUG) << "Cannot open symbol cache " << path << ": " << std::strerror(errno);
+        return nullptr;
+    }
+
+    // Hold the lock while checking the header so that two processes creating
+    // the same file don't both write one.
+    flock(fd, LOCK_EX);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        flock(fd, LOCK_UN);
+        close(fd);
+        return nullptr;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        std::string header(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        append(header, CACHE_VERSION);
+        if (!writeAll(fd, header)) {
+            flock(fd, LOCK_UN);
+            close(fd);
+            return nullptr;
+        }
+        size = header.size();
+    }
+    flock(fd, LOCK_UN);
+
+    void* data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        LOG(DEBUG) << "Cannot map symbol cache " << path << ": " << std::strerror(errno);
+        close(fd);
+        return nullptr;
+    }
+
+    uint32_t version = 0;
+    if (size >= HEADER_SIZE) {
+        std::memcpy(&version, static_cast<char*>(data) + sizeof(CACHE_MAGIC), sizeof(version));
+    }
+    if (version != CACHE_VERSION || std::memcmp(data, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) {
+        LOG(DEBUG) << "Ignoring symbol cache " << path << " with an unknown format";
+        munmap(data, size);
+        close(fd);
+        return nullptr;
+    }
+
+    LOG(DEBUG) << "Using symbol cache " << path << " (" << size << " bytes)";
+    return std::shared_ptr<SymbolCache>(new SymbolCache(fd, static_cast<const char*>(data), size));
+}
+
+void
+SymbolCache::buildIndex()
+{
+    size_t offset = HEADER_SIZE;
+    size_t skipped = 0;
+    while (d_size - offset >= RECORD_HEADER_SIZE + RECORD_FIXED_SIZE) {
+        uint32_t magic;
+        uint32_t payload_size;
+        uint32_t crc;
+        std::memcpy(&magic, d_data + offset, sizeof(magic));
+        std::memcpy(&payload_size, d_data + offset + sizeof(uint32_t), sizeof(payload_size));
+        std::memcpy(&crc, d_data + offset + 2 * sizeof(uint32_t), sizeof(crc));
+        size_t payload_start = offset + RECORD_HEADER_SIZE;
+        bool valid = magic == RECORD_MAGIC && payload_size >= RECORD_FIXED_SIZE
+                     && d_size - payload_start >= payload_size
+                     && crc32(d_data + payload_start, payload_size) == crc;
+        if (!valid) {
+            // A write cut short (by a crash or a full disk) leaves part of a
+            // record behind, and other processes keep appending after it, so
+            // look for the start of the next record.
+            const void* next = memmem(
+                    d_data + offset + 1,
+                    d_size - offset - 1,
+                    &RECORD_MAGIC,
+                    sizeof(RECORD_MAGIC));
+            if (!next) {
+                skipped += d_size - offset;
+                break;
+            }
+            size_t next_offset = static_cast<const char*>(next) - d_data;
+            skipped += next_offset - offset;
+            offset = next_offset;
+            continue;
+        }
+        RecordReader reader(d_data + payload_start, payload_size);
+        uint64_t relative_pc;
+        uint8_t is_activation;
+        reader.read(&relative_pc);
+        reader.read(&is_activation);
+        d_index.emplace(makeKey(relative_pc, is_activation), offset);
+        offset = payload_start + payload_size;
+    }
+    if (skipped) {
+        LOG(DEBUG) << "Skipped " << skipped << " corrupted bytes in the symbol cache";
+    }
+    LOG(DEBUG) << "Loaded " << d_index.size() << " entries from the symbol cache";
+}
+
+bool
+SymbolCache::lookup(
+        uint64_t relative_pc,
+        bool is_activation,
+        const std::string& library,
+        std::vector<NativeFrame>* frames) const
+{
+    auto it = d_index.find(makeKey(relative_pc, is_activation));
+    if (it == d_index.end()) {
+        return false;
+    }
+
+    uint32_t payload_size;
+    std::memcpy(&payload_size, d_data + it->second + sizeof(uint32_t), sizeof(payload_size));
+    RecordReader reader(d_data + it->second + RECORD_HEADER_SIZE, payload_size);
+    uint64_t stored_pc;
+    uint8_t stored_activation;
+    uint16_t count;
+    reader.read(&stored_pc);
+    reader.read(&stored_activation);
+    reader.read(&count);
+
+    std::vector<NativeFrame> result;
+    result.reserve(count);
+    for (uint16_t i = 0; i < count; ++i) {
+        NativeFrame frame{0, "", "", 0, 0, library};
+        int32_t line;
+        int32_t column;
+        if (!reader.read(&line) || !reader.read(&column) || !reader.readString(&frame.symbol)
+            || !reader.readString(&frame.path))
+        {
+            LOG(DEBUG) << "Ignoring corrupted symbol cache record";
+            return false;
+        }
+        frame.linenumber = line;
+        frame.colnumber = column;
+        result.push_back(std::move(frame));
+    }
+    *frames = std::move(result);
+    return true;
+}
+
+void
+SymbolCache::store(uint64_t relative_pc, bool is_activation, const std::vector<NativeFrame>& frames)
+{
+    if (frames.empty() || frames.size() > UINT16_MAX) {
+        return;
+    }
+
+    std::string record;
+    append<uint32_t>(record, RECORD_MAGIC);
+    append<uint32_t>(record, 0);
+    append<uint32_t>(record, 0);
+    append<uint64_t>(record, relative_pc);
+    append<uint8_t>(record, is_activation);
+    append<uint16_t>(record, frames.size());
+    for (const auto& frame : frames) {
+        append<int32_t>(record, frame.linenumber);
+        append<int32_t>(record, frame.colnumber);
+        appendString(record, frame.symbol);
+        appendString(record, frame.path);
+    }
+    uint32_t payload_size = record.size() - RECORD_HEADER_SIZE;
+    uint32_t crc = crc32(record.data() + RECORD_HEADER_SIZE, payload_size);
+    std::memcpy(record.data() + sizeof(uint32_t), &payload_size, sizeof(payload_size));
+    std::memcpy(record.data() + 2 * sizeof(uint32_t), &crc, sizeof(crc));
+
+    // The file is opened with O_APPEND, and the lock keeps records written by
+    // other processes from interleaving with ours.
+    std::lock_guard<std::mutex> lock(d_write_mutex);
+    flock(d_fd, LOCK_EX);
+    struct stat st;
+    if (fstat(d_fd, &st) != 0) {
+        LOG(DEBUG) << "Cannot stat the symbol cache: " << std::strerror(errno);
+    } else if (st.st_size + static_cast<off_t>(record.size()) > MAX_CACHE_FILE_SIZE) {
+        LOG(DEBUG) << "The symbol cache is full, not adding more entries to it";
+    } else if (!writeAll(d_fd, record)) {
+        LOG(DEBUG) << "Failed to write to the symbol cache: " << std::strerror(errno);
+        // Don't leave part of the record behind
+        if (ftruncate(d_fd, st.st_size) != 0) {
+            LOG(DEBUG) << "Failed to truncate the symbol cache: " << std::strerror(errno);
+        }
+    }
+    flock(d_fd, LOCK_UN);
+}
+
+}  // namespace pystack
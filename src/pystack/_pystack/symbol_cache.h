@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "native_frame.h"
+
+namespace pystack {
+
+// Persistent cache of symbolized native frames for a single build id.
+//
+// The cache is stored as one file per build id inside the directory named by
+// the PYSTACK_SYMBOL_CACHE_DIR environment variable. Each file starts with a
+// small header followed by append-only records, each holding the fully
+// expanded (inline chain included) frames for a module-relative pc. Files are
+// memory-mapped when opened and new records are appended under an exclusive
+// lock, so several pystack processes can share the same directory. Every
+// record carries a magic number and a checksum, so that what an interrupted
+// write left behind is skipped rather than misread.
+class SymbolCache
+{
+  public:
+    // Constructors
+    SymbolCache(const SymbolCache&) = delete;
+    SymbolCache& operator=(const SymbolCache&) = delete;
+
+    // Destructors
+    ~SymbolCache();
+
+    // Static methods
+    static bool enabled();
+    static std::shared_ptr<SymbolCache> forBuildId(const std::string& build_id);
+
+    // Methods
+    bool lookup(
+            uint64_t relative_pc,
+            bool is_activation,
+            const std::string& library,
+            std::vector<NativeFrame>* frames) const;
+    void store(uint64_t relative_pc, bool is_activation, const std::vector<NativeFrame>& frames);
+
+  private:
+    // Constructors
+    SymbolCache(int fd, const char* data, size_t size);
+
+    // Data members
+    int d_fd;
+    const char* d_data;
+    size_t d_size;
+    std::unordered_map<uint64_t, size_t> d_index;  // Offset of each record
+    std::mutex d_write_mutex;
+
+    // Methods
+    static std::shared_ptr<SymbolCache> open(const std::string& path);
+    void buildIndex();
+};
+
+}  // namespace pystack
@@ -1,10 +1,15 @@
 #include "thread_builder.h"
 
+#include <algorithm>
 #include <cstdint>
+#include <fnmatch.h>
+#include <unordered_set>
 
+#include "deadline.h"
 #include "interpreter.h"
 #include "logging.h"
 #include "maps_parser.h"
+#include "timing.h"
 
 namespace pystack {
 
@@ -18,13 +23,57 @@ enum StackMethodFlag {
     METHOD_DEBUG_OFFSETS = 1 << 5,
 };
 
+bool
+ThreadFilter::empty() const
+{
+    return !tids && !name_pattern && !gil_holder_only && !gc_collecting_only;
+}
+
+bool
+ThreadFilter::matches(pid_t pid, int tid, int gil_status, int gc_status) const
+{
+    if (tids && !tids->count(tid)) {
+        return false;
+    }
+    if (gil_holder_only && gil_status != PyThread::GilStatus::HELD) {
+        return false;
+    }
+    // Same rule as the one used to report a thread as garbage collecting
+    if (gc_collecting_only
+        && (gc_status != PyThread::GCStatus::COLLECTING || gil_status == PyThread::GilStatus::NOT_HELD))
+    {
+        return false;
+    }
+    if (name_pattern) {
+        auto name = getThreadName(pid, tid);
+        if (!name || fnmatch(name_pattern->c_str(), name->c_str(), 0) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace {
+
+bool
+nativeStackTruncated(pid_t tid)
+{
+    Deadline* deadline = Deadline::current();
+    return deadline && deadline->threadTruncated(tid);
+}
+
+}  // namespace
+
 std::vector<PyFrameData>
-buildFrameStack(FrameObject* first_frame, bool resolve_locals)
+buildFrameStack(FrameObject* first_frame, bool resolve_locals, bool* complete)
 {
+    ScopedTimer timer("frame_decode");
     std::vector<PyFrameData> frames;
     FrameObject* current_frame = first_frame;
+    bool skipped = false;
 
     while (current_frame != nullptr) {
+        skipped = skipped || current_frame->Truncated();
         auto code = current_frame->Code();
         // Skip frames without code (shim frames) or with unreadable code ("???")
         if (!code || code->Filename() == "???") {
@@ -33,6 +82,11 @@ buildFrameStack(FrameObject* first_frame, bool resolve_locals)
             continue;
         }
 
+        if (resolve_locals && Deadline::expired()) {
+            LOG(DEBUG) << "Deadline passed, not resolving the remaining local variables";
+            resolve_locals = false;
+            skipped = true;
+        }
         if (resolve_locals) {
             current_frame->resolveLocalVariables();
         }
@@ -52,6 +106,9 @@ buildFrameStack(FrameObject* first_frame, bool resolve_locals)
         current_frame = prev.get();
     }
 
+    if (skipped && complete) {
+        *complete = false;
+    }
     return frames;
 }
 
@@ -64,6 +121,7 @@ buildPythonThread(
         bool resolve_locals,
         int64_t interpreter_id)
 {
+    ScopedTimer timer("thread_walk");
     PyThreadData data;
     data.tid = thread->Tid();
     data.name = getThreadName(pid, thread->Tid());
@@ -74,9 +132,11 @@ buildPythonThread(
         thread->populateNativeStackTrace(manager);
     }
 
+    thread->decodeFrames(manager);
+    data.complete = thread->framesDecoded();
     auto first_frame = thread->FirstFrame();
     if (first_frame) {
-        data.frames = buildFrameStack(first_frame.get(), resolve_locals);
+        data.frames = buildFrameStack(first_frame.get(), resolve_locals, &data.complete);
     }
 
     const auto& native_frames = thread->NativeFrames();
@@ -112,32 +172,125 @@ buildNativeThread(const std::shared_ptr<AbstractProcessManager>& manager, pid_t
     return data;
 }
 
+std::vector<PyThreadData>
+buildNativeThreads(
+        const std::shared_ptr<AbstractProcessManager>& manager,
+        pid_t pid,
+        const std::vector<int>& tids)
+{
+    LOG(INFO) << "Constructing " << tids.size() << " native threads";
+    auto native_frames_by_tid = manager->unwindThreads(tids);
+
+    std::vector<PyThreadData> threads;
+    for (int tid : tids) {
+        PyThreadData data;
+        data.tid = tid;
+        data.name = getThreadName(pid, tid);
+        data.gil_status = 0;  // NOT_HELD
+        data.gc_status = 0;  // NOT_COLLECTING
+        data.interpreter_id = 0;  // No Python stack for this thread means no interpreter
+        data.stack_anchor = 0;  // and no stack anchor.
+
+        auto native_frames = native_frames_by_tid.find(tid);
+        if (native_frames != native_frames_by_tid.end()) {
+            data.native_frames.assign(native_frames->second.rbegin(), native_frames->second.rend());
+        }
+        if (native_frames == native_frames_by_tid.end() || nativeStackTruncated(tid)) {
+            data.complete = false;  // Skipped or cut short because the deadline passed
+        }
+        threads.push_back(std::move(data));
+    }
+    return threads;
+}
+
 std::vector<PyThreadData>
 buildThreadsFromInterpreter(
         const std::shared_ptr<AbstractProcessManager>& manager,
         remote_addr_t interpreter_head,
         pid_t pid,
         bool add_native_traces,
-        bool resolve_locals)
+        bool resolve_locals,
+        const ThreadFilter& filter)
 {
     LOG(INFO) << "Fetching Python threads";
     std::vector<PyThreadData> threads;
 
-    auto thread = getThreadFromInterpreterState(manager, interpreter_head);
-    int64_t interpreter_id = InterpreterUtils::getInterpreterId(manager, interpreter_head);
-    PyThread* current_thread = thread.get();
+    std::shared_ptr<PyThread> thread;
+    int64_t interpreter_id;
+    {
+        ScopedTimer timer("thread_walk");
+        thread = getThreadFromInterpreterState(manager, interpreter_head);
+        interpreter_id = InterpreterUtils::getInterpreterId(manager, interpreter_head);
+    }
+
+    // When the deadline is tight, the thread holding the GIL is the one most
+    // worth reporting, so its frames are decoded and unwound first. The
+    // threads are still reported in the order the interpreter lists them.
+    std::vector<PyThread*> by_priority;
+    for (PyThread* current = thread.get(); current != nullptr; current = current->NextThread().get()) {
+        if (!filter.matches(pid, current->Tid(), current->isGilHolder(), current->isGCCollecting())) {
+            LOG(DEBUG) << "Skipping thread " << current->Tid() << " as it was not selected";
+            continue;
+        }
+        by_priority.push_back(current);
+    }
+    std::stable_partition(by_priority.begin(), by_priority.end(), [](PyThread* current) {
+        return current->isGilHolder() == PyThread::GilStatus::HELD;
+    });
+
+    {
+        ScopedTimer timer("thread_walk");
+        for (PyThread* current : by_priority) {
+            current->decodeFrames(manager);
+        }
+    }
 
-    while (current_thread != nullptr) {
-        threads.push_back(buildPythonThread(
+    std::unordered_set<PyThread*> missing_native_frames;
+    if (add_native_traces) {
+        // Unwind all the threads together so that their native frames are
+        // symbolized in a single batch.
+        std::vector<pid_t> tids;
+        for (PyThread* current : by_priority) {
+            tids.push_back(current->Tid());
+        }
+        auto native_frames_by_tid = manager->unwindThreads(tids);
+        for (PyThread* current : by_priority) {
+            auto native_frames = native_frames_by_tid.find(current->Tid());
+            if (native_frames != native_frames_by_tid.end()) {
+                current->setNativeStackTrace(native_frames->second);
+            } else {
+                missing_native_frames.insert(current);
+            }
+        }
+    }
+
+    std::unordered_map<PyThread*, PyThreadData> data_by_thread;
+    for (PyThread* current : by_priority) {
+        PyThreadData data = buildPythonThread(
                 manager,
-                current_thread,
+                current,
                 pid,
-                add_native_traces,
+                /* add_native_traces = */ false,
                 resolve_locals,
-                interpreter_id));
+                interpreter_id);
+        if (missing_native_frames.count(current) || nativeStackTruncated(current->Tid())) {
+            data.complete = false;
+        }
+        data_by_thread.emplace(current, std::move(data));
+    }
 
-        auto next = current_thread->NextThread();
-        current_thread = next.get();
+    bool later_threads_skipped = false;
+    for (PyThread* current = thread.get(); current != nullptr; current = current->NextThread().get()) {
+        later_threads_skipped = current->laterThreadsSkipped();
+        auto data = data_by_thread.find(current);
+        if (data != data_by_thread.end()) {
+            threads.push_back(std::move(data->second));
+        }
+    }
+    // Nothing is known about the threads that the walk didn't reach, so the
+    // last one reported stands for them.
+    if (later_threads_skipped && !threads.empty()) {
+        threads.back().complete = false;
     }
 
     return threads;
@@ -146,6 +299,7 @@ buildThreadsFromInterpreter(
 remote_addr_t
 getInterpreterStateAddr(AbstractProcessManager* manager, int method_flags)
 {
+    ScopedTimer timer("interpreter_discovery");
     remote_addr_t head = 0;
 
     struct MethodInfo
@@ -176,6 +330,10 @@ getInterpreterStateAddr(AbstractProcessManager* manager, int method_flags)
         if ((method_flags & method.flag) == 0) {
             continue;
         }
+        if (Deadline::expired()) {
+            LOG(WARNING) << "Deadline passed, not looking for PyInterpreterState any further";
+            break;
+        }
 
         try {
             head = method.func();
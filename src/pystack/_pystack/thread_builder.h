@@ -3,7 +3,9 @@
 #include <memory>
 #include <optional>
 #include <string>
+#include <sys/types.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "maps_parser.h"
@@ -41,6 +43,21 @@ struct PyThreadData
     int gc_status;  // -1 = unknown, 0 = not collecting, 1 = collecting
     int64_t interpreter_id;
     remote_addr_t stack_anchor;
+    bool complete{true};  // false if part of the thread was skipped because the deadline passed
+};
+
+// Selects the threads to report. Everything it looks at is known as soon as
+// the interpreter's thread list has been walked, so the threads it rejects are
+// never decoded nor unwound.
+struct ThreadFilter
+{
+    std::optional<std::unordered_set<int>> tids;
+    std::optional<std::string> name_pattern;  // fnmatch(3) glob matched against the thread name
+    bool gil_holder_only{false};
+    bool gc_collecting_only{false};
+
+    bool empty() const;
+    bool matches(pid_t pid, int tid, int gil_status, int gc_status) const;
 };
 
 std::vector<PyThreadData>
@@ -49,7 +66,8 @@ buildThreadsFromInterpreter(
         remote_addr_t interpreter_head,
         pid_t pid,
         bool add_native_traces,
-        bool resolve_locals);
+        bool resolve_locals,
+        const ThreadFilter& filter = {});
 
 PyThreadData
 buildPythonThread(
@@ -63,8 +81,16 @@ buildPythonThread(
 PyThreadData
 buildNativeThread(const std::shared_ptr<AbstractProcessManager>& manager, pid_t pid, pid_t tid);
 
+std::vector<PyThreadData>
+buildNativeThreads(
+        const std::shared_ptr<AbstractProcessManager>& manager,
+        pid_t pid,
+        const std::vector<int>& tids);
+
+// Sets *complete to false if some frames or local variables were skipped
+// because the deadline passed.
 std::vector<PyFrameData>
-buildFrameStack(FrameObject* first_frame, bool resolve_locals);
+buildFrameStack(FrameObject* first_frame, bool resolve_locals, bool* complete = nullptr);
 
 remote_addr_t
 getInterpreterStateAddr(AbstractProcessManager* manager, int method_flags);
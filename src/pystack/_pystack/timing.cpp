@@ -0,0 +1,111 @@
+#include <algorithm>
+
+#include "timing.h"
+
+namespace pystack {
+
+namespace {
+
+thread_local TimingReport* t_current_report = nullptr;
+thread_local ScopedTimer* t_current_timer = nullptr;
+
+}  // namespace
+
+TimingReport::Activation::Activation(TimingReport* report)
+: d_previous(t_current_report)
+{
+    t_current_report = report;
+}
+
+TimingReport::Activation::~Activation()
+{
+    t_current_report = d_previous;
+}
+
+TimingReport*
+TimingReport::current()
+{
+    return t_current_report;
+}
+
+void
+TimingReport::addPhase(const char* phase, Clock::duration duration)
+{
+    auto it = std::find_if(d_phases.begin(), d_phases.end(), [&](const auto& entry) {
+        return entry.first == phase;
+    });
+    if (it == d_phases.end()) {
+        d_phases.emplace_back(phase, duration);
+    } else {
+        it->second += duration;
+    }
+}
+
+void
+TimingReport::recordTargetStopped(Clock::duration duration)
+{
+    d_target_stopped = std::max(d_target_stopped.value_or(duration), duration);
+}
+
+void
+TimingReport::recordStopSkew(Clock::duration duration)
+{
+    d_stop_skew = std::max(d_stop_skew.value_or(duration), duration);
+}
+
+const TimingReport::Phases&
+TimingReport::phases() const
+{
+    return d_phases;
+}
+
+TimingReport::Clock::duration
+TimingReport::total() const
+{
+    return Clock::now() - d_start;
+}
+
+std::optional<TimingReport::Clock::duration>
+TimingReport::targetStopped() const
+{
+    return d_target_stopped;
+}
+
+std::optional<TimingReport::Clock::duration>
+TimingReport::stopSkew() const
+{
+    return d_stop_skew;
+}
+
+ScopedTimer::ScopedTimer(const char* phase)
+: d_phase(phase)
+, d_report(TimingReport::current())
+{
+    if (!d_report) {
+        return;
+    }
+    d_start = TimingReport::Clock::now();
+    d_parent = t_current_timer;
+    if (d_parent) {
+        d_parent->d_elapsed += d_start - d_parent->d_start;
+    }
+    t_current_timer = this;
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (!d_report) {
+        return;
+    }
+    auto now = TimingReport::Clock::now();
+    d_elapsed += now - d_start;
+    if (d_report == TimingReport::current()) {
+        d_report->addPhase(d_phase, d_elapsed);
+    }
+    t_current_timer = d_parent;
+    if (d_parent) {
+        d_parent->d_start = now;
+    }
+}
+
+}  // namespace pystack
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <chrono>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace pystack {
+
+// Wall-clock time spent in each phase of gathering the stacks of a process,
+// together with how long the target process was kept stopped.
+//
+// A report only collects timings while it is activated on a thread, and only
+// from ScopedTimer instances created on that same thread.
+class TimingReport
+{
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Phases = std::vector<std::pair<std::string, Clock::duration>>;
+
+    // Makes a report the current one for the calling thread while alive.
+    class Activation
+    {
+      public:
+        // Constructors
+        explicit Activation(TimingReport* report);
+        Activation(const Activation&) = delete;
+        Activation& operator=(const Activation&) = delete;
+
+        // Destructors
+        ~Activation();
+
+      private:
+        // Data members
+        TimingReport* d_previous;
+    };
+
+    // Static methods
+    static TimingReport* current();
+
+    // Methods
+    void addPhase(const char* phase, Clock::duration duration);
+    // Called with the time between stopping and resuming the target. When
+    // several stops are recorded (e.g. a ptrace attach inside a cgroup
+    // freeze), the longest one is reported.
+    void recordTargetStopped(Clock::duration duration);
+    void recordStopSkew(Clock::duration duration);
+
+    // Phases in the order they first ran.
+    const Phases& phases() const;
+    Clock::duration total() const;
+    std::optional<Clock::duration> targetStopped() const;
+    std::optional<Clock::duration> stopSkew() const;
+
+  private:
+    // Data members
+    Clock::time_point d_start{Clock::now()};
+    Phases d_phases;
+    std::optional<Clock::duration> d_target_stopped;
+    std::optional<Clock::duration> d_stop_skew;
+};
+
+// Adds the time until it's destroyed to a phase of the current report, if
+// there is one. Timers nest, and the time spent in an inner timer is not
+// counted in the enclosing one, so phases never overlap.
+class ScopedTimer
+{
+  public:
+    // Constructors
+    explicit ScopedTimer(const char* phase);
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    // Destructors
+    ~ScopedTimer();
+
+  private:
+    // Data members
+    const char* d_phase;
+    TimingReport* d_report;
+    ScopedTimer* d_parent{nullptr};
+    TimingReport::Clock::time_point d_start;
+    TimingReport::Clock::duration d_elapsed{0};
+};
+
+}  // namespace pystack
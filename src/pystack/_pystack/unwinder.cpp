@@ -1,18 +1,29 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <cxxabi.h>
+#include <exception>
 #include <functional>
+#include <map>
 #include <optional>
+#include <set>
+#include <thread>
 #include <unistd.h>
+#include <unordered_set>
 #include <utility>
 
 #include <dwarf.h>
 
+#include "deadline.h"
 #include "elf_common.h"
 #include "logging.h"
 #include "mem.h"
 #include "native_frame.h"
+#include "stack_snapshot.h"
+#include "symbol_cache.h"
+#include "timing.h"
 #include "unwinder.h"
 
 namespace pystack {
@@ -22,6 +33,7 @@ ModuleCuDieRanges::CuDieRanges::CuDieRanges(Dwfl_Module* mod)
         return;
     }
 
+    std::vector<CuDieRange> ranges;
     Dwarf_Die* die = nullptr;
     Dwarf_Addr bias = 0;
     while ((die = dwfl_module_nextcu(mod, die, &bias))) {
@@ -30,18 +42,45 @@ ModuleCuDieRanges::CuDieRanges::CuDieRanges(Dwfl_Module* mod)
         Dwarf_Addr base = 0;
         ptrdiff_t offset = 0;
         while ((offset = dwarf_ranges(die, offset, &base, &low, &high)) > 0) {
-            d_ranges.push_back(CuDieRange{die, bias, low + bias, high + bias});
+            if (low < high) {
+                ranges.push_back(CuDieRange{die, bias, low + bias, high + bias});
+            }
+        }
+    }
+
+    // Build a table of disjoint ranges sorted by address so lookups can use a
+    // binary search. Contiguous ranges of the same CU are merged, and when
+    // ranges of different CUs overlap the one that starts first wins.
+    std::stable_sort(ranges.begin(), ranges.end(), [](const CuDieRange& a, const CuDieRange& b) {
+        return a.low < b.low;
+    });
+    d_ranges.reserve(ranges.size());
+    for (CuDieRange& range : ranges) {
+        if (!d_ranges.empty()) {
+            CuDieRange& last = d_ranges.back();
+            if (range.high <= last.high) {
+                continue;
+            }
+            if (range.low <= last.high && range.cuDie == last.cuDie && range.bias == last.bias) {
+                last.high = range.high;
+                continue;
+            }
+            range.low = std::max(range.low, last.high);
         }
+        d_ranges.push_back(range);
     }
+    d_ranges.shrink_to_fit();
 }
 
 Dwarf_Die*
 ModuleCuDieRanges::CuDieRanges::findDie(Dwarf_Addr addr, Dwarf_Addr* bias) const
 {
-    auto it = std::find_if(d_ranges.begin(), d_ranges.end(), [addr](const CuDieRange& range) {
-        return range.contains(addr);
-    });
-    if (it == d_ranges.end()) {
+    auto it = std::upper_bound(
+            d_ranges.begin(),
+            d_ranges.end(),
+            addr,
+            [](Dwarf_Addr addr, const CuDieRange& range) { return addr < range.low; });
+    if (it == d_ranges.begin() || !(--it)->contains(addr)) {
         return nullptr;
     }
 
@@ -79,6 +118,10 @@ static int
 frameCallback(Dwfl_Frame* state, void* arg)
 {
     auto* frames = static_cast<std::vector<Frame>*>(arg);
+    if (Deadline::expired()) {
+        LOG(DEBUG) << "Deadline passed, not unwinding past frame " << frames->size();
+        return DWARF_CB_ABORT;
+    }
     Dwarf_Addr pc;
     bool isActivation;
     if (!dwfl_frame_pc(state, &pc, &isActivation)) {
@@ -292,48 +335,161 @@ AbstractUnwinder::getNonInlineSymbolName(Dwfl_Module* mod, Dwarf_Addr pc) const
     return raw_symname;
 }
 
+AbstractUnwinder::SymbolizedFrameKey
+AbstractUnwinder::frameKey(const Frame& frame, Dwfl_Module** mod, const char** mod_name) const
+{
+    Dwarf_Addr pc_adjusted = frame.pc - (frame.isActivation ? 0 : 1);
+    *mod = dwfl_addrmodule(Dwfl(), pc_adjusted);
+    Dwarf_Addr mod_start = 0;
+    *mod_name = dwfl_module_info(*mod, nullptr, &mod_start, nullptr, nullptr, nullptr, nullptr, nullptr)
+                        ?: "???";
+    // Loading debug information can take arbitrarily long, so once the
+    // deadline has passed frames are only resolved using the symbol tables.
+    // The key records how a frame was resolved, so that a degraded result is
+    // never served when full information was asked for.
+    bool symbols_only = d_symbols_only || Deadline::expired();
+    return {*mod, frame.pc - mod_start, frame.isActivation, symbols_only};
+}
+
+const std::vector<NativeFrame>&
+AbstractUnwinder::resolveFrame(const Frame& frame) const
+{
+    Dwarf_Addr pc = frame.pc;
+    bool isactivation = frame.isActivation;
+    Dwarf_Addr pc_adjusted = pc - (isactivation ? 0 : 1);
+
+    Dwfl_Module* mod;
+    const char* mod_name;
+    // The same call sites show up over and over again in different threads,
+    // so the fully expanded frames are memoized per module and module-relative
+    // pc.
+    const SymbolizedFrameKey key = frameKey(frame, &mod, &mod_name);
+    auto it = d_symbolized_frames_cache.find(key);
+    if (it != d_symbolized_frames_cache.end()) {
+        LOG(DEBUG) << std::hex << std::showbase << "Using cached native information for frame @ " << pc;
+        return it->second;
+    }
+
+    std::vector<NativeFrame> symbolized;
+    SymbolCache* persistent_cache = key.symbolsOnly ? nullptr : persistentSymbolCache(mod);
+    if (key.symbolsOnly) {
+        symbolizeFrameFromSymbols(symbolized, mod, mod_name, pc);
+    } else if (persistent_cache
+               && persistent_cache->lookup(key.relative_pc, isactivation, mod_name, &symbolized))
+    {
+        LOG(DEBUG) << std::hex << std::showbase
+                   << "Using persistent cached native information for frame @ " << pc;
+    } else if (symbolizeFrame(symbolized, mod, mod_name, pc, pc_adjusted) && persistent_cache) {
+        persistent_cache->store(key.relative_pc, isactivation, symbolized);
+    }
+    return d_symbolized_frames_cache.emplace(key, std::move(symbolized)).first->second;
+}
+
+std::optional<Dwarf_Addr>
+AbstractUnwinder::unresolvedFrameModule(const Frame& frame) const
+{
+    Dwfl_Module* mod;
+    const char* mod_name;
+    const SymbolizedFrameKey key = frameKey(frame, &mod, &mod_name);
+    if (d_symbolized_frames_cache.find(key) != d_symbolized_frames_cache.end()) {
+        return std::nullopt;
+    }
+    return frame.pc - key.relative_pc;
+}
+
+void
+AbstractUnwinder::storeResolvedFrame(const Frame& frame, std::vector<NativeFrame> native_frames) const
+{
+    Dwfl_Module* mod;
+    const char* mod_name;
+    d_symbolized_frames_cache.emplace(frameKey(frame, &mod, &mod_name), std::move(native_frames));
+}
+
 std::vector<NativeFrame>
 AbstractUnwinder::gatherFrames(const std::vector<Frame>& frames) const
 {
+    ScopedTimer timer("symbolization");
     std::vector<NativeFrame> native_frames;
     for (auto& frame : frames) {
-        LOG(DEBUG) << std::hex << std::showbase << "Resolving native information for frame @ "
-                   << frame.pc;
-        Dwarf_Addr pc = frame.pc;
-        bool isactivation = frame.isActivation;
-        Dwarf_Addr pc_adjusted = pc - (isactivation ? 0 : 1);
-
-        Dwfl_Module* mod = dwfl_addrmodule(Dwfl(), pc_adjusted);
-        const char* mod_name =
-                dwfl_module_info(mod, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr)
-                        ?: "???";
-        assert(mod_name != nullptr);
-        LOG(DEBUG) << "Module identified for pc " << std::hex << std::showbase << pc << ": " << mod_name;
-        const char* raw_symname = getNonInlineSymbolName(mod, pc);
-        if (!raw_symname) {
-            LOG(DEBUG) << std::hex << std::showbase << "Non-inline symbol name could not be resolved @ "
-                       << pc;
-            // Add frame with unknown symbol rather than skipping it
-            native_frames.push_back({pc, "???", mod_name, 0, 0, mod_name});
-            continue;
+        for (const NativeFrame& native_frame : resolveFrame(frame)) {
+            native_frames.push_back(native_frame);
+            native_frames.back().address = frame.pc;
         }
+    }
+    return native_frames;
+}
 
-        const std::string noninline_symbol = raw_symname;
-
-        Dwarf_Addr bias = 0;
-        Dwarf_Die* cudie = dwarfModuleAddrDie(pc_adjusted, mod, &bias);
-        if (!cudie) {
-            LOG(DEBUG) << std::hex << std::showbase << "Main compilation unit for pc " << pc << " ("
-                       << noninline_symbol << ")"
-                       << " could not be found";
-            native_frames.push_back({pc, demangleSymbol(noninline_symbol), "???", 0, 0, mod_name});
-            continue;
+SymbolCache*
+AbstractUnwinder::persistentSymbolCache(Dwfl_Module* mod) const
+{
+    if (!mod || !SymbolCache::enabled()) {
+        return nullptr;
+    }
+    auto it = d_persistent_symbol_caches.find(mod);
+    if (it == d_persistent_symbol_caches.end()) {
+        std::shared_ptr<SymbolCache> cache;
+        const unsigned char* build_id = nullptr;
+        GElf_Addr build_id_vaddr = 0;
+        int build_id_len = dwfl_module_build_id(mod, &build_id, &build_id_vaddr);
+        if (build_id_len > 0) {
+            cache = SymbolCache::forBuildId(buildIdPtrToString(build_id, build_id_len));
         }
+        it = d_persistent_symbol_caches.emplace(mod, std::move(cache)).first;
+    }
+    return it->second.get();
+}
 
-        const auto pc_corrected = pc_adjusted - bias;
-        gatherInlineFrames(native_frames, noninline_symbol, pc, pc_corrected, cudie, mod_name);
+bool
+AbstractUnwinder::symbolizeFrame(
+        std::vector<NativeFrame>& native_frames,
+        Dwfl_Module* mod,
+        const char* mod_name,
+        Dwarf_Addr pc,
+        Dwarf_Addr pc_adjusted) const
+{
+    LOG(DEBUG) << std::hex << std::showbase << "Resolving native information for frame @ " << pc;
+    assert(mod_name != nullptr);
+    LOG(DEBUG) << "Module identified for pc " << std::hex << std::showbase << pc << ": " << mod_name;
+    const char* raw_symname = getNonInlineSymbolName(mod, pc);
+    if (!raw_symname) {
+        LOG(DEBUG) << std::hex << std::showbase << "Non-inline symbol name could not be resolved @ "
+                   << pc;
+        // Add frame with unknown symbol rather than skipping it
+        native_frames.push_back({pc, "???", mod_name, 0, 0, mod_name});
+        return false;
     }
-    return native_frames;
+
+    const std::string noninline_symbol = raw_symname;
+
+    Dwarf_Addr bias = 0;
+    Dwarf_Die* cudie = dwarfModuleAddrDie(pc_adjusted, mod, &bias);
+    if (!cudie) {
+        LOG(DEBUG) << std::hex << std::showbase << "Main compilation unit for pc " << pc << " ("
+                   << noninline_symbol << ")"
+                   << " could not be found";
+        native_frames.push_back({pc, demangleSymbol(noninline_symbol), "???", 0, 0, mod_name});
+        return false;
+    }
+
+    const auto pc_corrected = pc_adjusted - bias;
+    return gatherInlineFrames(native_frames, noninline_symbol, pc, pc_corrected, cudie, mod_name)
+           == StatusCode::SUCCESS;
+}
+
+void
+AbstractUnwinder::symbolizeFrameFromSymbols(
+        std::vector<NativeFrame>& native_frames,
+        Dwfl_Module* mod,
+        const char* mod_name,
+        Dwarf_Addr pc) const
+{
+    const char* raw_symname = mod ? getNonInlineSymbolName(mod, pc) : nullptr;
+    if (!raw_symname) {
+        LOG(DEBUG) << std::hex << std::showbase << "Symbol name could not be resolved @ " << pc;
+        native_frames.push_back({pc, "???", mod_name, 0, 0, mod_name});
+        return;
+    }
+    native_frames.push_back({pc, demangleSymbol(raw_symname), "???", 0, 0, mod_name});
 }
 
 Dwarf_Die*
@@ -352,9 +508,8 @@ AbstractUnwinder::dwarfModuleAddrDie(Dwarf_Addr pc_adjusted, Dwfl_Module* mod, D
 
 struct ModuleArg
 {
-    const char* symbol;
     const char* modulename;
-    remote_addr_t addr;
+    std::vector<Dwfl_Module*> modules;
 };
 
 static int
@@ -366,42 +521,110 @@ module_callback(
         void* arg)
 {
     auto module_arg = static_cast<ModuleArg*>(arg);
-    //    std::cerr << "Searching in " << name << std::endl;
     if (strstr(module_arg->modulename, name) == nullptr) {
         LOG(DEBUG) << "Skipping map for symbols " << name << " because doesn't match "
                    << module_arg->modulename;
         return DWARF_CB_OK;
     }
-    LOG(INFO) << "Attempting to find symbol '" << module_arg->symbol << "' in " << name;
+    module_arg->modules.push_back(mod);
+    return DWARF_CB_OK;
+}
+
+const AbstractUnwinder::SymbolIndex&
+AbstractUnwinder::moduleSymbolIndex(Dwfl_Module* mod) const
+{
+    auto it = d_symbol_index_cache.find(mod);
+    if (it != d_symbol_index_cache.end()) {
+        return it->second;
+    }
+
+    SymbolIndex index;
     int n_syms = dwfl_module_getsymtab(mod);
-    if (n_syms == -1) {
-        return DWARF_CB_OK;
+    if (n_syms > 0) {
+        index.reserve(n_syms);
     }
     GElf_Sym sym;
     GElf_Addr addr;
     for (int i = 0; i < n_syms; i++) {
+        // The names point into the module's string table, which lives as
+        // long as the Dwfl does. The first definition of a name wins.
         const char* sname = dwfl_module_getsym_info(mod, i, &sym, &addr, nullptr, nullptr, nullptr);
-        if (strcmp(sname, module_arg->symbol) == 0) {
-            module_arg->addr = addr;
-            LOG(INFO) << "Symbol '" << sname << "' found at address " << std::hex << std::showbase
-                      << addr;
-            return DWARF_CB_ABORT;
+        if (sname != nullptr && *sname != '\0') {
+            index.emplace(sname, addr);
         }
     }
-    return DWARF_CB_OK;
+    LOG(DEBUG) << "Indexed " << index.size() << " symbols of module "
+               << (dwfl_module_info(mod, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr)
+                           ?: "???");
+    return d_symbol_index_cache.emplace(mod, std::move(index)).first->second;
 }
 
-remote_addr_t
-AbstractUnwinder::getAddressforSymbol(const std::string& symbol, const std::string& modulename) const
+std::unordered_map<std::string, remote_addr_t>
+AbstractUnwinder::getAddressesForSymbols(
+        const std::vector<std::string>& symbols,
+        const std::string& modulename) const
 {
-    LOG(DEBUG) << "Trying to find address for symbol " << symbol;
-    ModuleArg arg = {symbol.c_str(), modulename.c_str(), 0};
+    ModuleArg arg = {modulename.c_str(), {}};
     if (dwfl_getmodules(Dwfl(), module_callback, &arg, 0) == -1) {
         throw UnwinderError("Failed to fetch modules!");
     }
+
+    std::unordered_map<std::string, remote_addr_t> result;
+    for (const auto& symbol : symbols) {
+        result.emplace(symbol, 0);
+    }
+    size_t pending = symbols.size();
+    for (Dwfl_Module* mod : arg.modules) {
+        if (pending == 0) {
+            break;
+        }
+        const SymbolIndex& index = moduleSymbolIndex(mod);
+        for (auto& [symbol, addr] : result) {
+            if (addr) {
+                continue;
+            }
+            auto it = index.find(symbol);
+            if (it != index.end()) {
+                addr = it->second;
+                --pending;
+                LOG(INFO) << "Symbol '" << symbol << "' found at address " << std::hex << std::showbase
+                          << addr;
+            }
+        }
+    }
+    return result;
+}
+
+remote_addr_t
+AbstractUnwinder::getAddressforSymbol(const std::string& symbol, const std::string& modulename) const
+{
+    LOG(DEBUG) << "Trying to find address for symbol " << symbol;
+    remote_addr_t addr = getAddressesForSymbols({symbol}, modulename)[symbol];
     LOG(DEBUG) << "Address for symbol " << symbol << " resolved to: " << std::hex << std::showbase
-               << arg.addr;
-    return arg.addr;
+               << addr;
+    return addr;
+}
+
+std::unordered_map<pid_t, std::vector<NativeFrame>>
+AbstractUnwinder::unwindThreads(const std::vector<pid_t>& tids) const
+{
+    std::unordered_map<pid_t, std::vector<NativeFrame>> result;
+    for (pid_t tid : tids) {
+        result.emplace(tid, unwindThread(tid));
+    }
+    return result;
+}
+
+void
+AbstractUnwinder::setSymbolsOnly(bool symbols_only)
+{
+    d_symbols_only = symbols_only;
+}
+
+bool
+AbstractUnwinder::symbolsOnly() const
+{
+    return d_symbols_only;
 }
 
 std::string
@@ -424,9 +647,16 @@ AbstractUnwinder::demangleSymbol(const std::string& symbol)
     return new_symbol;
 }
 
-Unwinder::Unwinder(std::shared_ptr<ProcessAnalyzer> analyzer)
-: d_analyzer(std::move(analyzer))
+Unwinder::Unwinder(
+        std::shared_ptr<ProcessAnalyzer> analyzer,
+        const AbstractRemoteMemoryManager* manager,
+        SharedVirtualMaps maps,
+        std::vector<int> tids)
+: d_maps(std::move(maps))
+, d_analyzer(std::move(analyzer))
 {
+    d_thread_state =
+            RemoteThreadState::attach(Dwfl(), d_analyzer->d_pid, std::move(tids), manager, d_maps);
 }
 
 Dwfl*
@@ -435,15 +665,328 @@ Unwinder::Dwfl() const
     return d_analyzer->d_dwfl.get();
 }
 
+void
+Unwinder::refresh(SharedVirtualMaps maps, std::vector<int> tids)
+{
+    d_maps = maps;
+    if (d_thread_state) {
+        d_thread_state->refresh(std::move(tids), std::move(maps));
+    }
+}
+
+bool
+Unwinder::setStopThreadsIndividually(bool stop_threads_individually)
+{
+    if (!d_thread_state) {
+        return !stop_threads_individually;
+    }
+    d_thread_state->setStopThreadsIndividually(stop_threads_individually);
+    return true;
+}
+
 std::vector<NativeFrame>
 Unwinder::unwindThread(pid_t tid) const
+{
+    return gatherFrames(collectThreadFrames(tid));
+}
+
+std::unordered_map<pid_t, std::vector<NativeFrame>>
+Unwinder::unwindThreads(const std::vector<pid_t>& tids) const
+{
+    // Unwind every thread before symbolizing any of them, so that the frames
+    // they have in common are only resolved once and the rest can be
+    // resolved in parallel.
+    std::unordered_map<pid_t, std::vector<Frame>> frames_by_tid;
+    std::set<std::pair<Dwarf_Addr, bool>> seen;
+    std::vector<Frame> unique_frames;
+    for (pid_t tid : tids) {
+        // Threads that are not unwound are left out of the result.
+        if (Deadline::expired()) {
+            LOG(WARNING) << "Deadline passed, not unwinding the remaining threads";
+            break;
+        }
+        auto [it, inserted] = frames_by_tid.try_emplace(tid);
+        if (!inserted) {
+            continue;
+        }
+        it->second = collectThreadFrames(tid);
+        for (const Frame& frame : it->second) {
+            if (seen.emplace(frame.pc, frame.isActivation).second) {
+                unique_frames.push_back(frame);
+            }
+        }
+    }
+
+    LOG(DEBUG) << "Resolving " << unique_frames.size() << " unique frames from "
+               << frames_by_tid.size() << " threads";
+    resolveFramesInParallel(unique_frames);
+
+    std::unordered_map<pid_t, std::vector<NativeFrame>> result;
+    for (const auto& [tid, frames] : frames_by_tid) {
+        result.emplace(tid, gatherFrames(frames));
+    }
+    return result;
+}
+
+std::vector<Frame>
+Unwinder::collectThreadFrames(pid_t tid) const
 {
     LOG(DEBUG) << "Unwinding frames for tid: " << tid;
-    std::vector<Frame> frames;
     if (!tid) {
         LOG(ERROR) << "Cannot unwind thread due to invalid tid: " << tid;
         return {};
     }
+    std::vector<Frame> frames;
+    try {
+        frames = collectFrames(tid);
+    } catch (...) {
+        if (d_thread_state) {
+            d_thread_state->releaseThread(tid);
+        }
+        throw;
+    }
+    if (d_thread_state) {
+        d_thread_state->releaseThread(tid);
+    }
+    // The unwinding stops as soon as the deadline passes, so the stack may
+    // be missing its outermost frames.
+    if (Deadline::expired()) {
+        Deadline::recordTruncatedThread(tid);
+    }
+    return frames;
+}
+
+// Resolves frames on a thread of its own. libdwfl is not thread safe, so every
+// worker reports the modules of the process to a Dwfl of its own.
+class SymbolizationWorker : public AbstractUnwinder
+{
+  public:
+    // Constructors
+    explicit SymbolizationWorker(pid_t pid)
+    : d_analyzer(pid)
+    {
+    }
+
+    // Methods
+    std::vector<NativeFrame> unwindThread(pid_t) const override
+    {
+        throw UnwinderError("Symbolization workers cannot unwind threads");
+    }
+
+    std::vector<std::vector<NativeFrame>> resolveFrames(const std::vector<const Frame*>& frames) const
+    {
+        std::vector<std::vector<NativeFrame>> result;
+        result.reserve(frames.size());
+        for (const Frame* frame : frames) {
+            result.push_back(resolveFrame(*frame));
+        }
+        return result;
+    }
+
+  protected:
+    // Methods
+    struct Dwfl* Dwfl() const override
+    {
+        return d_analyzer.d_dwfl.get();
+    }
+
+  private:
+    // Data members
+    ProcessAnalyzer d_analyzer;
+};
+
+Unwinder::~Unwinder() = default;
+
+static const size_t MAX_SYMBOLIZATION_THREADS = 8;
+
+namespace {
+
+// Symbolization threads running in the whole process. Several processes may
+// be inspected at once (each one by a thread of its own), and they all share
+// this budget instead of each starting as many threads as there are cores.
+std::atomic<size_t> s_symbolization_threads{0};
+
+class SymbolizationThreadToken
+{
+  public:
+    // Constructors
+    explicit SymbolizationThreadToken(size_t max_threads)
+    {
+        size_t running = s_symbolization_threads.load();
+        while (running < max_threads) {
+            if (s_symbolization_threads.compare_exchange_weak(running, running + 1)) {
+                d_acquired = true;
+                break;
+            }
+        }
+    }
+    SymbolizationThreadToken(SymbolizationThreadToken&& other) noexcept
+    : d_acquired(std::exchange(other.d_acquired, false))
+    {
+    }
+    SymbolizationThreadToken(const SymbolizationThreadToken&) = delete;
+    SymbolizationThreadToken& operator=(const SymbolizationThreadToken&) = delete;
+    SymbolizationThreadToken& operator=(SymbolizationThreadToken&&) = delete;
+
+    // Destructors
+    ~SymbolizationThreadToken()
+    {
+        if (d_acquired) {
+            --s_symbolization_threads;
+        }
+    }
+
+    // Methods
+    explicit operator bool() const
+    {
+        return d_acquired;
+    }
+
+  private:
+    // Data members
+    bool d_acquired{false};
+};
+
+// Joins the threads it holds when it goes out of scope, so that an exception
+// thrown while starting them never leaves a joinable std::thread behind.
+struct JoiningThreads
+{
+    std::vector<std::thread> threads;
+
+    ~JoiningThreads()
+    {
+        for (auto& thread : threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+};
+
+}  // namespace
+
+void
+Unwinder::resolveFramesInParallel(const std::vector<Frame>& frames) const
+{
+    ScopedTimer timer("symbolization");
+    std::map<Dwarf_Addr, std::vector<const Frame*>> frames_by_module;
+    for (const Frame& frame : frames) {
+        std::optional<Dwarf_Addr> module_start = unresolvedFrameModule(frame);
+        if (module_start) {
+            frames_by_module[*module_start].push_back(&frame);
+        }
+    }
+    if (frames_by_module.empty()) {
+        return;
+    }
+
+    // Most of the cost of symbolizing is loading the debug information of
+    // each module, so every module is owned by a single slot: slot 0 is this
+    // unwinder, running on the calling thread, and every other slot is a
+    // worker with its own Dwfl. New modules go to the least loaded slot.
+    const size_t max_slots =
+            std::clamp<size_t>(std::thread::hardware_concurrency(), 1, MAX_SYMBOLIZATION_THREADS);
+    // Once the deadline has passed, frames are resolved using the symbol
+    // tables alone, which isn't worth setting up a worker for.
+    const size_t num_slots =
+            getenv("_PYSTACK_NO_PARALLEL_SYMBOLIZATION") || Deadline::expired() ? 1 : max_slots;
+    std::vector<std::pair<Dwarf_Addr, const std::vector<const Frame*>*>> modules;
+    for (const auto& [module_start, module_frames] : frames_by_module) {
+        modules.emplace_back(module_start, &module_frames);
+    }
+    std::stable_sort(modules.begin(), modules.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.second->size() > rhs.second->size();
+    });
+
+    std::vector<std::vector<const Frame*>> work(num_slots);
+    for (const auto& [module_start, module_frames] : modules) {
+        size_t slot = 0;
+        auto owner = d_module_owners.find(module_start);
+        if (owner != d_module_owners.end()) {
+            slot = std::min(owner->second, num_slots - 1);
+        } else if (module_start != 0) {
+            slot = std::min_element(
+                           work.begin(),
+                           work.end(),
+                           [](const auto& lhs, const auto& rhs) { return lhs.size() < rhs.size(); })
+                   - work.begin();
+            d_module_owners.emplace(module_start, slot);
+        }
+        work[slot].insert(work[slot].end(), module_frames->begin(), module_frames->end());
+    }
+
+    d_symbolization_workers.resize(num_slots - 1);
+    std::vector<std::vector<std::vector<NativeFrame>>> results(num_slots);
+    std::vector<std::exception_ptr> errors(num_slots);
+    Deadline* deadline = Deadline::current();
+    auto resolve_slot = [this, deadline, &work, &results, &errors](size_t slot) {
+        Deadline::Activation activate_deadline(deadline);
+        try {
+            auto& worker = d_symbolization_workers[slot - 1];
+            if (!worker && Deadline::expired()) {
+                // Left for gatherFrames() to resolve using the symbol tables
+                return;
+            }
+            if (!worker) {
+                worker = std::make_unique<SymbolizationWorker>(d_analyzer->d_pid);
+            }
+            worker->setSymbolsOnly(symbolsOnly());
+            results[slot] = worker->resolveFrames(work[slot]);
+        } catch (...) {
+            errors[slot] = std::current_exception();
+        }
+    };
+
+    // Slots that get no thread from the budget are resolved on the calling
+    // thread, after its own slot.
+    std::vector<size_t> inline_slots;
+    JoiningThreads workers;
+    for (size_t slot = 1; slot < num_slots; ++slot) {
+        if (work[slot].empty()) {
+            continue;
+        }
+        SymbolizationThreadToken token(max_slots - 1);
+        if (!token) {
+            inline_slots.push_back(slot);
+            continue;
+        }
+        LOG(DEBUG) << "Resolving " << work[slot].size() << " frames in symbolization worker " << slot;
+        workers.threads.emplace_back([resolve_slot, slot, token = std::move(token)] {
+            resolve_slot(slot);
+        });
+    }
+    try {
+        for (const Frame* frame : work[0]) {
+            resolveFrame(*frame);
+        }
+    } catch (...) {
+        errors[0] = std::current_exception();
+    }
+    for (size_t slot : inline_slots) {
+        LOG(DEBUG) << "Resolving " << work[slot].size() << " frames of slot " << slot
+                   << " on the calling thread";
+        resolve_slot(slot);
+    }
+    for (auto& thread : workers.threads) {
+        thread.join();
+    }
+    for (const auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    for (size_t slot = 1; slot < num_slots; ++slot) {
+        for (size_t i = 0; i < results[slot].size(); ++i) {
+            storeResolvedFrame(*work[slot][i], std::move(results[slot][i]));
+        }
+    }
+}
+
+std::vector<Frame>
+Unwinder::collectFrames(pid_t tid) const
+{
+    std::vector<Frame> frames;
     switch (dwfl_getthread_frames(Dwfl(), tid, frameCallback, (void*)(&frames))) {
         case DWARF_CB_OK:
         case DWARF_CB_ABORT:
@@ -461,7 +1004,152 @@ Unwinder::unwindThread(pid_t tid) const
         default:
             throw UnwinderError("Unknown error happened when gathering thread frames");
     }
-    return gatherFrames(frames);
+    return frames;
+}
+
+// FramePointerUnwinder
+
+static const size_t MAX_FRAME_POINTER_FRAMES = 4096;
+
+bool
+FramePointerUnwinder::isExecutableAddress(remote_addr_t addr) const
+{
+    auto it = std::upper_bound(
+            d_maps->begin(),
+            d_maps->end(),
+            addr,
+            [](remote_addr_t addr, const VirtualMap& map) { return addr < map.Start(); });
+    return it != d_maps->begin() && (--it)->containsAddr(addr) && it->isExecutable();
+}
+
+std::vector<Frame>
+FramePointerUnwinder::collectFrames(pid_t tid) const
+{
+    const ThreadRegisters* regs = d_thread_state ? d_thread_state->registers(tid) : nullptr;
+    const StackSnapshot* stack = d_thread_state ? d_thread_state->stackSnapshot(tid) : nullptr;
+    if (!regs || !stack || stack->empty()) {
+        LOG(DEBUG) << "No stack snapshot for thread " << tid << ", unwinding it using CFI";
+        return Unwinder::collectFrames(tid);
+    }
+
+    std::vector<Frame> frames;
+    ThreadRegisters current{{}, regs->pc, regs->sp, regs->fp};
+    frames.emplace_back(current.pc, true, current.sp);
+    // The leaf may have been stopped before setting up its frame record, or
+    // may not set one up at all (syscall wrappers, -fomit-frame-pointer), in
+    // which case the frame pointer still points to its caller's record and
+    // following it would skip the caller. Only the CFI knows where the leaf
+    // returns to, so take the first step with it.
+    if (std::optional<ThreadRegisters> next = cfiStep(tid, current, frames)) {
+        current = *next;
+    } else if (frames.size() > 1) {
+        current.fp = 0;  // The CFI unwound the rest of the stack.
+    }
+    while (frames.size() < MAX_FRAME_POINTER_FRAMES && current.fp != 0) {
+        if (Deadline::expired()) {
+            LOG(DEBUG) << "Deadline passed, not unwinding thread " << tid << " any further";
+            break;
+        }
+        // A frame record is the caller's frame pointer followed by the return
+        // address, and records get older as the addresses grow.
+        Dwarf_Word next_fp = 0;
+        Dwarf_Word return_address = 0;
+        bool valid = current.fp % sizeof(Dwarf_Word) == 0 && current.fp >= current.sp
+                     && stack->read(current.fp, &next_fp)
+                     && stack->read(current.fp + sizeof(Dwarf_Word), &return_address)
+                     && (next_fp == 0 || next_fp > current.fp);
+        if (valid && return_address == 0) {
+            break;
+        }
+        if (valid && isExecutableAddress(return_address)) {
+            current = ThreadRegisters{{}, return_address, current.fp + 2 * sizeof(Dwarf_Word), next_fp};
+            frames.emplace_back(current.pc, false, current.sp);
+            continue;
+        }
+
+        LOG(DEBUG) << std::hex << std::showbase << "Frame pointer chain broken at pc " << current.pc
+                   << " (fp=" << current.fp << "), taking a CFI step";
+        std::optional<ThreadRegisters> next = cfiStep(tid, current, frames);
+        if (!next) {
+            break;
+        }
+        current = *next;
+    }
+    LOG(DEBUG) << "Collected " << frames.size() << " frames for thread " << tid
+               << " by following frame pointers";
+    return frames;
+}
+
+struct CfiStepArg
+{
+    std::vector<Frame> frames;
+    std::optional<ThreadRegisters> next;
+};
+
+static int
+cfiStepCallback(Dwfl_Frame* state, void* arg)
+{
+    auto* step = static_cast<CfiStepArg*>(arg);
+    if (Deadline::expired()) {
+        return DWARF_CB_ABORT;
+    }
+    Dwarf_Addr pc;
+    bool isActivation;
+    if (!dwfl_frame_pc(state, &pc, &isActivation)) {
+        return DWARF_CB_ABORT;
+    }
+    step->frames.emplace_back(pc, isActivation, std::nullopt);
+    if (step->frames.size() < 2) {
+        return DWARF_CB_OK;
+    }
+
+#if _ELFUTILS_VERSION >= 188 or (defined(__linux__) && !defined(__GLIBC__))
+    Dwarf_Word sp;
+    Dwarf_Word fp;
+    if (dwfl_frame_reg(state, STACK_POINTER_REGNO, &sp) == 0
+        && dwfl_frame_reg(state, FRAME_POINTER_REGNO, &fp) == 0)
+    {
+        step->frames.back().stackPointer = sp;
+        step->next = ThreadRegisters{{}, pc, sp, fp};
+    }
+#endif
+    return DWARF_CB_ABORT;
+}
+
+std::optional<ThreadRegisters>
+FramePointerUnwinder::cfiStep(pid_t tid, const ThreadRegisters& regs, std::vector<Frame>& frames) const
+{
+    CfiStepArg step;
+    d_thread_state->overrideInitialRegisters(tid, regs);
+    dwfl_getthread_frames(Dwfl(), tid, cfiStepCallback, &step);
+    d_thread_state->clearInitialRegistersOverride(tid);
+
+    if (step.frames.size() < 2) {
+        LOG(DEBUG) << std::hex << std::showbase << "CFI could not unwind past pc " << regs.pc;
+        return std::nullopt;
+    }
+    if (!step.next) {
+        // We can't tell where the caller's frame record is, so let the CFI
+        // unwind the rest of the stack.
+        cfiUnwindFrom(tid, regs, frames);
+        return std::nullopt;
+    }
+    frames.push_back(step.frames[1]);
+    return step.next;
+}
+
+void
+FramePointerUnwinder::cfiUnwindFrom(pid_t tid, const ThreadRegisters& regs, std::vector<Frame>& frames)
+        const
+{
+    std::vector<Frame> cfi_frames;
+    d_thread_state->overrideInitialRegisters(tid, regs);
+    dwfl_getthread_frames(Dwfl(), tid, frameCallback, &cfi_frames);
+    d_thread_state->clearInitialRegistersOverride(tid);
+    // The first frame is the one we started from, which we already have.
+    if (cfi_frames.size() > 1) {
+        frames.insert(frames.end(), cfi_frames.begin() + 1, cfi_frames.end());
+    }
 }
 
 CoreFileUnwinder::CoreFileUnwinder(std::shared_ptr<CoreFileAnalyzer> analyzer)
@@ -477,27 +1165,28 @@ thread_callback(Dwfl_Thread* thread, void* thread_arg)
     return DWARF_CB_OK;
 }
 
-struct ThreadArg
+struct ThreadFramesArg
 {
-    pid_t tid;
-    std::vector<Frame>& frames;
+    const std::unordered_set<pid_t>& tids;
+    std::unordered_map<pid_t, std::vector<Frame>>& frames;
+    std::unordered_map<pid_t, std::string>& errors;
 };
 
 static int
 thread_callback_for_frames(Dwfl_Thread* thread, void* arg)
 {
-    auto* thread_arg = static_cast<ThreadArg*>(arg);
+    auto* thread_arg = static_cast<ThreadFramesArg*>(arg);
     pid_t tid = dwfl_thread_tid(thread);
-    LOG(DEBUG) << "thread_callback_for_frames: checking thread tid=" << tid << " (looking for "
-               << thread_arg->tid << ")";
-    if (tid != thread_arg->tid) {
+    if (thread_arg->tids.find(tid) == thread_arg->tids.end()) {
+        LOG(DEBUG) << "thread_callback_for_frames: skipping thread tid=" << tid;
         return DWARF_CB_OK;
     }
 
-    LOG(DEBUG) << "thread_callback_for_frames: found matching thread, calling dwfl_thread_getframes";
-    int result = dwfl_thread_getframes(thread, frameCallback, (void*)(&(thread_arg->frames)));
+    LOG(DEBUG) << "thread_callback_for_frames: calling dwfl_thread_getframes for tid=" << tid;
+    std::vector<Frame>& frames = thread_arg->frames[tid];
+    int result = dwfl_thread_getframes(thread, frameCallback, (void*)(&frames));
     LOG(DEBUG) << "thread_callback_for_frames: dwfl_thread_getframes returned " << result << ", got "
-               << thread_arg->frames.size() << " frames";
+               << frames.size() << " frames";
 
     switch (result) {
         case DWARF_CB_OK:
@@ -509,19 +1198,79 @@ thread_callback_for_frames(Dwfl_Thread* thread, void* arg)
             int dwfl_err = dwfl_errno();
             LOG(DEBUG) << "thread_callback_for_frames: dwfl error: "
                        << (dwfl_err ? dwfl_errmsg(dwfl_err) : "no error");
-            if (thread_arg->frames.empty()) {
+            if (frames.empty()) {
                 std::string error(
                         dwfl_err ? dwfl_errmsg(dwfl_err) : "unwinding failed with no error reported");
-                throw UnwinderError("Unknown error happened when gathering thread frames: " + error);
+                thread_arg->errors[tid] =
+                        "Unknown error happened when gathering thread frames: " + error;
             }
             break;
         }
         default:
-            throw UnwinderError("Unknown error happened when gathering thread frames");
+            thread_arg->errors[tid] = "Unknown error happened when gathering thread frames";
     }
+    // Errors are reported per thread, so keep going with the rest of them.
     return DWARF_CB_OK;
 }
 
+void
+CoreFileUnwinder::collectFrames(const std::vector<pid_t>& tids) const
+{
+    std::unordered_set<pid_t> pending;
+    for (pid_t tid : tids) {
+        if (tid && d_thread_frames.find(tid) == d_thread_frames.end()) {
+            pending.insert(tid);
+        }
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    LOG(DEBUG) << "Unwinding frames for " << pending.size() << " threads";
+    std::unordered_map<pid_t, std::vector<Frame>> frames;
+    std::unordered_map<pid_t, std::string> errors;
+    ThreadFramesArg args = {pending, frames, errors};
+    // When unwinding core files, we cannot use dwfl_thread_getframes to inspect a
+    // single thread because libdwfl leaks memory otherwise (dwfl_thread_getframes
+    // is not supposed to be used directly with core files). So we need to inspect
+    // every thread in one traversal and skip the ones that were not requested.
+    int result = dwfl_getthreads(Dwfl(), thread_callback_for_frames, (void*)(&args));
+    std::optional<std::string> traversal_error;
+    if (result != DWARF_CB_OK && result != DWARF_CB_ABORT) {
+        int dwfl_err = dwfl_errno();
+        std::string error(dwfl_err ? dwfl_errmsg(dwfl_err) : "unwinding failed with no error reported");
+        traversal_error = "Unknown error happened when gathering thread frames: " + error;
+        if (frames.empty()) {
+            throw UnwinderError(*traversal_error);
+        }
+    }
+
+    for (pid_t tid : pending) {
+        ThreadFrames& entry = d_thread_frames[tid];
+        auto it = frames.find(tid);
+        if (it != frames.end()) {
+            entry.frames = std::move(it->second);
+        }
+        auto error = errors.find(tid);
+        if (error != errors.end()) {
+            entry.error = std::move(error->second);
+        } else if (it == frames.end() && traversal_error) {
+            // The traversal failed before reaching this thread
+            entry.error = traversal_error;
+        }
+    }
+}
+
+const std::vector<Frame>&
+CoreFileUnwinder::cachedFrames(pid_t tid) const
+{
+    const ThreadFrames& entry = d_thread_frames.at(tid);
+    if (entry.error) {
+        throw UnwinderError(entry.error.value());
+    }
+    return entry.frames;
+}
+
 std::vector<NativeFrame>
 CoreFileUnwinder::unwindThread(pid_t tid) const
 {
@@ -530,30 +1279,30 @@ CoreFileUnwinder::unwindThread(pid_t tid) const
         LOG(ERROR) << "Cannot unwind thread due to invalid tid: " << tid;
         return {};
     }
-    std::vector<Frame> frames;
-    ThreadArg args = {tid, frames};
-    // When unwinding core files, we cannot use dwfl_thread_getframes to inspect a
-    // single thread because libdwfl leaks memory otherwise (dwfl_thread_getframes
-    // is not supposed to be used directly with core files). So we need to inspect
-    // frame by frame and skip the ones that are different from *tid*.
-    switch (dwfl_getthreads(Dwfl(), thread_callback_for_frames, (void*)(&args))) {
-        case DWARF_CB_OK:
-        case DWARF_CB_ABORT:
-            break;
-        case -1:
-            // This may or may not be an error, as it can signal the end of the stack
-            // unwinding.
-            if (frames.empty()) {
-                int dwfl_err = dwfl_errno();
-                std::string error(
-                        dwfl_err ? dwfl_errmsg(dwfl_err) : "unwinding failed with no error reported");
-                throw UnwinderError("Unknown error happened when gathering thread frames: " + error);
-            }
-            break;
-        default:
-            throw UnwinderError("Unknown error happened when gathering thread frames");
+    if (d_thread_frames.find(tid) == d_thread_frames.end() && !d_collected_all_threads) {
+        // Threads are almost always unwound one after another, so unwind all
+        // of them in one traversal instead of one traversal per thread.
+        d_collected_all_threads = true;
+        std::vector<pid_t> tids = getCoreTids();
+        tids.push_back(tid);
+        collectFrames(tids);
+    } else {
+        collectFrames({tid});
+    }
+    return gatherFrames(cachedFrames(tid));
+}
+
+std::unordered_map<pid_t, std::vector<NativeFrame>>
+CoreFileUnwinder::unwindThreads(const std::vector<pid_t>& tids) const
+{
+    collectFrames(tids);
+    std::unordered_map<pid_t, std::vector<NativeFrame>> result;
+    for (pid_t tid : tids) {
+        if (tid) {
+            result.emplace(tid, gatherFrames(cachedFrames(tid)));
+        }
     }
-    return gatherFrames(frames);
+    return result;
 }
 
 std::vector<int>
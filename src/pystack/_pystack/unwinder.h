@@ -3,7 +3,9 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
@@ -11,9 +13,13 @@
 #include "elf_common.h"
 #include "mem.h"
 #include "native_frame.h"
+#include "stack_snapshot.h"
 
 namespace pystack {
 
+class SymbolCache;
+class SymbolizationWorker;
+
 class UnwinderError : public std::exception
 {
   public:
@@ -87,7 +93,15 @@ class AbstractUnwinder
     // Methods
     virtual remote_addr_t
     getAddressforSymbol(const std::string& symbol, const std::string& modulename) const;
+    virtual std::unordered_map<std::string, remote_addr_t> getAddressesForSymbols(
+            const std::vector<std::string>& symbols,
+            const std::string& modulename) const;
     virtual std::vector<NativeFrame> unwindThread(pid_t tid) const = 0;
+    virtual std::unordered_map<pid_t, std::vector<NativeFrame>>
+    unwindThreads(const std::vector<pid_t>& tids) const;
+    // Resolve native frames using only the ELF symbol tables, without
+    // loading any DWARF information. Must be set before unwinding.
+    void setSymbolsOnly(bool symbols_only);
 
     // Static methods
     static std::string demangleSymbol(const std::string&);
@@ -98,6 +112,14 @@ class AbstractUnwinder
     // Methods
     virtual struct Dwfl* Dwfl() const = 0;
     std::vector<NativeFrame> gatherFrames(const std::vector<Frame>& frames) const;
+    // The native frames (inline calls included) a single unwound frame
+    // expands to. The result is memoized.
+    const std::vector<NativeFrame>& resolveFrame(const Frame& frame) const;
+    // Start address of the module containing the frame, or nullopt if the
+    // frame has already been resolved.
+    std::optional<Dwarf_Addr> unresolvedFrameModule(const Frame& frame) const;
+    void storeResolvedFrame(const Frame& frame, std::vector<NativeFrame> native_frames) const;
+    bool symbolsOnly() const;
 
   private:
     // Enums
@@ -108,14 +130,52 @@ class AbstractUnwinder
     // Aliases
     using Scopes = std::shared_ptr<Dwarf_Die>;
     using ScopesInfo = std::pair<int, Scopes>;
+    using SymbolIndex = std::unordered_map<std::string_view, GElf_Addr>;
+
+    // Classes
+    struct SymbolizedFrameKey
+    {
+        Dwfl_Module* mod;
+        Dwarf_Addr relative_pc;
+        bool isActivation;
+        bool symbolsOnly;
+
+        bool operator==(const SymbolizedFrameKey& other) const = default;
+    };
+
+    struct SymbolizedFrameKeyHash
+    {
+        size_t operator()(const SymbolizedFrameKey& key) const
+        {
+            size_t hash = std::hash<Dwfl_Module*>{}(key.mod);
+            hash ^= std::hash<Dwarf_Addr>{}(key.relative_pc) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+            return hash ^ key.isActivation ^ (key.symbolsOnly << 1);
+        }
+    };
 
     // Methods
+    SymbolizedFrameKey frameKey(const Frame& frame, Dwfl_Module** mod, const char** mod_name) const;
     Dwarf_Die* dwarfModuleAddrDie(Dwarf_Addr pc_adjusted, Dwfl_Module* mod, Dwarf_Addr* bias) const;
 
     std::pair<int, Scopes> dwarfGetScopes(Dwarf_Die* cudie, Dwarf_Addr pc_adjusted) const;
     std::pair<int, Scopes> dwarfGetScopesDie(Dwarf_Die* die) const;
 
     const char* getNonInlineSymbolName(Dwfl_Module* mod, Dwarf_Addr pc) const;
+    SymbolCache* persistentSymbolCache(Dwfl_Module* mod) const;
+    const SymbolIndex& moduleSymbolIndex(Dwfl_Module* mod) const;
+
+    // Returns whether the frame could be fully resolved using debug information.
+    bool symbolizeFrame(
+            std::vector<NativeFrame>& native_frames,
+            Dwfl_Module* mod,
+            const char* mod_name,
+            Dwarf_Addr pc,
+            Dwarf_Addr pc_adjusted) const;
+    void symbolizeFrameFromSymbols(
+            std::vector<NativeFrame>& native_frames,
+            Dwfl_Module* mod,
+            const char* mod_name,
+            Dwarf_Addr pc) const;
 
     StatusCode gatherInlineFrames(
             std::vector<NativeFrame>& native_frames,
@@ -126,25 +186,87 @@ class AbstractUnwinder
             const char* mod_name) const;
 
     // Data members
+    bool d_symbols_only{false};
     mutable ModuleCuDieRanges d_range_maps_cache;
     mutable std::unordered_map<Dwarf_Addr, ScopesInfo> d_dwarf_getscopes_cache;
     mutable std::unordered_map<void*, ScopesInfo> d_dwarf_getscopes_die_cache;
     mutable std::unordered_map<Dwarf_Addr, const char*> d_symbol_by_pc_cache;
+    mutable std::unordered_map<SymbolizedFrameKey, std::vector<NativeFrame>, SymbolizedFrameKeyHash>
+            d_symbolized_frames_cache;
+    mutable std::unordered_map<Dwfl_Module*, std::shared_ptr<SymbolCache>> d_persistent_symbol_caches;
+    mutable std::unordered_map<Dwfl_Module*, SymbolIndex> d_symbol_index_cache;
 };
 
 class Unwinder : public AbstractUnwinder
 {
   public:
     // Constructors
-    explicit Unwinder(std::shared_ptr<ProcessAnalyzer> analyzer);
+    Unwinder(
+            std::shared_ptr<ProcessAnalyzer> analyzer,
+            const AbstractRemoteMemoryManager* manager,
+            SharedVirtualMaps maps,
+            std::vector<int> tids);
+
+    // Destructors
+    ~Unwinder() override;
 
     // Methods
     virtual struct Dwfl* Dwfl() const override;
     std::vector<NativeFrame> unwindThread(pid_t tid) const override;
+    // Unwinds all the threads first, then symbolizes the distinct frames
+    // found in them using a pool of threads.
+    std::unordered_map<pid_t, std::vector<NativeFrame>>
+    unwindThreads(const std::vector<pid_t>& tids) const override;
+    // Starts unwinding the given threads of the process after it has been
+    // stopped again. Everything known about its modules is kept, so the
+    // modules must not have changed.
+    void refresh(SharedVirtualMaps maps, std::vector<int> tids);
+    // Captures the state of each thread by stopping only that thread, for
+    // processes that are left running. Returns false if the platform can't
+    // unwind threads from captured state.
+    bool setStopThreadsIndividually(bool stop_threads_individually);
+
+  protected:
+    // Methods
+    virtual std::vector<Frame> collectFrames(pid_t tid) const;
+
+    // Data members
+    RemoteThreadState* d_thread_state{nullptr};
+    SharedVirtualMaps d_maps;
 
   private:
+    // Methods
+    std::vector<Frame> collectThreadFrames(pid_t tid) const;
+    void resolveFramesInParallel(const std::vector<Frame>& frames) const;
+
     // Data members
     std::shared_ptr<ProcessAnalyzer> d_analyzer;
+    mutable std::vector<std::unique_ptr<SymbolizationWorker>> d_symbolization_workers;
+    mutable std::unordered_map<Dwarf_Addr, size_t> d_module_owners;
+};
+
+// Unwinds live processes by following the chain of saved frame pointers
+// (rbp on x86_64, x29 on aarch64) through the thread's stack snapshot. The
+// first step, out of a leaf that may not have set up its frame record, is
+// taken using the DWARF CFI. Each further step is validated, and where the
+// chain is broken, e.g. by a function compiled without frame pointers, a
+// single CFI step is taken before going back to the frame pointer chain.
+class FramePointerUnwinder : public Unwinder
+{
+  public:
+    // Constructors
+    using Unwinder::Unwinder;
+
+  protected:
+    // Methods
+    std::vector<Frame> collectFrames(pid_t tid) const override;
+
+  private:
+    // Methods
+    bool isExecutableAddress(remote_addr_t addr) const;
+    std::optional<ThreadRegisters>
+    cfiStep(pid_t tid, const ThreadRegisters& regs, std::vector<Frame>& frames) const;
+    void cfiUnwindFrom(pid_t tid, const ThreadRegisters& regs, std::vector<Frame>& frames) const;
 };
 
 class CoreFileUnwinder : public AbstractUnwinder
@@ -157,9 +279,26 @@ class CoreFileUnwinder : public AbstractUnwinder
     virtual struct Dwfl* Dwfl() const override;
     std::vector<int> getCoreTids() const;
     std::vector<NativeFrame> unwindThread(pid_t tid) const override;
+    std::unordered_map<pid_t, std::vector<NativeFrame>>
+    unwindThreads(const std::vector<pid_t>& tids) const override;
 
   private:
+    // Classes
+    struct ThreadFrames
+    {
+        std::vector<Frame> frames;
+        std::optional<std::string> error;
+    };
+
+    // Methods
+    void collectFrames(const std::vector<pid_t>& tids) const;
+    const std::vector<Frame>& cachedFrames(pid_t tid) const;
+
     // Data members
     std::shared_ptr<CoreFileAnalyzer> d_analyzer;
+    // The threads of a core file never change, so the raw frames of every
+    // thread we have unwound are kept around.
+    mutable std::unordered_map<pid_t, ThreadFrames> d_thread_frames;
+    mutable bool d_collected_all_threads{false};
 };
 }  // namespace pystack
@@ -1,28 +1,249 @@
 #include "version_detector.h"
 
-#include <cstdio>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
-#include <regex>
+#include <optional>
 #include <stdexcept>
+#include <string_view>
 #include <vector>
 
+#include "elf_common.h"
 #include "logging.h"
 
 namespace pystack {
 
 namespace fs = std::filesystem;
 
-// Regex patterns for version detection
-// Matches: "3.8.10 (default, May 26 2023, 14:05:08)" or similar version strings in BSS
-static const std::regex BSS_VERSION_REGEXP(
-        R"(((2|3)\.(\d+)\.(\d{1,2}))((a|b|c|rc)\d{1,2})?\+?(?: (?:experimental )?free-threading build)? (\(.{1,64}\)))");
+namespace {
 
-// Matches: python3.8, python3.10, etc.
-static const std::regex BINARY_REGEXP(R"(python(\d+)\.(\d+).*)", std::regex_constants::icase);
+bool
+isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+// Returns the number of consecutive decimal digits starting at data[pos], up
+// to max_digits + 1 so that callers can detect runs that are too long.
+size_t
+countDigits(const char* data, size_t size, size_t pos, size_t max_digits)
+{
+    size_t count = 0;
+    while (pos + count < size && count <= max_digits && isDigit(data[pos + count])) {
+        ++count;
+    }
+    return count;
+}
+
+bool
+hasPrefixAt(const char* data, size_t size, size_t pos, std::string_view prefix)
+{
+    return pos <= size && size - pos >= prefix.size()
+           && std::memcmp(data + pos, prefix.data(), prefix.size()) == 0;
+}
+
+struct VersionMatch
+{
+    PythonVersion version;
+    size_t end;  // Offset one past the last byte of the "X.Y.Z[suffix][+]" part
+};
+
+// Validates a "X.Y.Z[(a|b|c|rc)N][+]" version core starting at data[pos].
+std::optional<VersionMatch>
+matchVersionCore(const char* data, size_t size, size_t pos)
+{
+    static constexpr size_t MAX_MINOR_DIGITS = 3;
+    static constexpr size_t MAX_MICRO_DIGITS = 2;
+    static constexpr size_t MAX_SERIAL_DIGITS = 2;
+
+    if (pos + 1 >= size || (data[pos] != '2' && data[pos] != '3') || data[pos + 1] != '.') {
+        return std::nullopt;
+    }
+    int major = data[pos] - '0';
+    size_t cursor = pos + 2;
+
+    size_t minor_digits = countDigits(data, size, cursor, MAX_MINOR_DIGITS);
+    if (minor_digits == 0 || minor_digits > MAX_MINOR_DIGITS) {
+        return std::nullopt;
+    }
+    int minor = 0;
+    std::from_chars(data + cursor, data + cursor + minor_digits, minor);
+    cursor += minor_digits;
+
+    if (cursor >= size || data[cursor] != '.') {
+        return std::nullopt;
+    }
+    ++cursor;
+
+    size_t micro_digits = countDigits(data, size, cursor, MAX_MICRO_DIGITS);
+    if (micro_digits == 0 || micro_digits > MAX_MICRO_DIGITS) {
+        return std::nullopt;
+    }
+    cursor += micro_digits;
+
+    size_t suffix_length = 0;
+    if (hasPrefixAt(data, size, cursor, "rc")) {
+        suffix_length = 2;
+    } else if (cursor < size && (data[cursor] == 'a' || data[cursor] == 'b' || data[cursor] == 'c')) {
+        suffix_length = 1;
+    }
+    if (suffix_length) {
+        size_t serial_digits = countDigits(data, size, cursor + suffix_length, MAX_SERIAL_DIGITS);
+        if (serial_digits == 0 || serial_digits > MAX_SERIAL_DIGITS) {
+            return std::nullopt;
+        }
+        cursor += suffix_length + serial_digits;
+    }
+
+    if (cursor < size && data[cursor] == '+') {
+        ++cursor;
+    }
+    return VersionMatch{PythonVersion(major, minor), cursor};
+}
+
+// Matches the string produced by Py_GetVersion(), for instance
+// "3.8.10 (default, May 26 2023, 14:05:08)", starting at data[pos].
+std::optional<PythonVersion>
+matchFullVersionString(const char* data, size_t size, size_t pos)
+{
+    static constexpr size_t MAX_BUILD_INFO_LENGTH = 64;
+
+    auto match = matchVersionCore(data, size, pos);
+    if (!match) {
+        return std::nullopt;
+    }
+    size_t cursor = match->end;
+
+    for (std::string_view build_flavour :
+         {" free-threading build", " experimental free-threading build"})
+    {
+        if (hasPrefixAt(data, size, cursor, build_flavour)) {
+            cursor += build_flavour.size();
+            break;
+        }
+    }
+
+    if (!hasPrefixAt(data, size, cursor, " (")) {
+        return std::nullopt;
+    }
+    cursor += 2;
+
+    // The build information must be 1 to 64 characters on a single line
+    // followed by a closing parenthesis.
+    size_t limit = std::min(size, cursor + MAX_BUILD_INFO_LENGTH + 1);
+    for (size_t i = cursor; i < limit; ++i) {
+        if (data[i] == '\n' || data[i] == '\r') {
+            break;
+        }
+        if (data[i] == ')' && i > cursor) {
+            return match->version;
+        }
+    }
+    return std::nullopt;
+}
+
+// Matches a NUL-terminated "X.Y.Z" literal (the PY_VERSION macro) starting at data[pos].
+std::optional<PythonVersion>
+matchVersionLiteral(const char* data, size_t size, size_t pos)
+{
+    if (pos == 0 || data[pos - 1] != '\0') {
+        return std::nullopt;
+    }
+    auto match = matchVersionCore(data, size, pos);
+    if (!match || match->end >= size || data[match->end] != '\0') {
+        return std::nullopt;
+    }
+    return match->version;
+}
+
+using VersionMatcher = std::optional<PythonVersion> (*)(const char*, size_t, size_t);
+
+// Calls visitor with every version the matcher finds in the buffer, until it
+// returns false. Every version string contains "<major>." so use memchr() to
+// jump between candidate dots and only run the (bounded) validation around them.
+template<typename Visitor>
+void
+visitVersionsInBuffer(const char* data, size_t size, VersionMatcher matcher, Visitor visitor)
+{
+    if (size < 2) {
+        return;
+    }
+    const char* cursor = data + 1;
+    const char* end = data + size;
+    while (cursor < end) {
+        auto dot = static_cast<const char*>(std::memchr(cursor, '.', end - cursor));
+        if (dot == nullptr) {
+            break;
+        }
+        size_t pos = dot - data - 1;
+        if (data[pos] == '2' || data[pos] == '3') {
+            auto version = matcher(data, size, pos);
+            if (version && !visitor(*version)) {
+                return;
+            }
+        }
+        cursor = dot + 1;
+    }
+}
+
+std::optional<PythonVersion>
+scanBufferForVersion(const char* data, size_t size, VersionMatcher matcher)
+{
+    std::optional<PythonVersion> result;
+    visitVersionsInBuffer(data, size, matcher, [&](const PythonVersion& version) {
+        result = version;
+        return false;
+    });
+    return result;
+}
+
+// PY_VERSION has no symbol of its own, and other libraries linked into the
+// file may have "X.Y.Z" literals too. The literal is only trusted in data that
+// also holds the format string Py_GetVersion() expands it with, and only if
+// every version literal in it agrees.
+std::optional<PythonVersion>
+scanBufferForVersionLiteral(const char* data, size_t size)
+{
+    static constexpr std::string_view GET_VERSION_FORMAT = "%.80s (%.80s) %.80s";
+    if (!memmem(data, size, GET_VERSION_FORMAT.data(), GET_VERSION_FORMAT.size())) {
+        return std::nullopt;
+    }
 
-// Matches: libpython3.8.so, libpython3.10.so.1.0, etc.
-static const std::regex LIBPYTHON_REGEXP(R"(.*libpython(\d+)\.(\d+).*)", std::regex_constants::icase);
+    std::optional<PythonVersion> result;
+    bool ambiguous = false;
+    visitVersionsInBuffer(data, size, matchVersionLiteral, [&](const PythonVersion& version) {
+        ambiguous = result && *result != version;
+        result = version;
+        return !ambiguous;
+    });
+    if (ambiguous) {
+        LOG(DEBUG) << "Found version literals of several Python versions, ignoring them";
+        return std::nullopt;
+    }
+    return result;
+}
+
+std::optional<PythonVersion>
+parseMajorMinor(std::string_view text)
+{
+    unsigned int major = 0;
+    unsigned int minor = 0;
+    const char* end = text.data() + text.size();
+    auto [major_end, major_ec] = std::from_chars(text.data(), end, major);
+    if (major_ec != std::errc() || major_end == end || *major_end != '.') {
+        return std::nullopt;
+    }
+    auto [minor_end, minor_ec] = std::from_chars(major_end + 1, end, minor);
+    if (minor_ec != std::errc()) {
+        return std::nullopt;
+    }
+    return PythonVersion(major, minor);
+}
+
+}  // namespace
 
 static std::optional<PythonVersion>
 scanProcessBssForVersion(pid_t pid, const VirtualMap& bss, AbstractRemoteMemoryManager* manager)
@@ -43,134 +264,164 @@ scanProcessBssForVersion(pid_t pid, const VirtualMap& bss, AbstractRemoteMemoryM
         return std::nullopt;
     }
 
-    std::string memory_str(memory.begin(), memory.end());
-    std::smatch match;
-    if (std::regex_search(memory_str, match, BSS_VERSION_REGEXP)) {
-        int major = std::stoi(match[2].str());
-        int minor = std::stoi(match[3].str());
-        return PythonVersion(major, minor);
-    }
-
-    return std::nullopt;
+    return scanBufferForVersion(memory.data(), memory.size(), matchFullVersionString);
 }
 
-static std::optional<PythonVersion>
-scanCoreBssForVersion(const std::string& corefile, const VirtualMap& bss)
+static bool
+readFileRange(const std::string& filename, off_t offset, size_t size, std::vector<char>* data)
 {
-    std::ifstream file(corefile, std::ios::binary);
+    std::ifstream file(filename, std::ios::binary);
     if (!file.is_open()) {
-        return std::nullopt;
+        return false;
     }
 
-    file.seekg(bss.Offset());
+    file.seekg(offset);
     if (!file.good()) {
-        return std::nullopt;
+        return false;
     }
 
-    size_t size = bss.Size();
-    std::vector<char> data(size);
-    file.read(data.data(), size);
+    data->resize(size);
+    file.read(data->data(), size);
     if (!file.good() && !file.eof()) {
-        return std::nullopt;
+        return false;
     }
+    data->resize(file.gcount());
+    return true;
+}
 
-    std::string data_str(data.begin(), data.end());
-    std::smatch match;
-    if (std::regex_search(data_str, match, BSS_VERSION_REGEXP)) {
-        int major = std::stoi(match[2].str());
-        int minor = std::stoi(match[3].str());
-        return PythonVersion(major, minor);
+static std::optional<PythonVersion>
+scanCoreBssForVersion(const std::string& corefile, const VirtualMap& bss)
+{
+    std::vector<char> data;
+    if (!readFileRange(corefile, bss.Offset(), bss.Size(), &data)) {
+        return std::nullopt;
     }
-
-    return std::nullopt;
+    return scanBufferForVersion(data.data(), data.size(), matchFullVersionString);
 }
 
 static std::optional<PythonVersion>
 inferVersionFromPath(const std::string& path)
 {
     std::string filename = fs::path(path).filename().string();
-
-    std::smatch match;
-    if (std::regex_match(filename, match, LIBPYTHON_REGEXP)) {
-        int major = std::stoi(match[1].str());
-        int minor = std::stoi(match[2].str());
-        LOG(INFO) << "Version inferred from libpython path: " << major << "." << minor;
-        return PythonVersion(major, minor);
+    std::transform(filename.begin(), filename.end(), filename.begin(), [](unsigned char c) {
+        return std::tolower(c);
+    });
+    std::string_view name = filename;
+
+    static constexpr std::string_view LIBPYTHON_PREFIX = "libpython";
+    for (size_t pos = name.rfind(LIBPYTHON_PREFIX); pos != std::string_view::npos;
+         pos = pos ? name.rfind(LIBPYTHON_PREFIX, pos - 1) : std::string_view::npos)
+    {
+        auto version = parseMajorMinor(name.substr(pos + LIBPYTHON_PREFIX.size()));
+        if (version) {
+            LOG(INFO) << "Version inferred from libpython path: " << version->first << "."
+                      << version->second;
+            return version;
+        }
     }
 
-    if (std::regex_match(filename, match, BINARY_REGEXP)) {
-        int major = std::stoi(match[1].str());
-        int minor = std::stoi(match[2].str());
-        LOG(INFO) << "Version inferred from binary path: " << major << "." << minor;
-        return PythonVersion(major, minor);
+    static constexpr std::string_view BINARY_PREFIX = "python";
+    if (name.substr(0, BINARY_PREFIX.size()) == BINARY_PREFIX) {
+        auto version = parseMajorMinor(name.substr(BINARY_PREFIX.size()));
+        if (version) {
+            LOG(INFO) << "Version inferred from binary path: " << version->first << "."
+                      << version->second;
+            return version;
+        }
     }
 
     return std::nullopt;
 }
 
-// Matches: "Python 3.10.4" or similar --version output
-static const std::regex VERSION_OUTPUT_REGEXP(R"(Python (\d+)\.(\d+).*)", std::regex_constants::icase);
-
-static std::optional<PythonVersion>
-getVersionFromBinary(const std::string& binary_path)
+std::optional<PythonVersion>
+getVersionFromElfSectionData(const char* data, size_t size)
 {
-    std::string cmd = binary_path + " --version 2>&1";
-    FILE* pipe = popen(cmd.c_str(), "r");
-    if (!pipe) {
-        return std::nullopt;
+    auto version = scanBufferForVersion(data, size, matchFullVersionString);
+    if (version) {
+        return version;
     }
+    return scanBufferForVersionLiteral(data, size);
+}
 
-    char buffer[256];
-    std::string output;
-    while (fgets(buffer, sizeof(buffer), pipe)) {
-        output += buffer;
+static std::optional<PythonVersion>
+getVersionFromElf(const std::string& filename)
+{
+    // Python 3.11+ exports its version as a PY_VERSION_HEX constant.
+    unsigned long py_version = 0;
+    if (getSymbolData(filename, "Py_Version", &py_version, sizeof(py_version))) {
+        int major = (py_version >> 24) & 0xFF;
+        int minor = (py_version >> 16) & 0xFF;
+        if (major == 2 || major == 3) {
+            LOG(INFO) << "Version found in the Py_Version symbol of " << filename << ": " << major
+                      << "." << minor;
+            return PythonVersion(major, minor);
+        }
     }
-    pclose(pipe);
 
-    std::smatch match;
-    if (std::regex_search(output, match, VERSION_OUTPUT_REGEXP)) {
-        int major = std::stoi(match[1].str());
-        int minor = std::stoi(match[2].str());
-        LOG(INFO) << "Version found by running --version: " << major << "." << minor;
-        return PythonVersion(major, minor);
+    // Otherwise look for the version string in the initialized data sections
+    // of the file.
+    for (const char* section_name : {".rodata", ".data"}) {
+        SectionInfo section;
+        std::vector<char> data;
+        if (!getSectionInfo(filename, section_name, &section)
+            || !readFileRange(filename, section.offset, section.size, &data))
+        {
+            continue;
+        }
+        auto version = getVersionFromElfSectionData(data.data(), data.size());
+        if (version) {
+            LOG(INFO) << "Version found in the " << section_name << " section of " << filename
+                      << ": " << version->first << "." << version->second;
+            return version;
+        }
     }
 
     return std::nullopt;
 }
 
 static PythonVersion
-getVersionFromMapInfo(const ProcessMemoryMapInfo& mapinfo)
+getVersionFromMapInfo(const ProcessMemoryMapInfo& mapinfo, const StringTable& strings)
 {
-    if (mapinfo.libpython && !mapinfo.libpython->Path().empty()) {
-        LOG(INFO) << "Trying to extract version from filename: " << mapinfo.libpython->Path();
-        auto version = inferVersionFromPath(mapinfo.libpython->Path());
+    bool has_libpython = mapinfo.libpython && mapinfo.libpython->hasPath();
+    if (has_libpython) {
+        LOG(INFO) << "Trying to extract version from filename: " << mapinfo.libpython->Path(strings);
+        auto version = inferVersionFromPath(mapinfo.libpython->Path(strings));
         if (version) {
             return *version;
         }
     }
 
-    if (!mapinfo.python.Path().empty()) {
-        LOG(INFO) << "Trying to extract version from filename: " << mapinfo.python.Path();
-        auto version = inferVersionFromPath(mapinfo.python.Path());
+    if (mapinfo.python.hasPath()) {
+        LOG(INFO) << "Trying to extract version from filename: " << mapinfo.python.Path(strings);
+        auto version = inferVersionFromPath(mapinfo.python.Path(strings));
         if (version) {
             return *version;
         }
+    }
 
-        LOG(INFO) << "Could not find version by looking at library or binary path: "
-                     "Trying to get it from running python --version";
-        auto bin_version = getVersionFromBinary(mapinfo.python.Path());
-        if (bin_version) {
-            return *bin_version;
+    LOG(INFO) << "Could not find version by looking at library or binary path: "
+                 "Trying to get it from their ELF data";
+    if (has_libpython) {
+        auto version = getVersionFromElf(mapinfo.libpython->Path(strings));
+        if (version) {
+            return *version;
+        }
+    }
+    if (mapinfo.python.hasPath()) {
+        auto version = getVersionFromElf(mapinfo.python.Path(strings));
+        if (version) {
+            return *version;
         }
     }
 
-    throw std::runtime_error("Could not determine python version from " + mapinfo.python.Path());
+    throw std::runtime_error("Could not determine python version from " + mapinfo.python.Path(strings));
 }
 
 PythonVersion
 getVersionForProcess(
         pid_t pid,
         const ProcessMemoryMapInfo& mapinfo,
+        const StringTable& strings,
         AbstractRemoteMemoryManager* manager)
 {
     if (mapinfo.bss) {
@@ -182,11 +433,14 @@ getVersionForProcess(
         }
     }
 
-    return getVersionFromMapInfo(mapinfo);
+    return getVersionFromMapInfo(mapinfo, strings);
 }
 
 PythonVersion
-getVersionForCore(const std::string& corefile, const ProcessMemoryMapInfo& mapinfo)
+getVersionForCore(
+        const std::string& corefile,
+        const ProcessMemoryMapInfo& mapinfo,
+        const StringTable& strings)
 {
     if (mapinfo.bss) {
         auto version = scanCoreBssForVersion(corefile, *mapinfo.bss);
@@ -197,7 +451,7 @@ getVersionForCore(const std::string& corefile, const ProcessMemoryMapInfo& mapin
         }
     }
 
-    return getVersionFromMapInfo(mapinfo);
+    return getVersionFromMapInfo(mapinfo, strings);
 }
 
 }  // namespace pystack
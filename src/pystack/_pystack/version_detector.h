@@ -1,5 +1,6 @@
 #pragma once
 
+#include <optional>
 #include <string>
 #include <utility>
 
@@ -14,9 +15,19 @@ PythonVersion
 getVersionForProcess(
         pid_t pid,
         const ProcessMemoryMapInfo& mapinfo,
+        const StringTable& strings,
         AbstractRemoteMemoryManager* manager);
 
 PythonVersion
-getVersionForCore(const std::string& corefile, const ProcessMemoryMapInfo& mapinfo);
+getVersionForCore(
+        const std::string& corefile,
+        const ProcessMemoryMapInfo& mapinfo,
+        const StringTable& strings);
+
+// Finds the Python version in the contents of a data section of a Python
+// binary or libpython, preferring a full Py_GetVersion() string over a bare
+// PY_VERSION literal.
+std::optional<PythonVersion>
+getVersionFromElfSectionData(const char* data, size_t size);
 
 }  // namespace pystack
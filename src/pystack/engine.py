@@ -1,13 +1,21 @@
 from ._pystack import CoreFileAnalyzer
 from ._pystack import NativeReportingMode
+from ._pystack import SamplingSession
+from ._pystack import StackAggregator
 from ._pystack import StackMethod
+from ._pystack import StopMethod
 from ._pystack import get_process_threads
 from ._pystack import get_process_threads_for_core
+from ._pystack import get_processes_threads
 
 __all__ = [
     "CoreFileAnalyzer",
     "StackMethod",
+    "StopMethod",
     "NativeReportingMode",
+    "SamplingSession",
+    "StackAggregator",
     "get_process_threads",
     "get_process_threads_for_core",
+    "get_processes_threads",
 ]
@@ -1,12 +1,15 @@
 """Process utility functions.
 
-This module provides utility functions for checking file types
-and decompressing gzip files.
+This module provides utility functions for checking file types,
+decompressing gzip files and finding the descendants of a process.
 """
 
+import collections
 import gzip
 import pathlib
 import tempfile
+from typing import Dict
+from typing import List
 
 
 def is_elf(filename: pathlib.Path) -> bool:
@@ -56,3 +59,34 @@ def decompress_gzip(
                     break
                 temp_file.write(chunk)
     return pathlib.Path(temp_file.name)
+
+
+def get_process_tree(pid: int, proc: pathlib.Path = pathlib.Path("/proc")) -> List[int]:
+    """Return the given PID followed by the PIDs of all of its descendants.
+
+    Args:
+        pid: The PID of the root of the process tree.
+        proc: The mount point of procfs.
+
+    Returns:
+        The PIDs of the tree in breadth-first order, so parents always come
+        before their children.
+    """
+    children: Dict[int, List[int]] = collections.defaultdict(list)
+    for stat_file in proc.glob("[0-9]*/stat"):
+        try:
+            stat = stat_file.read_text()
+        except OSError:
+            continue  # The process exited
+        # The command name is enclosed in parentheses and may contain spaces
+        # and parentheses itself, so parse the fields after the last one.
+        state_and_ppid = stat[stat.rindex(")") + 2 :].split()
+        children[int(state_and_ppid[1])].append(int(stat_file.parent.name))
+
+    tree = []
+    pending = collections.deque([pid])
+    while pending:
+        current = pending.popleft()
+        tree.append(current)
+        pending.extend(sorted(children.get(current, [])))
+    return tree
@@ -66,6 +66,13 @@ def format_frame(frame: PyFrame) -> Iterable[str]:
             yield f"        {local}: {value}"
 
 
+def _describe_threads(thread: PyThread) -> str:
+    if thread.tids is None or len(thread.tids) == 1:
+        return f"thread {thread.tid}"
+    tids = ", ".join(str(tid) for tid in thread.tids)
+    return f"{len(thread.tids)} threads ({tids})"
+
+
 def _are_the_stacks_mergeable(thread: PyThread) -> bool:
     eval_frames = (
         frame
@@ -86,13 +93,13 @@ def format_thread(
     native = native_mode != NativeReportingMode.OFF
     current_frame: Optional[PyFrame] = thread.first_frame
     if current_frame is None and not native and not show_interpreter:
-        yield f"The frame stack for thread {thread.tid} is empty"
+        yield f"The frame stack for {_describe_threads(thread)} is empty"
         return
 
     thread_name = f" ({thread.name}) " if thread.name else " "
     if show_thread_header:
         yield (
-            f"Traceback for thread {thread.tid}{thread_name}"
+            f"Traceback for {_describe_threads(thread)}{thread_name}"
             f"{thread.status + ' ' if not show_interpreter else ''}"
             f"(most recent call last):"
         )
@@ -108,6 +108,12 @@ class PyThread:
     python_version: Optional[Tuple[int, int]]
     name: Optional[str] = None
     interpreter_id: Optional[int] = None
+    # When threads with identical stacks are grouped, the TIDs of every
+    # thread of the group, including this one.
+    tids: Optional[List[int]] = None
+    # False when part of the thread was skipped because the analysis ran out
+    # of time (see the timeout argument of get_process_threads).
+    complete: bool = True
 
     @property
     def frames(self) -> Iterable[PyFrame]:
@@ -135,6 +141,8 @@ class PyThread:
             status.append(gil_status)
         if gc_status:
             status.append(gc_status)
+        if not self.complete:
+            status.append("Incomplete")
         return "[" + ",".join(status) + "]"
 
     @property
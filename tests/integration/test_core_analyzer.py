@@ -253,6 +253,40 @@ def test_multiple_thread_stack_native(
         )
 
 
+@ALL_PYTHONS
+def test_multiple_thread_stack_filtered_by_tid(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with generate_core_file(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as core_file:
+        all_threads = list(get_process_threads_for_core(core_file, python_executable))
+        main_tid = next(
+            thread.tid
+            for thread in all_threads
+            if [frame.code.scope for frame in thread.frames][:1] == ["<module>"]
+        )
+        threads = list(
+            get_process_threads_for_core(core_file, python_executable, tids=[main_tid])
+        )
+        no_threads = list(
+            get_process_threads_for_core(core_file, python_executable, tids=[0])
+        )
+
+    # THEN
+
+    assert len(all_threads) == 4
+    assert [thread.tid for thread in threads] == [main_tid]
+    (thread,) = threads
+    functions = [frame.code.scope for frame in thread.frames]
+    assert functions == ["<module>", "first_func", "second_func", "third_func"]
+    assert no_threads == []
+
+
 def test_thread_registered_with_python_with_other_threads(tmpdir):
     # WHEN
     extension_name = "empty_thread_extension_with_os_threads"
@@ -3,8 +3,12 @@ import subprocess
 import sys
 from pathlib import Path
 
+import pytest
+
 from pystack.engine import NativeReportingMode
+from pystack.engine import StopMethod
 from pystack.engine import get_process_threads
+from pystack.errors import NotEnoughInformation
 from pystack.types import LocationInfo
 from pystack.types import NativeFrame
 from pystack.types import frame_type
@@ -215,6 +219,412 @@ def test_single_thread_stack_native(python, method, blocking, tmpdir):
         assert any(frame.path and "?" not in frame.path for frame in eval_frames)
 
 
+@ALL_PYTHONS
+def test_single_thread_stack_native_frame_pointers(python, tmpdir):
+    # GIVEN
+
+    (major_version, minor_version), python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_SINGLE_THREAD_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+                frame_pointers=True,
+            )
+        )
+        cfi_threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 1
+    (thread,) = threads
+
+    functions = [frame.code.scope for frame in thread.frames]
+    assert functions == ["<module>", "first_func", "second_func", "third_func"]
+
+    eval_frames = [
+        frame
+        for frame in thread.native_frames
+        if frame_type(frame, thread.python_version) == NativeFrame.FrameType.EVAL
+    ]
+    if python_has_inlined_eval_frames(major_version, minor_version):  # pragma: no cover
+        assert len(eval_frames) == 1
+    else:  # pragma: no cover
+        assert len(eval_frames) >= 4
+    assert all("?" not in frame.symbol for frame in eval_frames)
+
+    # The child is blocked in the same place for both unwinds, so following
+    # the frame pointers must find the same frames as the CFI.
+    (cfi_thread,) = cfi_threads
+    assert [frame.symbol for frame in thread.native_frames] == [
+        frame.symbol for frame in cfi_thread.native_frames
+    ]
+
+
+@ALL_PYTHONS
+def test_single_thread_stack_native_symbols_only(python, tmpdir):
+    # GIVEN
+
+    (major_version, minor_version), python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_SINGLE_THREAD_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.SYMBOLS,
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 1
+    (thread,) = threads
+
+    functions = [frame.code.scope for frame in thread.frames]
+    assert functions == ["<module>", "first_func", "second_func", "third_func"]
+
+    assert thread.native_frames
+    assert all(frame.linenumber == 0 for frame in thread.native_frames)
+    assert all(
+        frame.path == ("???" if frame.symbol != "???" else frame.library)
+        for frame in thread.native_frames
+    )
+
+    eval_frames = [
+        frame
+        for frame in thread.native_frames
+        if frame_type(frame, thread.python_version) == NativeFrame.FrameType.EVAL
+    ]
+    if python_has_inlined_eval_frames(major_version, minor_version):  # pragma: no cover
+        assert len(eval_frames) == 1
+    else:  # pragma: no cover
+        assert len(eval_frames) >= 4
+    assert all("?" not in frame.symbol for frame in eval_frames)
+
+
+@ALL_PYTHONS
+def test_multiple_thread_stack_native_stopped_with_signal(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+                stop_method=StopMethod.SIGNAL,
+            )
+        )
+        # The process must have been resumed
+        assert child_process.poll() is None
+        with open(f"/proc/{child_process.pid}/stat") as stat:
+            assert stat.read().rpartition(")")[2].split()[0] != "T"
+
+    # THEN
+
+    assert len(threads) == 4
+    main_thread = next(
+        thread for thread in threads if thread.tid == child_process.pid
+    )
+    functions = [frame.code.scope for frame in main_thread.frames]
+    assert functions == ["<module>", "first_func", "second_func", "third_func"]
+    assert all(thread.native_frames for thread in threads)
+
+
+@ALL_PYTHONS
+@pytest.mark.parametrize(
+    "native_mode", [NativeReportingMode.OFF, NativeReportingMode.PYTHON]
+)
+def test_multiple_thread_stack_grouped(python, native_mode, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid, native_mode=native_mode, group=True
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 2
+    main_thread, workers = sorted(threads, key=lambda thread: len(thread.tids))
+    assert main_thread.tids == [main_thread.tid]
+    assert len(workers.tids) == 3
+    assert workers.tid == workers.tids[0]
+    assert main_thread.tid not in workers.tids
+    functions = [frame.code.scope for frame in workers.frames]
+    assert functions[-3:] == ["thread_func_1", "thread_func_2", "thread_func_3"]
+
+
+@ALL_PYTHONS
+def test_multiple_thread_stack_native_timings(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+    timings = {}
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+                timings=timings,
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 4
+    phases = timings["phases"]
+    for phase in (
+        "attach",
+        "maps_parsing",
+        "version_detection",
+        "interpreter_discovery",
+        "thread_walk",
+        "frame_decode",
+        "native_unwind",
+        "symbolization",
+        "object_construction",
+    ):
+        assert phases[phase] >= 0
+    assert sum(phases.values()) <= timings["total"]
+    assert 0 <= timings["stop_skew"] <= timings["target_stopped"] <= timings["total"]
+
+
+@ALL_PYTHONS
+def test_multiple_thread_stack_within_timeout(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+                locals=True,
+                timeout=60,
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 4
+    assert all(thread.complete for thread in threads)
+    assert all(thread.native_frames for thread in threads)
+
+
+def test_expired_timeout_stops_the_analysis(tmpdir):
+    # GIVEN
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        # WHEN / THEN
+
+        with pytest.raises(NotEnoughInformation):
+            get_process_threads(child_process.pid, timeout=1e-9)
+
+        with open(f"/proc/{child_process.pid}/status") as status_file:
+            tracer_pid = [
+                line.split()[1]
+                for line in status_file
+                if line.startswith("TracerPid:")
+            ]
+
+    assert tracer_pid == ["0"]
+
+
+def test_invalid_timeout():
+    # GIVEN/WHEN/THEN
+
+    with pytest.raises(ValueError, match="timeout must be positive"):
+        get_process_threads(1, timeout=0)
+
+
+@ALL_PYTHONS
+@pytest.mark.parametrize(
+    "native_mode", [NativeReportingMode.PYTHON, NativeReportingMode.ALL]
+)
+def test_multiple_thread_stack_filtered_by_tid(python, native_mode, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        all_threads = list(get_process_threads(child_process.pid))
+        worker_tid = next(
+            thread.tid for thread in all_threads if thread.tid != child_process.pid
+        )
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=native_mode,
+                tids=[child_process.pid, worker_tid],
+            )
+        )
+
+    # THEN
+
+    assert len(all_threads) == 4
+    assert sorted(thread.tid for thread in threads) == sorted(
+        [child_process.pid, worker_tid]
+    )
+    main_thread = next(thread for thread in threads if thread.tid == child_process.pid)
+    functions = [frame.code.scope for frame in main_thread.frames]
+    assert functions == ["<module>", "first_func", "second_func", "third_func"]
+    assert all(thread.native_frames for thread in threads)
+
+
+@ALL_PYTHONS
+def test_multiple_thread_stack_filtered_by_name(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        all_threads = list(get_process_threads(child_process.pid))
+        main_thread = next(
+            thread for thread in all_threads if thread.tid == child_process.pid
+        )
+        threads = list(
+            get_process_threads(child_process.pid, thread_name=main_thread.name)
+        )
+        no_threads = list(
+            get_process_threads(child_process.pid, thread_name="no-such-thread-*")
+        )
+
+    # THEN
+
+    assert main_thread.name
+    assert child_process.pid in [thread.tid for thread in threads]
+    assert all(thread.name == main_thread.name for thread in threads)
+    assert no_threads == []
+
+
+@ALL_PYTHONS
+def test_multiple_thread_stack_native_non_blocking(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+    timings = {}
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                native_mode=NativeReportingMode.PYTHON,
+                stop_process=False,
+                timings=timings,
+            )
+        )
+        with open(f"/proc/{child_process.pid}/status") as status_file:
+            tracer_pid = [
+                line.split()[1]
+                for line in status_file
+                if line.startswith("TracerPid:")
+            ]
+
+    # THEN
+
+    assert len(threads) == 4
+    for thread in threads:
+        assert thread.native_frames
+        eval_frames = [
+            frame
+            for frame in thread.native_frames
+            if frame_type(frame, thread.python_version) == NativeFrame.FrameType.EVAL
+        ]
+        assert len(eval_frames) == sum(frame.is_entry for frame in thread.frames)
+    assert tracer_pid == ["0"]
+    # Threads are stopped one at a time, so no stop skew is reported, and
+    # only the longest pause of a single thread counts as time stopped.
+    assert "attach" not in timings["phases"]
+    assert timings["stop_skew"] is None
+    assert 0 <= timings["target_stopped"] <= timings["total"]
+
+
+@ALL_PYTHONS
+def test_parallel_symbolization_matches_serial(python, tmpdir, monkeypatch):
+    # GIVEN
+
+    _, python_executable = python
+
+    def native_stacks():
+        threads = get_process_threads(
+            child_process.pid, native_mode=NativeReportingMode.PYTHON
+        )
+        return {
+            thread.tid: [
+                (frame.address, frame.symbol, frame.path, frame.linenumber)
+                for frame in thread.native_frames
+            ]
+            for thread in threads
+        }
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        parallel = native_stacks()
+        monkeypatch.setenv("_PYSTACK_NO_PARALLEL_SYMBOLIZATION", "1")
+        serial = native_stacks()
+
+    # THEN
+
+    assert len(parallel) == 4
+    assert all(parallel.values())
+    assert parallel == serial
+
+
 @all_pystack_combinations(native=True)
 def test_multiple_thread_stack_native(python, method, blocking, tmpdir):
     # GIVEN
@@ -38,6 +38,31 @@ def test_gc_status_is_reported_when_garbage_collecting_in_process(python, tmpdir
     assert {thread.gc_status for thread in threads} == {"", "Garbage collecting"}
 
 
+@ALL_PYTHONS_WITH_SYMBOLS
+def test_only_the_garbage_collecting_thread_is_reported(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(python_executable, TEST_GC, tmpdir) as child_process:
+        threads = list(
+            get_process_threads(
+                child_process.pid,
+                stop_process=True,
+                native_mode=NativeReportingMode.PYTHON,
+                gc_only=True,
+            )
+        )
+
+    # THEN
+
+    assert [thread.tid for thread in threads] == [child_process.pid]
+    (thread,) = threads
+    assert thread.gc_status == "Garbage collecting"
+
+
 @ALL_PYTHONS
 def test_gc_status_is_reported_when_no_garbage_collecting_in_process(python, tmpdir):
     # GIVEN
@@ -86,6 +111,31 @@ def test_gc_status_is_reported_when_garbage_collecting_in_core(python, tmpdir):
     assert {thread.gc_status for thread in threads} == {"", "Garbage collecting"}
 
 
+@ALL_PYTHONS_WITH_SYMBOLS
+def test_only_the_garbage_collecting_thread_is_reported_in_core(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with generate_core_file(python_executable, TEST_GC, tmpdir) as core_file:
+        threads = list(
+            get_process_threads_for_core(
+                core_file,
+                Path(python_executable),
+                native_mode=NativeReportingMode.PYTHON,
+                gc_only=True,
+            )
+        )
+
+    # THEN
+
+    assert len(threads) == 1
+    (thread,) = threads
+    assert thread.gc_status == "Garbage collecting"
+
+
 @ALL_PYTHONS
 def test_gc_status_is_reported_when_no_garbage_collecting_in_core(python, tmpdir):
     # GIVEN
@@ -44,6 +44,31 @@ def test_gil_status_one_thread_among_many_holds_the_gil(python, tmpdir):
     assert sorted(thread.holds_the_gil for thread in threads) == [0, 0, 0, 1]
 
 
+@ALL_PYTHONS
+def test_only_the_thread_holding_the_gil_is_reported(python, tmpdir):
+    # GIVEN
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_GIL_FILE, tmpdir
+    ) as child_process:
+        threads = list(get_process_threads(child_process.pid, gil_only=True))
+
+    # THEN
+
+    assert [thread.tid for thread in threads] == [child_process.pid]
+    (thread,) = threads
+    assert thread.holds_the_gil
+    assert [frame.code.scope for frame in thread.frames] == [
+        "<module>",
+        "first_func",
+        "second_func",
+        "third_func",
+    ]
+
+
 @ALL_PYTHONS
 def test_gil_status_no_thread_among_many_holds_the_gil(python, tmpdir):
     # GIVEN
@@ -123,6 +148,31 @@ def test_gil_status_one_thread_among_many_holds_the_gil_for_core(python, tmpdir)
     assert sorted(thread.holds_the_gil for thread in threads) == [0, 0, 0, 1]
 
 
+@ALL_PYTHONS
+def test_only_the_thread_holding_the_gil_is_reported_for_core(python, tmpdir):
+    # GIVEN
+    _, python_executable = python
+
+    # WHEN
+
+    with generate_core_file(
+        python_executable, TEST_MULTIPLE_THREADS_GIL_FILE, tmpdir
+    ) as core_file:
+        all_threads = list(
+            get_process_threads_for_core(core_file, Path(python_executable))
+        )
+        threads = list(
+            get_process_threads_for_core(
+                core_file, Path(python_executable), gil_only=True
+            )
+        )
+
+    # THEN
+
+    (gil_holder,) = [thread for thread in all_threads if thread.holds_the_gil]
+    assert [thread.tid for thread in threads] == [gil_holder.tid]
+
+
 @ALL_PYTHONS
 def test_gil_status_no_thread_among_many_holds_the_gil_for_core(python, tmpdir):
     """Generate a core file for a process with multiple threads in which we know
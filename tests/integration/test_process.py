@@ -1,3 +1,4 @@
+import os
 import sys
 import threading
 from concurrent.futures import ThreadPoolExecutor
@@ -7,12 +8,16 @@ import pytest
 
 from pystack._pystack import ProcessManager
 from pystack.engine import get_process_threads
+from pystack.engine import get_processes_threads
+from pystack.errors import EngineError
+from pystack.process import get_process_tree
 from pystack.process import is_elf
 from tests.utils import ALL_PYTHONS
 from tests.utils import spawn_child_process
 
 TEST_SINGLE_THREAD_FILE = Path(__file__).parent / "single_thread_program.py"
 TEST_SHUTDOWN_FILE = Path(__file__).parent / "shutdown_program.py"
+TEST_MULTIPLE_THREADS_FILE = Path(__file__).parent / "multiple_thread_program.py"
 
 
 @ALL_PYTHONS
@@ -114,3 +119,96 @@ def test_invalid_method_for_get_process_threads():
                 method=None,  # type: ignore
             )
         )
+
+
+@ALL_PYTHONS
+def test_get_processes_threads(python, tmpdir):
+    # GIVEN
+    _, python_executable = python
+
+    with (
+        spawn_child_process(
+            python_executable, TEST_SINGLE_THREAD_FILE, tmpdir.mkdir("first")
+        ) as first_child,
+        spawn_child_process(
+            python_executable, TEST_SINGLE_THREAD_FILE, tmpdir.mkdir("second")
+        ) as second_child,
+    ):
+        # WHEN
+        results = get_processes_threads(
+            [first_child.pid, second_child.pid], max_workers=2
+        )
+
+    # THEN
+
+    assert set(results) == {first_child.pid, second_child.pid}
+    for threads in results.values():
+        (thread,) = list(threads)
+        assert [frame.code.scope for frame in thread.frames] == [
+            "<module>",
+            "first_func",
+            "second_func",
+            "third_func",
+        ]
+
+
+@ALL_PYTHONS
+def test_get_processes_threads_filters_threads(python, tmpdir):
+    # GIVEN
+    _, python_executable = python
+
+    with (
+        spawn_child_process(
+            python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir.mkdir("first")
+        ) as first_child,
+        spawn_child_process(
+            python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir.mkdir("second")
+        ) as second_child,
+    ):
+        pids = [first_child.pid, second_child.pid]
+
+        # WHEN
+        results = get_processes_threads(pids, max_workers=2, tids=pids)
+        unnamed_results = get_processes_threads(
+            pids, max_workers=2, thread_name="no-such-thread-*"
+        )
+
+    # THEN
+
+    assert set(results) == set(pids)
+    for pid, threads in results.items():
+        assert [thread.tid for thread in threads] == [pid]
+    assert {pid: list(threads) for pid, threads in unnamed_results.items()} == {
+        pid: [] for pid in pids
+    }
+
+
+def test_get_processes_threads_reports_errors_per_process(tmpdir):
+    # GIVEN
+
+    with spawn_child_process(
+        sys.executable, TEST_SINGLE_THREAD_FILE, tmpdir
+    ) as child_process:
+        # WHEN
+        results = get_processes_threads([child_process.pid, 0])
+
+    # THEN
+
+    assert len(list(results[child_process.pid])) == 1
+    assert isinstance(results[0], EngineError)
+    assert results[0].pid == 0
+
+
+def test_get_process_tree(tmpdir):
+    # GIVEN
+
+    with spawn_child_process(
+        sys.executable, TEST_SINGLE_THREAD_FILE, tmpdir
+    ) as child_process:
+        # WHEN
+        tree = get_process_tree(os.getpid())
+
+    # THEN
+
+    assert tree[0] == os.getpid()
+    assert child_process.pid in tree
@@ -0,0 +1,213 @@
+import sys
+import threading
+from pathlib import Path
+
+import pytest
+
+from pystack.engine import NativeReportingMode
+from pystack.engine import SamplingSession
+from pystack.engine import StackAggregator
+from tests.utils import ALL_PYTHONS
+from tests.utils import spawn_child_process
+
+TEST_MULTIPLE_THREADS_FILE = Path(__file__).parent / "multiple_thread_program.py"
+
+
+def _process_status(pid):
+    status = {}
+    with open(f"/proc/{pid}/status") as status_file:
+        for line in status_file:
+            key, _, value = line.partition(":")
+            status[key] = value.strip()
+    return status
+
+
+@ALL_PYTHONS
+def test_sampling_session_repeated_snapshots(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with SamplingSession(child_process.pid) as session:
+            snapshots = [list(session.snapshot()) for _ in range(3)]
+
+    # THEN
+
+    for threads in snapshots:
+        assert len(threads) == 4
+        stacks = sorted(
+            [frame.code.scope for frame in thread.frames] for thread in threads
+        )
+        assert stacks[0] == ["<module>", "first_func", "second_func", "third_func"]
+        for stack in stacks[1:]:
+            assert stack[-3:] == ["thread_func_1", "thread_func_2", "thread_func_3"]
+    assert [{thread.tid for thread in threads} for threads in snapshots] == [
+        {thread.tid for thread in snapshots[0]}
+    ] * 3
+
+
+@ALL_PYTHONS
+def test_sampling_session_native_reuses_setup(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+    first_timings = {}
+    second_timings = {}
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with SamplingSession(
+            child_process.pid, native_mode=NativeReportingMode.PYTHON
+        ) as session:
+            first = list(session.snapshot(timings=first_timings))
+            second = list(session.snapshot(timings=second_timings))
+
+    # THEN
+
+    for threads in (first, second):
+        assert len(threads) == 4
+        assert all(thread.native_frames for thread in threads)
+    assert "dwfl_setup" in first_timings["phases"]
+    assert "dwfl_setup" not in second_timings["phases"]
+    assert "version_detection" not in second_timings["phases"]
+    assert second_timings["target_stopped"] <= second_timings["total"]
+
+
+@ALL_PYTHONS
+def test_sampling_session_aggregates_stacks(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+    aggregator = StackAggregator()
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with SamplingSession(child_process.pid, stop_process=False) as session:
+            sampled = [session.sample(aggregator) for _ in range(5)]
+
+    # THEN
+
+    assert sampled == [4] * 5
+    assert aggregator.samples == 20
+    assert aggregator.truncated_samples == 0
+    stacks = dict(aggregator.collapsed())
+    assert sum(stacks.values()) == 20
+    main_stacks = [stack for stack in stacks if stack.startswith("<module> ")]
+    assert len(main_stacks) == 1
+    assert [frame.split(" ")[0] for frame in main_stacks[0].split(";")] == [
+        "<module>",
+        "first_func",
+        "second_func",
+        "third_func",
+    ]
+    assert stacks[main_stacks[0]] == 5
+
+
+@ALL_PYTHONS
+def test_sampling_session_aggregator_is_bounded(python, tmpdir):
+    # GIVEN
+
+    _, python_executable = python
+    aggregator = StackAggregator(max_nodes=2)
+
+    # WHEN
+
+    with spawn_child_process(
+        python_executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with SamplingSession(child_process.pid) as session:
+            session.sample(aggregator)
+
+    # THEN
+
+    assert aggregator.nodes == 2
+    assert aggregator.samples == 4
+    assert aggregator.truncated_samples == 4
+    assert all(len(stack.split(";")) <= 2 for stack, _ in aggregator.collapsed())
+
+
+def test_sampling_session_resumes_process_between_snapshots(tmpdir):
+    # GIVEN
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        # WHEN
+        with SamplingSession(child_process.pid) as session:
+            after_creation = _process_status(child_process.pid)
+            session.snapshot()
+            after_snapshot = _process_status(child_process.pid)
+
+    # THEN
+
+    for status in (after_creation, after_snapshot):
+        assert status["TracerPid"] == "0"
+        assert not status["State"].startswith(("t", "T"))
+
+
+def test_sampling_session_closed(tmpdir):
+    # GIVEN
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        session = SamplingSession(child_process.pid)
+
+        # WHEN
+
+        session.close()
+
+        # THEN
+
+        with pytest.raises(RuntimeError):
+            session.snapshot()
+
+
+
+def test_sampling_session_rejects_concurrent_use(tmpdir):
+    # GIVEN
+
+    results = []
+    barrier = threading.Barrier(4)
+
+    def take_snapshots(session):
+        barrier.wait()
+        for _ in range(10):
+            try:
+                results.append(len(session.snapshot()))
+            except RuntimeError as exc:
+                results.append(str(exc))
+
+    # WHEN
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with SamplingSession(child_process.pid) as session:
+            threads = [
+                threading.Thread(target=take_snapshots, args=(session,))
+                for _ in range(4)
+            ]
+            for thread in threads:
+                thread.start()
+            for thread in threads:
+                thread.join()
+            after = list(session.snapshot())
+
+    # THEN
+
+    assert len(results) == 40
+    assert 4 in results
+    assert set(results) <= {4, "The sampling session is being used by another thread"}
+    assert len(after) == 4
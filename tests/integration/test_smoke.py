@@ -13,6 +13,7 @@ from tests.utils import spawn_child_process
 from tests.utils import xfail_on_expected_exceptions
 
 TEST_SINGLE_THREAD_FILE = Path(__file__).parent / "single_thread_program.py"
+TEST_MULTIPLE_THREADS_FILE = Path(__file__).parent / "multiple_thread_program.py"
 
 if sys.version_info < (3, 10):  # pragma: no cover
     STACK_METHODS = (StackMethod.SYMBOLS, StackMethod.BSS, StackMethod.HEAP)
@@ -70,6 +71,49 @@ def test_simple_execution(method, blocking, use_process_vm_readv, tmpdir, monkey
     assert threads is not None
 
 
+# The methods that scan memory areas for a pointer to the interpreter state.
+# The bss section only holds one before Python 3.10.
+if sys.version_info < (3, 10):  # pragma: no cover
+    HEURISTIC_STACK_METHODS = (StackMethod.BSS, StackMethod.HEAP)
+else:  # pragma: no cover
+    HEURISTIC_STACK_METHODS = (StackMethod.HEAP,)
+
+
+@pytest.mark.parametrize("method", HEURISTIC_STACK_METHODS)
+@pytest.mark.parametrize("use_pagemap", [True, False], ids=["pagemap", "no-pagemap"])
+def test_heuristic_scanning(method, use_pagemap, tmpdir, monkeypatch):
+    """Test that scanning memory for the interpreter state works both when
+    only resident pages are scanned and when whole regions are read.
+
+    The program has several threads, so that thread states are allocated on
+    the heap on every Python version.
+    """
+
+    # GIVEN
+    env_var = "_PYSTACK_NO_PAGEMAP"
+    if use_pagemap:
+        monkeypatch.delenv(env_var, raising=False)
+    else:
+        monkeypatch.setenv(env_var, "1")
+
+    # WHEN
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        with xfail_on_expected_exceptions(method):
+            threads = list(get_process_threads(child_process.pid, method=method))
+
+    # THEN
+    assert len(threads) == 4
+    (main_thread,) = [thread for thread in threads if thread.tid == child_process.pid]
+    assert [frame.code.scope for frame in main_thread.frames] == [
+        "<module>",
+        "first_func",
+        "second_func",
+        "third_func",
+    ]
+
+
 @pytest.mark.parametrize("method", STACK_METHODS)
 def test_simple_execution_native(method, tmpdir):
     """Test that we can retrieve the thread state of a single process.
@@ -0,0 +1,82 @@
+import os
+import re
+import subprocess
+import sys
+from pathlib import Path
+
+from tests.utils import spawn_child_process
+
+TEST_MULTIPLE_THREADS_FILE = Path(__file__).parent / "multiple_thread_program.py"
+CACHE_HEADER_SIZE = 12
+
+
+def _run_pystack(pid, cache_dir):
+    result = subprocess.run(
+        [sys.executable, "-m", "pystack", "remote", str(pid), "--native", "-vv"],
+        capture_output=True,
+        text=True,
+        check=True,
+        env={**os.environ, "PYSTACK_SYMBOL_CACHE_DIR": str(cache_dir)},
+    )
+    loaded = re.findall(r"Loaded (\d+) entries from the symbol cache", result.stderr)
+    assert loaded
+    return result.stdout, sum(int(entries) for entries in loaded)
+
+
+def test_symbol_cache_serves_second_run(tmpdir):
+    # GIVEN
+
+    cache_dir = Path(tmpdir) / "nested" / "cache"
+
+    # WHEN
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        first_output, first_entries = _run_pystack(child_process.pid, cache_dir)
+        second_output, second_entries = _run_pystack(child_process.pid, cache_dir)
+
+    # THEN
+
+    assert list(cache_dir.glob("*.symbols"))
+    assert first_entries == 0
+    assert second_entries > 0
+    assert second_output == first_output
+
+
+def test_symbol_cache_recovers_from_interrupted_writes(tmpdir):
+    # GIVEN
+
+    cache_dir = Path(tmpdir) / "cache"
+
+    with spawn_child_process(
+        sys.executable, TEST_MULTIPLE_THREADS_FILE, tmpdir
+    ) as child_process:
+        expected_output, _ = _run_pystack(child_process.pid, cache_dir)
+        _, expected_entries = _run_pystack(child_process.pid, cache_dir)
+
+        # WHEN
+
+        # Leave part of a record in the middle of every file, followed by
+        # complete records, as a write cut short by another process would.
+        for cache_file in cache_dir.glob("*.symbols"):
+            data = cache_file.read_bytes()
+            header, records = data[:CACHE_HEADER_SIZE], data[CACHE_HEADER_SIZE:]
+            cache_file.write_bytes(header + records[: len(records) // 2 + 3] + records)
+        torn_output, torn_entries = _run_pystack(child_process.pid, cache_dir)
+
+        # Cut the last record of every file short
+        for cache_file in cache_dir.glob("*.symbols"):
+            data = cache_file.read_bytes()
+            cache_file.write_bytes(data[:-3])
+        truncated_output, truncated_entries = _run_pystack(
+            child_process.pid, cache_dir
+        )
+
+    # THEN
+
+    assert expected_entries > 0
+    assert torn_entries == expected_entries
+    assert torn_output == expected_output
+    assert 0 < truncated_entries <= expected_entries
+    assert truncated_output == expected_output
@@ -12,10 +12,12 @@ from pystack.__main__ import PERMISSION_ERROR_MSG
 from pystack.__main__ import PERMISSION_HELP_TEXT
 from pystack.__main__ import format_failureinfo_information
 from pystack.__main__ import format_psinfo_information
+from pystack.__main__ import format_timings
 from pystack.__main__ import main
 from pystack.__main__ import produce_error_message
 from pystack.engine import NativeReportingMode
 from pystack.engine import StackMethod
+from pystack.engine import StopMethod
 from pystack.errors import EXECUTABLE_NOT_FOUND_HELP_TEXT
 from pystack.errors import INVALID_EXECUTABLE_HELP_TEXT
 from pystack.errors import MISSING_EXECUTABLE_MAPS_HELP_TEXT
@@ -203,6 +205,15 @@ def test_process_remote_default():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -232,6 +243,15 @@ def test_process_remote_no_block():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -242,6 +262,7 @@ def test_process_remote_no_block():
         ["--native", NativeReportingMode.PYTHON],
         ["--native-all", NativeReportingMode.ALL],
         ["--native-last", NativeReportingMode.LAST],
+        ["--native-symbols", NativeReportingMode.SYMBOLS],
     ],
 )
 def test_process_remote_native(argument, mode):
@@ -269,6 +290,15 @@ def test_process_remote_native(argument, mode):
         native_mode=mode,
         locals=False,
         method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, mode)
 
@@ -298,11 +328,20 @@ def test_process_remote_locals():
         native_mode=NativeReportingMode.OFF,
         locals=True,
         method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
 
-def test_process_remote_native_no_block(capsys):
+def test_process_remote_native_no_block():
     # GIVEN
 
     argv = ["pystack", "remote", "31", "--native", "--no-block"]
@@ -317,6 +356,163 @@ def test_process_remote_native_no_block(capsys):
         patch("sys.argv", argv),
     ):
         get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    get_process_threads_mock.assert_called_with(
+        31,
+        stop_process=False,
+        native_mode=NativeReportingMode.PYTHON,
+        locals=False,
+        method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
+    )
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.PYTHON)
+
+
+def test_process_remote_exhaustive():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--exhaustive"]
+
+    threads = [Mock(), Mock(), Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    get_process_threads_mock.assert_called_with(
+        31,
+        stop_process=True,
+        native_mode=NativeReportingMode.OFF,
+        locals=False,
+        method=StackMethod.ALL,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
+    )
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_remote_frame_pointers():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--native", "--frame-pointers"]
+
+    threads = [Mock(), Mock(), Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    get_process_threads_mock.assert_called_with(
+        31,
+        stop_process=True,
+        native_mode=NativeReportingMode.PYTHON,
+        locals=False,
+        method=StackMethod.AUTO,
+        frame_pointers=True,
+        stop_method=StopMethod.PTRACE,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
+    )
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.PYTHON)
+
+
+@pytest.mark.parametrize(
+    "argument, method",
+    [
+        ["ptrace", StopMethod.PTRACE],
+        ["cgroup", StopMethod.CGROUP],
+        ["signal", StopMethod.SIGNAL],
+    ],
+)
+def test_process_remote_stop_method(argument, method):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--stop-method", argument]
+
+    threads = [Mock(), Mock(), Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    get_process_threads_mock.assert_called_with(
+        31,
+        stop_process=True,
+        native_mode=NativeReportingMode.OFF,
+        locals=False,
+        method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=method,
+        timings=None,
+        group=False,
+        timeout=None,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
+    )
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_remote_stop_method_no_block():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--stop-method", "signal", "--no-block"]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
         # THEN
 
         with pytest.raises(SystemExit):
@@ -326,10 +522,47 @@ def test_process_remote_native_no_block(capsys):
     print_threads_mock.assert_not_called()
 
 
-def test_process_remote_exhaustive():
+def test_process_remote_timings(capsys):
     # GIVEN
 
-    argv = ["pystack", "remote", "31", "--exhaustive"]
+    argv = ["pystack", "remote", "31", "--timings"]
+
+    threads = [Mock(), Mock(), Mock()]
+
+    def fill_timings(*args, timings, **kwargs):
+        timings.update(
+            phases={"attach": 0.001, "thread_walk": 0.002},
+            total=0.004,
+            target_stopped=0.003,
+            stop_skew=0.0001,
+        )
+        return threads
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.side_effect = fill_timings
+        main()
+
+    # THEN
+
+    assert get_process_threads_mock.call_args.kwargs["timings"] is not None
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+    stderr = capsys.readouterr().err
+    assert "attach" in stderr
+    assert "thread walk" in stderr
+    assert "target stopped" in stderr
+    assert "3.000 ms" in stderr
+
+
+def test_process_remote_group():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--group"]
 
     threads = [Mock(), Mock(), Mock()]
 
@@ -345,16 +578,338 @@ def test_process_remote_exhaustive():
 
     # THEN
 
-    get_process_threads_mock.assert_called_with(
+    assert get_process_threads_mock.call_args.kwargs["group"] is True
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_remote_timeout():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--timeout", "0.5"]
+
+    threads = [Mock(), Mock(), Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    assert get_process_threads_mock.call_args.kwargs["timeout"] == 0.5
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_remote_frame_pointers_without_native_mode():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--frame-pointers"]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        # THEN
+
+        with pytest.raises(SystemExit):
+            main()
+
+    get_process_threads_mock.assert_not_called()
+
+
+@pytest.mark.parametrize("timeout", ["0", "-1"])
+def test_process_remote_invalid_timeout(timeout):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--timeout", timeout]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        # THEN
+
+        with pytest.raises(SystemExit):
+            main()
+
+    get_process_threads_mock.assert_not_called()
+
+
+@pytest.mark.parametrize(
+    "extra_args, expected",
+    [
+        (["--tid", "1", "--tid", "2"], {"tids": [1, 2]}),
+        (["--thread-name", "worker-*"], {"thread_name": "worker-*"}),
+        (["--gil-only"], {"gil_only": True}),
+        (["--gc-only"], {"gc_only": True}),
+    ],
+)
+def test_process_remote_thread_filters(extra_args, expected):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", *extra_args]
+
+    threads = [Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    filters = {"tids": None, "thread_name": None, "gil_only": False, "gc_only": False}
+    filters.update(expected)
+    kwargs = get_process_threads_mock.call_args.kwargs
+    assert {name: kwargs[name] for name in filters} == filters
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_remote_sample(capsys):
+    # GIVEN
+
+    argv = [
+        "pystack",
+        "remote",
+        "31",
+        "--sample",
+        "--rate",
+        "1000",
+        "--duration",
+        "0.01",
+    ]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.SamplingSession") as session_mock,
+        patch("pystack.__main__.StackAggregator") as aggregator_mock,
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        aggregator = aggregator_mock.return_value
+        aggregator.collapsed.return_value = [
+            ("<module> (a.py:1);f (a.py:2)", 3),
+            ("<module> (a.py:1);g (a.py:5)", 1),
+        ]
+        aggregator.truncated_samples = 0
+        main()
+
+    # THEN
+
+    session_mock.assert_called_once_with(
         31,
         stop_process=True,
+        method=StackMethod.AUTO,
+        stop_method=StopMethod.PTRACE,
+    )
+    session = session_mock.return_value.__enter__.return_value
+    assert session.sample.call_count >= 1
+    session.sample.assert_called_with(aggregator)
+    get_process_threads_mock.assert_not_called()
+    assert capsys.readouterr().out == (
+        "<module> (a.py:1);f (a.py:2) 3\n<module> (a.py:1);g (a.py:5) 1\n"
+    )
+
+
+@pytest.mark.parametrize(
+    "extra_args",
+    [
+        ["--native"],
+        ["--locals"],
+        ["--timeout", "1"],
+        ["--tid", "1"],
+        ["--thread-name", "worker-*"],
+        ["--gil-only"],
+        ["--gc-only"],
+        ["--rate", "0"],
+        ["--duration", "-1"],
+    ],
+)
+def test_process_remote_sample_invalid_arguments(extra_args):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--sample", *extra_args]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.SamplingSession") as session_mock,
+        patch("sys.argv", argv),
+    ):
+        # THEN
+
+        with pytest.raises(SystemExit):
+            main()
+
+    session_mock.assert_not_called()
+
+
+def test_process_remote_multiple_pids(capsys):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "32", "31", "--workers", "2"]
+
+    threads = [Mock(), Mock(), Mock()]
+    error = EngineError("Failed to attach", pid=32)
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_processes_threads") as get_processes_threads_mock,
+        patch("pystack.__main__.get_process_threads") as get_process_threads_mock,
+        patch("pystack.__main__.get_process_tree") as get_process_tree_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+        patch.dict("os.environ", {"NO_COLOR": "1"}),
+    ):
+        get_processes_threads_mock.return_value = {31: threads, 32: error}
+        main()
+
+    # THEN
+
+    get_processes_threads_mock.assert_called_once_with(
+        [31, 32],
+        stop_process=True,
         native_mode=NativeReportingMode.OFF,
         locals=False,
-        method=StackMethod.ALL,
+        method=StackMethod.AUTO,
+        frame_pointers=False,
+        stop_method=StopMethod.PTRACE,
+        max_workers=2,
+        group=False,
+        tids=None,
+        thread_name=None,
+        gil_only=False,
+        gc_only=False,
     )
+    get_process_threads_mock.assert_not_called()
+    get_process_tree_mock.assert_not_called()
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+    captured = capsys.readouterr()
+    assert captured.out == "Process 31:\nProcess 32:\n"
+    assert "Failed to attach" in captured.err
+
+
+def test_process_remote_tree():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "--tree"]
+
+    threads = [Mock()]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_processes_threads") as get_processes_threads_mock,
+        patch("pystack.__main__.get_process_tree") as get_process_tree_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        get_process_tree_mock.return_value = [31]
+        get_processes_threads_mock.return_value = {31: threads}
+        main()
+
+    # THEN
+
+    get_process_tree_mock.assert_called_once_with(31)
+    assert get_processes_threads_mock.call_args.args == ([31],)
+    assert get_processes_threads_mock.call_args.kwargs["max_workers"] == 8
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
 
+def test_process_remote_multiple_pids_all_failed():
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "32"]
+
+    first_error = EngineError("Failed to attach", pid=31)
+    second_error = EngineError("Failed to attach", pid=32)
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_processes_threads") as get_processes_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("pystack.__main__._exit_with_code") as exit_mock,
+        patch("sys.argv", argv),
+    ):
+        get_processes_threads_mock.return_value = {31: first_error, 32: second_error}
+        main()
+
+    # THEN
+
+    print_threads_mock.assert_not_called()
+    exit_mock.assert_called_once_with(first_error)
+
+
+@pytest.mark.parametrize(
+    "extra_args",
+    [
+        ["--sample"],
+        ["--timings"],
+        ["--timeout", "1"],
+        ["--workers", "0"],
+    ],
+)
+def test_process_remote_multiple_pids_invalid_arguments(extra_args):
+    # GIVEN
+
+    argv = ["pystack", "remote", "31", "32", *extra_args]
+
+    # WHEN
+
+    with (
+        patch("pystack.__main__.get_processes_threads") as get_processes_threads_mock,
+        patch("sys.argv", argv),
+    ):
+        # THEN
+
+        with pytest.raises(SystemExit):
+            main()
+
+    get_processes_threads_mock.assert_not_called()
+
+
+def test_format_timings():
+    # GIVEN
+
+    timings = {
+        "phases": {"maps_parsing": 0.0005, "frame_decode": 0.25},
+        "total": 0.5,
+        "target_stopped": None,
+        "stop_skew": None,
+    }
+
+    # WHEN
+
+    with patch.dict("os.environ", {"NO_COLOR": "1"}):
+        result = format_timings(timings)
+
+    # THEN
+
+    assert result.splitlines() == [
+        "Timings:",
+        "  maps parsing                 0.500 ms",
+        "  frame decode               250.000 ms",
+        "  total                      500.000 ms",
+    ]
+
+
 @pytest.mark.parametrize(
     "exception, exval", [(EngineError, 1), (InvalidPythonProcess, 2)]
 )
@@ -419,6 +974,11 @@ def test_process_core_default_without_executable():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -467,6 +1027,11 @@ def test_process_core_default_gzip_without_executable():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
     gzip_open_mock.assert_called_with(Path("corefile.gz"), "rb")
@@ -557,6 +1122,11 @@ def test_process_core_default_with_executable():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -567,6 +1137,7 @@ def test_process_core_default_with_executable():
         ["--native", NativeReportingMode.PYTHON],
         ["--native-all", NativeReportingMode.ALL],
         ["--native-last", NativeReportingMode.LAST],
+        ["--native-symbols", NativeReportingMode.SYMBOLS],
     ],
 )
 def test_process_core_native(argument, mode):
@@ -601,6 +1172,11 @@ def test_process_core_native(argument, mode):
         native_mode=mode,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, mode)
 
@@ -637,6 +1213,61 @@ def test_process_core_locals():
         native_mode=NativeReportingMode.OFF,
         locals=True,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
+    )
+    print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
+
+
+def test_process_core_thread_filters():
+    # GIVEN
+
+    argv = [
+        "pystack",
+        "core",
+        "corefile",
+        "executable",
+        "--tid",
+        "7",
+        "--gil-only",
+        "--gc-only",
+    ]
+
+    threads = [Mock()]
+
+    # WHEN
+
+    with (
+        patch(
+            "pystack.__main__.get_process_threads_for_core"
+        ) as get_process_threads_mock,
+        patch("pystack.__main__.print_threads") as print_threads_mock,
+        patch("sys.argv", argv),
+        patch("pathlib.Path.exists", return_value=True),
+        patch("pystack.__main__.CoreFileAnalyzer"),
+        patch("pystack.__main__.is_elf", return_value=True),
+        patch("pystack.__main__.is_gzip", return_value=False),
+    ):
+        get_process_threads_mock.return_value = threads
+        main()
+
+    # THEN
+
+    get_process_threads_mock.assert_called_with(
+        Path("corefile"),
+        Path("executable"),
+        library_search_path="",
+        native_mode=NativeReportingMode.OFF,
+        locals=False,
+        method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=[7],
+        gil_only=True,
+        gc_only=True,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -680,6 +1311,11 @@ def test_process_core_with_search_path():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -727,6 +1363,11 @@ def test_process_core_with_search_root():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -905,6 +1546,11 @@ def test_process_core_exhaustive():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.ALL,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
     print_threads_mock.assert_called_once_with(threads, NativeReportingMode.OFF)
 
@@ -1322,4 +1968,9 @@ def test_executable_is_not_elf_uses_the_first_map():
         native_mode=NativeReportingMode.OFF,
         locals=False,
         method=StackMethod.AUTO,
+        timings=None,
+        group=False,
+        tids=None,
+        gil_only=False,
+        gc_only=False,
     )
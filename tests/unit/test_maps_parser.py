@@ -0,0 +1,137 @@
+from pathlib import Path
+
+import pytest
+
+from pystack._pystack import _parse_maps_for_testing
+from pystack.maps import VirtualMap
+
+
+@pytest.mark.parametrize(
+    "line, expected",
+    [
+        pytest.param(
+            "7f1ac1e2b000-7f1ac1e2d000 r-xp 00002000 08:01 1234567"
+            "                    /usr/lib/libfoo.so.1",
+            VirtualMap(
+                start=0x7F1AC1E2B000,
+                end=0x7F1AC1E2D000,
+                filesize=0x2000,
+                offset=0x2000,
+                device="08:01",
+                flags="r-xp",
+                inode=1234567,
+                path=Path("/usr/lib/libfoo.so.1"),
+            ),
+            id="library",
+        ),
+        pytest.param(
+            "55d0c4a00000-55d0c4a01000 rw-p 00000000 fd:02 42"
+            "  /home/user/my project/lib with spaces.so",
+            VirtualMap(
+                start=0x55D0C4A00000,
+                end=0x55D0C4A01000,
+                filesize=0x1000,
+                offset=0,
+                device="fd:02",
+                flags="rw-p",
+                inode=42,
+                path=Path("/home/user/my project/lib with spaces.so"),
+            ),
+            id="path-with-spaces",
+        ),
+        pytest.param(
+            "7f1ac1e00000-7f1ac1e01000 r--s 00000000 00:05 9"
+            "  /memfd:arena (deleted)",
+            VirtualMap(
+                start=0x7F1AC1E00000,
+                end=0x7F1AC1E01000,
+                filesize=0x1000,
+                offset=0,
+                device="00:05",
+                flags="r--s",
+                inode=9,
+                path=Path("/memfd:arena (deleted)"),
+            ),
+            id="deleted-file",
+        ),
+        pytest.param(
+            "ffffffffff600000-ffffffffff601000 --xp 00000000 00:00 0"
+            "                  [vsyscall]",
+            VirtualMap(
+                start=0xFFFFFFFFFF600000,
+                end=0xFFFFFFFFFF601000,
+                filesize=0x1000,
+                offset=0,
+                device="00:00",
+                flags="--xp",
+                inode=0,
+                path=Path("[vsyscall]"),
+            ),
+            id="vsyscall",
+        ),
+        pytest.param(
+            "7f1ac1c00000-7f1ac1e00000 rw-p 00000000 00:00 0 ",
+            VirtualMap(
+                start=0x7F1AC1C00000,
+                end=0x7F1AC1E00000,
+                filesize=0x200000,
+                offset=0,
+                device="00:00",
+                flags="rw-p",
+                inode=0,
+                path=None,
+            ),
+            id="anonymous",
+        ),
+        pytest.param(
+            "7f1ac1c00000-7f1ac1e00000 rw-p 00000000 00:00 0",
+            VirtualMap(
+                start=0x7F1AC1C00000,
+                end=0x7F1AC1E00000,
+                filesize=0x200000,
+                offset=0,
+                device="00:00",
+                flags="rw-p",
+                inode=0,
+                path=None,
+            ),
+            id="no-pathname",
+        ),
+    ],
+)
+def test_parse_maps_line(line, expected):
+    # WHEN
+
+    maps = _parse_maps_for_testing(line + "\n")
+
+    # THEN
+
+    assert maps == [expected]
+
+
+@pytest.mark.parametrize(
+    "line",
+    [
+        pytest.param("", id="empty"),
+        pytest.param("garbage", id="garbage"),
+        pytest.param("7f1ac1c00000 rw-p 00000000 00:00 0", id="missing-end"),
+        pytest.param("7f1ac1c00000-7f1ac1e00000 rw 00000000 00:00 0", id="short-flags"),
+        pytest.param("7f1ac1c00000-7f1ac1e00000 rw-p 00000000 0000 0", id="bad-device"),
+        pytest.param("7f1ac1c00000-7f1ac1e00000 rw-p 00000000 00:00", id="no-inode"),
+    ],
+)
+def test_parse_maps_skips_unrecognized_lines(line):
+    # GIVEN
+
+    contents = (
+        f"{line}\n"
+        "7f1ac1e2b000-7f1ac1e2d000 r-xp 00002000 08:01 1234567 /usr/lib/libfoo.so.1"
+    )
+
+    # WHEN
+
+    maps = _parse_maps_for_testing(contents)
+
+    # THEN
+
+    assert [vmap.path for vmap in maps] == [Path("/usr/lib/libfoo.so.1")]
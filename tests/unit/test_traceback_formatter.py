@@ -106,6 +106,68 @@ def test_traceback_formatter_no_frames_no_native():
     assert lines == ["The frame stack for thread 1 is empty"]
 
 
+def test_traceback_formatter_grouped_threads():
+    # GIVEN
+
+    code = PyCodeObject(
+        filename="file1.py",
+        scope="function1",
+        location=LocationInfo(1, 1, 0, 0),
+    )
+    frame = PyFrame(
+        prev=None,
+        next=None,
+        code=code,
+        arguments={},
+        locals={},
+        is_entry=True,
+        is_shim=False,
+    )
+    thread = PyThread(
+        tid=1,
+        frame=frame,
+        native_frames=[],
+        holds_the_gil=False,
+        is_gc_collecting=False,
+        python_version=(3, 8),
+        name="worker",
+        tids=[1, 7, 9],
+    )
+
+    # WHEN
+
+    lines = list(format_thread(thread, NativeReportingMode.OFF))
+
+    # THEN
+
+    assert lines == [
+        "Traceback for 3 threads (1, 7, 9) (worker) [] (most recent call last):",
+        '    (Python) File "file1.py", line 1, in function1',
+    ]
+
+
+def test_traceback_formatter_grouped_threads_no_frames():
+    # GIVEN
+
+    thread = PyThread(
+        tid=1,
+        frame=None,
+        native_frames=[],
+        holds_the_gil=False,
+        is_gc_collecting=False,
+        python_version=(3, 8),
+        tids=[1, 2],
+    )
+
+    # WHEN
+
+    lines = list(format_thread(thread, NativeReportingMode.OFF))
+
+    # THEN
+
+    assert lines == ["The frame stack for 2 threads (1, 2) is empty"]
+
+
 def test_traceback_formatter_no_frames_native():
     # GIVEN
 
@@ -228,3 +228,17 @@ def test_dead_thread():
     # THEN
 
     assert state == "[Thread terminated]"
+
+
+def test_incomplete_thread():
+    # GIVEN
+
+    thread = PyThread(1, None, [], 1, 0, (3, 8), complete=False)
+
+    # WHEN
+
+    state = thread.status
+
+    # THEN
+
+    assert state == "[Has the GIL,Incomplete]"
@@ -0,0 +1,90 @@
+import pytest
+
+from pystack._pystack import _get_version_from_elf_section_for_testing
+
+GET_VERSION_FORMAT = b"\0%.80s (%.80s) %.80s\0"
+
+
+@pytest.mark.parametrize(
+    "data, expected",
+    [
+        pytest.param(b"", None, id="empty"),
+        pytest.param(
+            b"\0junk\x003.8.10 (default, May 26 2023, 14:05:08)\0",
+            (3, 8),
+            id="full-version-string",
+        ),
+        pytest.param(
+            b"\x003.13.0 experimental free-threading build "
+            b"(main, Oct  7 2024, 05:02:14)\0",
+            (3, 13),
+            id="free-threading-build",
+        ),
+        pytest.param(
+            b"\x002.7.18+ (default, Aug  4 2023, 11:27:46)\0",
+            (2, 7),
+            id="patched-version",
+        ),
+        pytest.param(
+            b"\x003.8.10 (" + b"x" * 80 + b")\0",
+            None,
+            id="build-information-too-long",
+        ),
+        pytest.param(
+            b"\x003.8.10 (default\n)\0",
+            None,
+            id="build-information-across-lines",
+        ),
+        pytest.param(b"\x003.9.7\0", None, id="literal-without-format"),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.9.7\0",
+            (3, 9),
+            id="literal-with-format",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.12.0rc1\0",
+            (3, 12),
+            id="prerelease-literal",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.9.7x\0",
+            None,
+            id="literal-not-terminated",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"13.9.7\0",
+            None,
+            id="literal-inside-number",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.1234.0\0",
+            None,
+            id="literal-minor-too-long",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.9.7\0abc\x003.9.7\0",
+            (3, 9),
+            id="agreeing-literals",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT + b"3.0.2\0abc\x003.9.7\0",
+            None,
+            id="disagreeing-literals",
+        ),
+        pytest.param(
+            GET_VERSION_FORMAT
+            + b"3.9.1\0"
+            + b"3.10.4 (main, Apr  2 2022, 09:04:19) [GCC 11.2.0]\0",
+            (3, 10),
+            id="full-version-string-preferred",
+        ),
+    ],
+)
+def test_get_version_from_elf_section(data, expected):
+    # WHEN
+
+    version = _get_version_from_elf_section_for_testing(data)
+
+    # THEN
+
+    assert version == expected